@@ -0,0 +1,38 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Windows/Threading.h"
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		// Lock free float updates through a compare exchange on the bit pattern, for values accumulated by many threads
+		inline bool CompareExchange(volatile float* pDest, const float oldValue, const float newValue)
+		{
+			const long oldBits = *(const long*)&oldValue;
+			const long newBits = *(const long*)&newValue;
+			return InterlockedCompareExchange((volatile long*)pDest, newBits, oldBits) == oldBits;
+		}
+
+		inline void AtomicAdd(volatile float* pDest, const float value)
+		{
+			float oldValue;
+			do
+			{
+				oldValue = *pDest;
+			} while (!CompareExchange(pDest, oldValue, oldValue + value));
+		}
+
+		inline void AtomicMax(volatile float* pDest, const float value)
+		{
+			float oldValue;
+			do
+			{
+				oldValue = *pDest;
+				if (oldValue >= value)
+					return;
+			} while (!CompareExchange(pDest, oldValue, value));
+		}
+	}
+}
@@ -2,6 +2,7 @@
 #include "BSDF.h"
 #include "Ray.h"
 #include "Scene.h"
+#include "Primitive.h"
 #include "DifferentialGeom.h"
 #include "Sampler.h"
 #include "Graphics/Color.h"
@@ -285,18 +286,7 @@ endfor
 			int channel = Math::Min(3.0f * u, 2);
 			u = u * 3.0f - channel;
 
-			auto DiffuseMeamFreePathFitting = [](const float A) -> float
-			{
-				const float tempTerm = A - 0.33f;
-				return 3.5f + 100.0f * tempTerm * tempTerm * tempTerm * tempTerm;
-			};
-
-			Vector3 S;
-			Color diffuseReflectance = mpBSDF->GetValue(mpBSDF->GetTexture(), diffGeom);
-			for (auto ch = 0; ch < 3; ch++)
-				S[ch] = DiffuseMeamFreePathFitting(diffuseReflectance[ch]);
-
-			Vector3 D = mMeanFreePathLength * mScale / S;
+			Vector3 D = DiffusionLength(diffGeom);
 
 			float d = D[channel];
 			float radius = SampleRadius(sample.u, d);
@@ -315,35 +305,16 @@ endfor
 			Vector3 rayDir = (target - base) / isectHeight;
 			Ray projRay = Ray(base, rayDir, nullptr, isectHeight);
 
-			struct IntersectionChain
-			{
-				DifferentialGeom diffGeom;
-				IntersectionChain *pNext;
-
-				IntersectionChain()
-					: pNext(nullptr)
-				{
-				}
-			};
-			IntersectionChain* pChain = memory.Alloc<IntersectionChain>();
-			*pChain = IntersectionChain();
+			// Probe hits can only lie on the primitive the path entered, keep the ones sharing this material
+			Intersection isects[MAX_PROBE_HITS];
+			const int numHits = pScene->IntersectAll(diffGeom.mPrimId, projRay, isects, MAX_PROBE_HITS);
+			const auto& pPrim = pScene->GetPrimitives()[diffGeom.mPrimId];
 
-			IntersectionChain* pPtr = pChain;
 			int numIsect = 0;
-			while (pScene->Intersect(projRay, &pPtr->diffGeom))
+			for (auto i = 0; i < numHits; i++)
 			{
-				pScene->PostIntersect(projRay, &pPtr->diffGeom);
-
-				isectHeight -= pPtr->diffGeom.mDist;
-				projRay = Ray(projRay.CalcPoint(pPtr->diffGeom.mDist), rayDir, nullptr, isectHeight);
-
-				if (pPtr->diffGeom.mpBSSRDF == this)
-				{
-					pPtr->pNext = memory.Alloc<IntersectionChain>();
-					pPtr = pPtr->pNext;
-					*pPtr = IntersectionChain();
-					numIsect++;
-				}
+				if (pPrim->GetBSSRDF(isects[i].mTriId) == this)
+					isects[numIsect++] = isects[i];
 			}
 
 			if (numIsect == 0)
@@ -352,10 +323,11 @@ endfor
 				return Color::BLACK;
 			}
 
+			// Only the selected hit is fully evaluated
 			int selected = Math::Clamp(u * numIsect, 0, numIsect - 1);
-			while (selected-- > 0)
-				pChain = pChain->pNext;
-			*pSampledDiffGeom = pChain->diffGeom;
+			*pSampledDiffGeom = DifferentialGeom();
+			*static_cast<Intersection*>(pSampledDiffGeom) = isects[selected];
+			pScene->PostIntersect(projRay, pSampledDiffGeom);
 
 			*pPdf = Pdf_Sample(radius, D, diffGeom, *pSampledDiffGeom) / float(numIsect);
 			pSampledDiffGeom->mpBSDF = mAdapter.Get();
@@ -364,6 +336,22 @@ endfor
 			return Color(actualDist * NormalizeDiffusion(actualDist, D) * float(Math::EDX_INV_PI));
 		}
 
+		Vector3 BSSRDF::DiffusionLength(const DifferentialGeom& diffGeom) const
+		{
+			auto DiffuseMeamFreePathFitting = [](const float A) -> float
+			{
+				const float tempTerm = A - 0.33f;
+				return 3.5f + 100.0f * tempTerm * tempTerm * tempTerm * tempTerm;
+			};
+
+			Vector3 S;
+			Color diffuseReflectance = mpBSDF->GetValue(mpBSDF->GetTexture(), diffGeom);
+			for (auto ch = 0; ch < 3; ch++)
+				S[ch] = DiffuseMeamFreePathFitting(diffuseReflectance[ch]);
+
+			return mMeanFreePathLength * mScale / S;
+		}
+
 		float BSSRDF::EvalWi(const Vector3& wi) const
 		{
 			float Fi = BSDF::FresnelDielectric(BSDFCoordinate::CosTheta(wi), mEtai, mEtat);
@@ -38,6 +38,9 @@ namespace EDX
 			static const int LUTSize = 1024;
 			static float ScatteredDistLUT[LUTSize];
 
+			// Probe rays rarely cross a surface more than a few times within the sampled radius
+			static const int MAX_PROBE_HITS = 32;
+
 			const BSDF* mpBSDF;
 			Vector3 mMeanFreePathLength;
 			UniquePtr<BSSRDFAdapter> mAdapter;
@@ -65,18 +68,9 @@ namespace EDX
 
 			float EvalWi(const Vector3& wi) const;
 
-			Vector3 GetMeanFreePath() const
-			{
-				return mMeanFreePathLength;
-			}
+			// Per channel shape parameter of the diffusion profile at the surface point
+			Vector3 DiffusionLength(const DifferentialGeom& diffGeom) const;
 
-			void SetMeanFreePath(const Vector3& inMFP, const float scale = 1.0f)
-			{
-				mMeanFreePathLength = inMFP;
-				mScale = scale;
-			}
-
-		private:
 			inline Vector3 NormalizeDiffusion(const float r, const Vector3& D) const
 			{
 				if (r == 0.0f)
@@ -94,6 +88,29 @@ namespace EDX
 						(8.0f * float(Math::EDX_PI) * d * r);
 			}
 
+			// BSDF of the points where light enters or leaves the surface
+			const BSDF* GetAdapter() const
+			{
+				return mAdapter.Get();
+			}
+
+			Vector3 GetMeanFreePath() const
+			{
+				return mMeanFreePathLength;
+			}
+
+			float GetScale() const
+			{
+				return mScale;
+			}
+
+			void SetMeanFreePath(const Vector3& inMFP, const float scale = 1.0f)
+			{
+				mMeanFreePathLength = inMFP;
+				mScale = scale;
+			}
+
+		private:
 			float SampleRadius(const float u, const float d, float* pPdf = nullptr) const;
 			float Pdf_Radius(const float radius, const float d) const;
 			float Pdf_Sample(const float radius, const Vector3& D, const DifferentialGeom& diffGeomOut, const DifferentialGeom& diffGeomIn) const;
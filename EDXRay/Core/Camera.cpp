@@ -55,7 +55,7 @@ namespace EDX
 				}
 			}
 
-			mpApertureDistribution = MakeUnique<Sampling::Distribution2D>(apetureFunc.Data(), ApertureSize, ApertureSize);
+			mpApertureDistribution = MakeUnique<Sampling::AliasDistribution2D>(apetureFunc.Data(), ApertureSize, ApertureSize);
 		}
 
 		void Camera::Init(const Vector3& pos,
@@ -193,7 +193,7 @@ namespace EDX
 			int ApertureWidth, AperturaHeight, Channel;
 			float* pFunc = Bitmap::ReadFromFile<float>(path, &ApertureWidth, &AperturaHeight, &Channel);
 
-			mpApertureDistribution = MakeUnique<Sampling::Distribution2D>(pFunc, ApertureWidth, AperturaHeight);
+			mpApertureDistribution = MakeUnique<Sampling::AliasDistribution2D>(pFunc, ApertureWidth, AperturaHeight);
 			Memory::SafeDeleteArray(pFunc);
 		}
 	}
@@ -38,7 +38,7 @@ namespace EDX
 			Vector3 mDyCam;
 
 		private:
-			UniquePtr<Sampling::Distribution2D>	mpApertureDistribution;
+			UniquePtr<Sampling::AliasDistribution2D>	mpApertureDistribution;
 
 		public:
 			Camera();
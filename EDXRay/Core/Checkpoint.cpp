@@ -0,0 +1,178 @@
+#include "Checkpoint.h"
+#include "Core/Memory.h"
+
+#include <cstdio>
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		RenderCheckpoint::RenderCheckpoint(const char* path, const float interval, const RenderJobDesc& jobDesc, const TaskSynchronizer& taskSync)
+			: mInterval(interval)
+			, mLastSaveTime(0.0f)
+			, mJobDesc(jobDesc)
+			, mTaskSync(taskSync)
+			, mWriteTask(this)
+			, mWriting(false)
+		{
+			CStringUtil::Strcpy(mPath, MAX_PATH, path ? path : "");
+			mTimer.Start();
+		}
+
+		void RenderCheckpoint::OnPassFinished(const Film* pFilm)
+		{
+			// A pass cut short by an abort leaves the film half accumulated
+			if (mTaskSync.Aborted())
+				return;
+
+			const float currentTime = mTimer.GetElapsedTime();
+			if (currentTime - mLastSaveTime < mInterval)
+				return;
+
+			{
+				ScopeLock lock(&mCS);
+				if (mWriting)
+					return;
+
+				mWriting = true;
+			}
+
+			pFilm->SaveState(&mPendingState);
+			mLastSaveTime = currentTime;
+
+			QueuedThreadPool::Instance()->AddQueuedWork(&mWriteTask);
+		}
+
+		bool RenderCheckpoint::Flush(const Film* pFilm)
+		{
+			WaitForPendingWrite();
+
+			pFilm->SaveState(&mPendingState);
+			mLastSaveTime = mTimer.GetElapsedTime();
+
+			return Commit(mPendingState);
+		}
+
+		void RenderCheckpoint::WaitForPendingWrite()
+		{
+			while (true)
+			{
+				{
+					ScopeLock lock(&mCS);
+					if (!mWriting)
+						return;
+				}
+
+				Sleep(1);
+			}
+		}
+
+		bool RenderCheckpoint::Commit(const FilmState& state)
+		{
+			return Save(mPath, state, mJobDesc.IntegratorType, mJobDesc.CameraParams);
+		}
+
+		void RenderCheckpoint::WritePendingState()
+		{
+			Commit(mPendingState);
+
+			ScopeLock lock(&mCS);
+			mWriting = false;
+		}
+
+		bool RenderCheckpoint::Save(const char* path, const FilmState& state, const EIntegratorType integratorType, const CameraParameters& cameraParams)
+		{
+			// Write to a temporary file first so that a crash mid-write never destroys the previous checkpoint
+			char tempPath[MAX_PATH];
+			sprintf_s(tempPath, MAX_PATH, "%s.tmp", path);
+
+			FILE* pFile = nullptr;
+			if (fopen_s(&pFile, tempPath, "wb") != 0 || !pFile)
+				return false;
+
+			Header header;
+			header.Magic = Header::MAGIC;
+			header.Version = Header::VERSION;
+			header.IntegratorType = int(integratorType);
+			header.CameraParams = cameraParams;
+			header.Width = state.Width;
+			header.Height = state.Height;
+			header.SampleCount = state.SampleCount;
+			header.SplatScale = state.SplatScale;
+			header.AccumulationSize = state.Accumulation.Size();
+			header.HistogramSize = state.Histogram.Size();
+
+			bool succeeded = fwrite(&header, sizeof(Header), 1, pFile) == 1;
+			if (succeeded && header.AccumulationSize > 0)
+				succeeded = fwrite(state.Accumulation.Data(), sizeof(float), header.AccumulationSize, pFile) == header.AccumulationSize;
+			if (succeeded && header.HistogramSize > 0)
+				succeeded = fwrite(state.Histogram.Data(), sizeof(float), header.HistogramSize, pFile) == header.HistogramSize;
+
+			fclose(pFile);
+
+			if (!succeeded)
+			{
+				remove(tempPath);
+				return false;
+			}
+
+			return MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING) != 0;
+		}
+
+		bool RenderCheckpoint::Load(const char* path, FilmState* pState, EIntegratorType* pIntegratorType, CameraParameters* pCameraParams)
+		{
+			Assert(pState);
+			Assert(pIntegratorType);
+			Assert(pCameraParams);
+
+			FILE* pFile = nullptr;
+			if (fopen_s(&pFile, path, "rb") != 0 || !pFile)
+				return false;
+
+			Header header;
+			bool succeeded = fread(&header, sizeof(Header), 1, pFile) == 1 &&
+				header.Magic == Header::MAGIC &&
+				header.Version == Header::VERSION;
+
+			if (succeeded)
+			{
+				pState->Width = header.Width;
+				pState->Height = header.Height;
+				pState->SampleCount = header.SampleCount;
+				pState->SplatScale = header.SplatScale;
+				pState->Accumulation.Resize(header.AccumulationSize);
+				pState->Histogram.Resize(header.HistogramSize);
+
+				if (header.AccumulationSize > 0)
+					succeeded = fread(pState->Accumulation.Data(), sizeof(float), header.AccumulationSize, pFile) == header.AccumulationSize;
+				if (succeeded && header.HistogramSize > 0)
+					succeeded = fread(pState->Histogram.Data(), sizeof(float), header.HistogramSize, pFile) == header.HistogramSize;
+
+				*pIntegratorType = EIntegratorType(header.IntegratorType);
+				*pCameraParams = header.CameraParams;
+			}
+
+			fclose(pFile);
+			return succeeded;
+		}
+
+		bool RenderCheckpoint::SameView(const CameraParameters& lhs, const CameraParameters& rhs)
+		{
+			auto SameVector = [](const Vector3& a, const Vector3& b)
+			{
+				return a.x == b.x && a.y == b.y && a.z == b.z;
+			};
+
+			// Parameters round trip through the file bit exact, so any difference means the camera was changed
+			return SameVector(lhs.Pos, rhs.Pos) &&
+				SameVector(lhs.Target, rhs.Target) &&
+				SameVector(lhs.Up, rhs.Up) &&
+				lhs.NearClip == rhs.NearClip &&
+				lhs.FarClip == rhs.FarClip &&
+				lhs.FocusPlaneDist == rhs.FocusPlaneDist &&
+				lhs.FocalLengthMilliMeters == rhs.FocalLengthMilliMeters &&
+				lhs.FStop == rhs.FStop &&
+				lhs.Vignette == rhs.Vignette;
+		}
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Config.h"
+#include "Film.h"
+#include "TaskSynchronizer.h"
+#include "../ForwardDecl.h"
+
+#include "Windows/Threading.h"
+#include "Windows/Timer.h"
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		class RenderCheckpoint
+		{
+		private:
+			struct Header
+			{
+				static const uint MAGIC = 0x43584445; // "EDXC"
+				static const uint VERSION = 2;
+
+				uint Magic;
+				uint Version;
+				int IntegratorType;
+				CameraParameters CameraParams;	// Samples taken from another view must not be blended in
+				int Width, Height;
+				int SampleCount;
+				float SplatScale;
+				uint AccumulationSize;
+				uint HistogramSize;
+			};
+
+			class QueuedWriteTask : public QueuedWork
+			{
+			private:
+				RenderCheckpoint* mpCheckpoint;
+
+			public:
+				QueuedWriteTask(RenderCheckpoint* pCheckpoint)
+					: mpCheckpoint(pCheckpoint)
+				{
+				}
+
+				void DoThreadedWork()
+				{
+					mpCheckpoint->WritePendingState();
+				}
+
+				void Abandon()
+				{
+				}
+			};
+
+			char mPath[MAX_PATH];
+			float mInterval;
+			float mLastSaveTime;
+			Timer mTimer;
+
+			const RenderJobDesc& mJobDesc;
+			const TaskSynchronizer& mTaskSync;
+
+			// Film state is copied here at a pass boundary and written to disk by the queued task
+			FilmState mPendingState;
+			QueuedWriteTask mWriteTask;
+			bool mWriting;
+			CriticalSection mCS;
+
+		public:
+			RenderCheckpoint(const char* path, const float interval, const RenderJobDesc& jobDesc, const TaskSynchronizer& taskSync);
+			virtual ~RenderCheckpoint()
+			{
+				WaitForPendingWrite();
+			}
+
+			void OnPassFinished(const Film* pFilm);
+			bool Flush(const Film* pFilm);
+			void WaitForPendingWrite();
+
+			static bool Save(const char* path, const FilmState& state, const EIntegratorType integratorType, const CameraParameters& cameraParams);
+			static bool Load(const char* path, FilmState* pState, EIntegratorType* pIntegratorType, CameraParameters* pCameraParams);
+			static bool SameView(const CameraParameters& lhs, const CameraParameters& rhs);
+
+		protected:
+			// Persists a film snapshot, called from a pool thread
+			virtual bool Commit(const FilmState& state);
+
+		private:
+			void WritePendingState();
+		};
+	}
+}
@@ -14,14 +14,23 @@ namespace EDX
 			PathTracing,
 			BidirectionalPathTracing,
 			MultiplexedMLT,
-			StochasticPPM
+			StochasticPPM,
+			PathGuiding,
+			RLPathTracing
 		};
 
 		enum class ESamplerType
 		{
 			Random,
 			Sobol,
-			Metropolis
+			Metropolis,
+			ZSobol
+		};
+
+		enum class ESubsurfaceMode
+		{
+			Stochastic,
+			Hierarchical
 		};
 
 		enum class EFilterType
@@ -39,8 +48,10 @@ namespace EDX
 			EFilterType			FilterType;
 			bool				AdaptiveSample;
 			bool				UseRHF;
+			ESubsurfaceMode		SubsurfaceMode;	// BSSRDF evaluation in the path tracer
 			uint				ImageWidth, ImageHeight;
 			uint				SamplesPerPixel;
+			uint				PassOffset;		// Global index of the first pass, nonzero when the passes are split among workers
 			uint				MaxPathLength;
 			Array<String>		ModelPaths;
 
@@ -64,7 +75,9 @@ namespace EDX
 				FilterType = EFilterType::Gaussian;
 				AdaptiveSample = false;
 				UseRHF = false;
+				SubsurfaceMode = ESubsurfaceMode::Stochastic;
 				SamplesPerPixel = 4096;
+				PassOffset = 0;
 				MaxPathLength = 8;
 			}
 		};
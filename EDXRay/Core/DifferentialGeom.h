@@ -139,7 +139,7 @@ namespace EDX
 		public:
 			const PhaseFunctionHG* mpPhaseFunc;
 
-			MediumScatter(const Vector3& pos = Vector3::ZERO, PhaseFunctionHG* pPhaseFunc = nullptr, const MediumInterface& mediumInterface = MediumInterface())
+			MediumScatter(const Vector3& pos = Vector3::ZERO, const PhaseFunctionHG* pPhaseFunc = nullptr, const MediumInterface& mediumInterface = MediumInterface())
 				: Scatter(pos, Vector3::ZERO, mediumInterface)
 				, mpPhaseFunc(pPhaseFunc)
 			{
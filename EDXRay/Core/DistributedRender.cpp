@@ -0,0 +1,306 @@
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <mstcpip.h>
+
+#include "DistributedRender.h"
+#include "Config.h"
+
+#include <cstdio>
+
+#pragma comment(lib, "ws2_32.lib")
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		namespace
+		{
+			bool SendAll(const SOCKET socket, const void* pData, const uint size)
+			{
+				const char* pBytes = (const char*)pData;
+				uint sent = 0;
+				while (sent < size)
+				{
+					const int ret = send(socket, pBytes + sent, size - sent, 0);
+					if (ret <= 0)
+						return false;
+
+					sent += ret;
+				}
+
+				return true;
+			}
+
+			bool ReceiveAll(const SOCKET socket, void* pData, const uint size)
+			{
+				char* pBytes = (char*)pData;
+				uint received = 0;
+				while (received < size)
+				{
+					const int ret = recv(socket, pBytes + received, size - received, 0);
+					if (ret <= 0)
+						return false;
+
+					received += ret;
+				}
+
+				return true;
+			}
+		}
+
+		RenderWorkerStream::RenderWorkerStream(const int workerIndex, const float interval, const RenderJobDesc& jobDesc, const TaskSynchronizer& taskSync)
+			: RenderCheckpoint(nullptr, interval, jobDesc, taskSync)
+			, mSocket(INVALID_SOCKET)
+			, mWorkerIndex(workerIndex)
+		{
+			WSADATA wsaData;
+			WSAStartup(MAKEWORD(2, 2), &wsaData);
+		}
+
+		RenderWorkerStream::~RenderWorkerStream()
+		{
+			// Pending snapshot still needs the socket
+			WaitForPendingWrite();
+
+			if (mSocket != INVALID_SOCKET)
+				closesocket(mSocket);
+
+			WSACleanup();
+		}
+
+		bool RenderWorkerStream::Connect(const char* host, const int port)
+		{
+			char portName[16];
+			sprintf_s(portName, "%i", port);
+
+			addrinfo hints = {};
+			hints.ai_family = AF_INET;
+			hints.ai_socktype = SOCK_STREAM;
+			hints.ai_protocol = IPPROTO_TCP;
+
+			addrinfo* pAddress = nullptr;
+			if (getaddrinfo(host, portName, &hints, &pAddress) != 0)
+				return false;
+
+			SOCKET connection = socket(pAddress->ai_family, pAddress->ai_socktype, pAddress->ai_protocol);
+			if (connection != INVALID_SOCKET && connect(connection, pAddress->ai_addr, int(pAddress->ai_addrlen)) == SOCKET_ERROR)
+			{
+				closesocket(connection);
+				connection = INVALID_SOCKET;
+			}
+
+			freeaddrinfo(pAddress);
+
+			mSocket = connection;
+			return mSocket != INVALID_SOCKET;
+		}
+
+		bool RenderWorkerStream::Commit(const FilmState& state)
+		{
+			if (mSocket == INVALID_SOCKET)
+				return false;
+
+			WorkerMessage message;
+			message.Magic = WorkerMessage::MAGIC;
+			message.WorkerIndex = mWorkerIndex;
+			message.Width = state.Width;
+			message.Height = state.Height;
+			message.SampleCount = state.SampleCount;
+			message.SplatScale = state.SplatScale;
+			message.AccumulationSize = state.Accumulation.Size();
+			message.HistogramSize = state.Histogram.Size();
+
+			return SendAll(mSocket, &message, sizeof(WorkerMessage)) &&
+				SendAll(mSocket, state.Accumulation.Data(), message.AccumulationSize * sizeof(float)) &&
+				SendAll(mSocket, state.Histogram.Data(), message.HistogramSize * sizeof(float));
+		}
+
+		RenderCoordinator::RenderCoordinator()
+			: mListenSocket(INVALID_SOCKET)
+			, mNumWorkers(0)
+		{
+			WSADATA wsaData;
+			WSAStartup(MAKEWORD(2, 2), &wsaData);
+		}
+
+		RenderCoordinator::~RenderCoordinator()
+		{
+			for (auto i = 0; i < mWorkerSockets.Size(); i++)
+				Close(i);
+
+			if (mListenSocket != INVALID_SOCKET)
+				closesocket(mListenSocket);
+
+			WSACleanup();
+		}
+
+		bool RenderCoordinator::Listen(const int port, const int numWorkers)
+		{
+			mNumWorkers = numWorkers;
+			mWorkerSockets.Clear();
+			mWorkerStates.Clear();
+			for (auto i = 0; i < numWorkers; i++)
+			{
+				mWorkerSockets.Add(INVALID_SOCKET);
+				mWorkerStates.Add(UniquePtr<FilmState>());
+			}
+
+			mListenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			if (mListenSocket == INVALID_SOCKET)
+				return false;
+
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_ANY);
+			address.sin_port = htons(u_short(port));
+
+			return bind(mListenSocket, (sockaddr*)&address, sizeof(address)) != SOCKET_ERROR &&
+				listen(mListenSocket, numWorkers) != SOCKET_ERROR;
+		}
+
+		bool RenderCoordinator::WaitForWorkers()
+		{
+			// Workers identify themselves with their first message, so slots are only assigned in Update
+			const uint64 deadline = GetTickCount64() + CONNECT_TIMEOUT * 1000;
+			int numConnected = 0;
+			while (numConnected < mNumWorkers)
+			{
+				const uint64 now = GetTickCount64();
+				if (now >= deadline)
+					break;
+
+				// Never block in accept, a worker that fails to start would hang the coordinator
+				fd_set acceptSet;
+				FD_ZERO(&acceptSet);
+				FD_SET(mListenSocket, &acceptSet);
+
+				const uint64 remaining = deadline - now;
+				timeval timeout = { long(remaining / 1000), long(remaining % 1000) * 1000 };
+				const int ready = select(0, &acceptSet, nullptr, nullptr, &timeout);
+				if (ready == SOCKET_ERROR)
+					return false;
+				if (ready == 0)
+					break;
+
+				const SOCKET connection = accept(mListenSocket, nullptr, nullptr);
+				if (connection == INVALID_SOCKET)
+					continue;
+
+				// Workers may stay silent for long, e.g. MLT only sends its final film. Keep-alive probes make the
+				// connection of a dead machine fail instead of staying open, a crashed process closes it anyway
+				tcp_keepalive keepAlive = { 1, 30000, 5000 };
+				DWORD bytesReturned;
+				WSAIoctl(connection, SIO_KEEPALIVE_VALS, &keepAlive, sizeof(keepAlive), nullptr, 0, &bytesReturned, nullptr, nullptr);
+
+				mWorkerSockets[numConnected] = connection;
+				numConnected++;
+			}
+
+			if (numConnected < mNumWorkers)
+				printf("Only %i of %i workers connected\n", numConnected, mNumWorkers);
+
+			return numConnected > 0;
+		}
+
+		bool RenderCoordinator::Update(Film* pFilm)
+		{
+			fd_set readSet;
+			FD_ZERO(&readSet);
+			for (auto i = 0; i < mWorkerSockets.Size(); i++)
+			{
+				if (mWorkerSockets[i] != INVALID_SOCKET)
+					FD_SET(mWorkerSockets[i], &readSet);
+			}
+
+			// All workers are done
+			if (readSet.fd_count == 0)
+				return false;
+
+			timeval timeout = { POLL_INTERVAL, 0 };
+			if (select(0, &readSet, nullptr, nullptr, &timeout) == SOCKET_ERROR)
+				return false;
+
+			bool received = false;
+			for (auto i = 0; i < mWorkerSockets.Size(); i++)
+			{
+				// Dead connections become readable and fail in ReceiveAll, which drops them
+				if (mWorkerSockets[i] == INVALID_SOCKET || !FD_ISSET(mWorkerSockets[i], &readSet))
+					continue;
+
+				WorkerMessage message;
+				if (!ReceiveAll(mWorkerSockets[i], &message, sizeof(WorkerMessage)) ||
+					message.Magic != WorkerMessage::MAGIC ||
+					message.WorkerIndex < 0 || message.WorkerIndex >= mNumWorkers)
+				{
+					// Closed by the worker, its last snapshot stays in the merged film
+					Close(i);
+					continue;
+				}
+
+				// Sizes come off the network, a worker rendering another job or resolution is rejected before anything
+				// is allocated for it
+				if (message.Width != pFilm->GetWidth() || message.Height != pFilm->GetHeight() ||
+					message.AccumulationSize != pFilm->GetStateAccumulationSize() ||
+					message.HistogramSize != pFilm->GetStateHistogramSize())
+				{
+					printf("\nRejecting worker %i, its film does not match the coordinator's\n", message.WorkerIndex);
+					Close(i);
+					continue;
+				}
+
+				UniquePtr<FilmState> pState = MakeUnique<FilmState>();
+				pState->Width = message.Width;
+				pState->Height = message.Height;
+				pState->SampleCount = message.SampleCount;
+				pState->SplatScale = message.SplatScale;
+				pState->Accumulation.Resize(message.AccumulationSize);
+				pState->Histogram.Resize(message.HistogramSize);
+
+				if (!ReceiveAll(mWorkerSockets[i], pState->Accumulation.Data(), message.AccumulationSize * sizeof(float)) ||
+					!ReceiveAll(mWorkerSockets[i], pState->Histogram.Data(), message.HistogramSize * sizeof(float)))
+				{
+					Close(i);
+					continue;
+				}
+
+				mWorkerStates[message.WorkerIndex] = Move(pState);
+				received = true;
+			}
+
+			if (received)
+			{
+				// Snapshots are cumulative per worker, so the film is rebuilt from the latest one of each
+				pFilm->Clear();
+				for (auto i = 0; i < mWorkerStates.Size(); i++)
+				{
+					if (mWorkerStates[i])
+						pFilm->MergeState(*mWorkerStates[i]);
+				}
+			}
+
+			return true;
+		}
+
+		void RenderCoordinator::Close(const int workerIndex)
+		{
+			if (mWorkerSockets[workerIndex] != INVALID_SOCKET)
+			{
+				closesocket(mWorkerSockets[workerIndex]);
+				mWorkerSockets[workerIndex] = INVALID_SOCKET;
+			}
+		}
+
+		void RenderCoordinator::AssignPassRange(RenderJobDesc* pJobDesc, const int workerIndex, const int numWorkers)
+		{
+			Assert(workerIndex < numWorkers);
+
+			const uint totalPasses = pJobDesc->SamplesPerPixel;
+			const uint firstPass = totalPasses * workerIndex / numWorkers;
+			const uint lastPass = totalPasses * (workerIndex + 1) / numWorkers;
+
+			// Samplers and integrators offset their seeds by the global pass index, keeping workers decorrelated
+			pJobDesc->PassOffset = firstPass;
+			pJobDesc->SamplesPerPixel = lastPass - firstPass;
+		}
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Checkpoint.h"
+#include "Film.h"
+#include "../ForwardDecl.h"
+
+#include "Core/SmartPointer.h"
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		// Header of a film snapshot streamed from a worker to the coordinator
+		struct WorkerMessage
+		{
+			static const uint MAGIC = 0x57584445; // "EDXW"
+
+			uint Magic;
+			int WorkerIndex;
+			int Width, Height;
+			int SampleCount;
+			float SplatScale;
+			uint AccumulationSize;
+			uint HistogramSize;
+		};
+
+		// Streams the worker's film to the coordinator at pass boundaries
+		class RenderWorkerStream : public RenderCheckpoint
+		{
+		private:
+			UINT_PTR mSocket;
+			int mWorkerIndex;
+
+		public:
+			RenderWorkerStream(const int workerIndex, const float interval, const RenderJobDesc& jobDesc, const TaskSynchronizer& taskSync);
+			~RenderWorkerStream();
+
+			bool Connect(const char* host, const int port);
+
+		protected:
+			bool Commit(const FilmState& state) override;
+		};
+
+		// Collects the films of all workers and merges them into one
+		class RenderCoordinator
+		{
+		private:
+			UINT_PTR mListenSocket;
+			Array<UINT_PTR> mWorkerSockets;
+
+			static const int CONNECT_TIMEOUT = 60;	// Seconds to wait for all workers to connect
+			static const int POLL_INTERVAL = 1;		// Seconds Update waits for snapshots, so callers can check budgets
+
+			// Latest snapshot received from each worker
+			Array<UniquePtr<FilmState>> mWorkerStates;
+			int mNumWorkers;
+
+		public:
+			RenderCoordinator();
+			~RenderCoordinator();
+
+			bool Listen(const int port, const int numWorkers);
+			// Accepts workers until all are connected or CONNECT_TIMEOUT passes, false if none connected
+			bool WaitForWorkers();
+			// Merges the snapshots that arrived within POLL_INTERVAL, false once no worker is left
+			bool Update(Film* pFilm);
+
+			// Splits the passes of a job into disjoint, contiguous ranges
+			static void AssignPassRange(RenderJobDesc* pJobDesc, const int workerIndex, const int numWorkers);
+
+		private:
+			void Close(const int workerIndex);
+		};
+	}
+}
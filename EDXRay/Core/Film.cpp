@@ -1,6 +1,8 @@
 #include "Film.h"
+#include "Checkpoint.h"
 #include "Math/EDXMath.h"
 #include "Graphics/Color.h"
+#include "SIMD/SSE.h"
 
 #include <ppl.h>
 using namespace concurrency;
@@ -27,6 +29,7 @@ namespace EDX
 			mAccumulateBuffer.Free();
 			mAccumulateBuffer.Init(Vector2i(width, height));
 			mSampleCount = 0;
+			mSplatScale = 0.0f;
 		}
 
 		void Film::Release()
@@ -38,6 +41,7 @@ namespace EDX
 		void Film::Clear()
 		{
 			mSampleCount = 0;
+			mSplatScale = 0.0f;
 			mPixelBuffer.Clear();
 			mAccumulateBuffer.Clear();
 		}
@@ -91,6 +95,7 @@ namespace EDX
 		{
 			ScopeLock scopeLock(&mCS);
 
+			mSplatScale = inSplatScale;
 			float splatScale = inSplatScale > 0.0f ?
 				inSplatScale :
 				mSampleCount;
@@ -109,6 +114,93 @@ namespace EDX
 			});
 		}
 
+		// Resolves rows of the accumulation buffer into linear radiance, without gamma
+		void Film::ResolveLinear(Color* pOutput, const int startRow, const int endRow) const
+		{
+			ScopeLock scopeLock(&mCS);
+
+			const float splatScale = mSplatScale > 0.0f ? mSplatScale : Math::Max(mSampleCount, 1);
+			for (auto y = startRow; y < endRow; y++)
+			{
+				for (auto x = 0; x < mWidth; x++)
+				{
+					const Pixel& pixel = mAccumulateBuffer[Vector2i(x, y)];
+					Color color = pixel.color / (pixel.weight + float(Math::EDX_EPSILON)) + pixel.splat / splatScale;
+					color.r = Math::Max(0.0f, color.r);
+					color.g = Math::Max(0.0f, color.g);
+					color.b = Math::Max(0.0f, color.b);
+
+					pOutput[(y - startRow) * mWidth + x] = color;
+				}
+			}
+		}
+
+		void Film::IncreSampleCount(const bool allowCheckpoint)
+		{
+			mSampleCount++;
+
+			if (mpCheckpoint && allowCheckpoint)
+				mpCheckpoint->OnPassFinished(this);
+		}
+
+		void Film::SaveState(FilmState* pState) const
+		{
+			ScopeLock scopeLock(&mCS);
+
+			const int numFloats = mAccumulateBuffer.LinearSize() * sizeof(Pixel) / sizeof(float);
+
+			pState->Width = mWidth;
+			pState->Height = mHeight;
+			pState->SampleCount = mSampleCount;
+			pState->SplatScale = mSplatScale;
+			pState->Accumulation.Resize(numFloats);
+			Memory::Memcpy(pState->Accumulation.Data(), mAccumulateBuffer.Data(), numFloats * sizeof(float));
+		}
+
+		bool Film::RestoreState(const FilmState& state)
+		{
+			{
+				ScopeLock scopeLock(&mCS);
+
+				const int numFloats = mAccumulateBuffer.LinearSize() * sizeof(Pixel) / sizeof(float);
+				if (state.Width != mWidth || state.Height != mHeight || state.Accumulation.Size() != numFloats)
+					return false;
+
+				Memory::Memcpy(mAccumulateBuffer.Data(), state.Accumulation.Data(), numFloats * sizeof(float));
+				mSampleCount = state.SampleCount;
+			}
+
+			ScaleToPixel(state.SplatScale);
+			return true;
+		}
+
+		bool Film::MergeState(const FilmState& state)
+		{
+			{
+				ScopeLock scopeLock(&mCS);
+
+				const int numFloats = mAccumulateBuffer.LinearSize() * sizeof(Pixel) / sizeof(float);
+				if (state.Width != mWidth || state.Height != mHeight || state.Accumulation.Size() != numFloats)
+					return false;
+
+				// Every field of a pixel is a plain sum over samples, so the buffers merge element-wise
+				float* pData = (float*)mAccumulateBuffer.Data();
+				for (auto i = 0; i < numFloats; i++)
+					pData[i] += state.Accumulation[i];
+
+				mSampleCount += state.SampleCount;
+				mSplatScale += state.SplatScale;
+			}
+
+			ScaleToPixel(mSplatScale);
+			return true;
+		}
+
+		uint Film::GetStateAccumulationSize() const
+		{
+			return mAccumulateBuffer.LinearSize() * sizeof(Pixel) / sizeof(float);
+		}
+
 		// Ray Histogram Fusion film implementation
 		void FilmRHF::Init(int width, int height, Filter* pFilter)
 		{
@@ -201,6 +293,78 @@ namespace EDX
 			}
 		}
 
+		void FilmRHF::SaveState(FilmState* pState) const
+		{
+			Film::SaveState(pState);
+
+			ScopeLock scopeLock(&mCS);
+
+			const int pixelCount = mSampleHistogram.totalWeights.LinearSize();
+			const int binSize = pixelCount * sizeof(Color) / sizeof(float);
+
+			pState->Histogram.Resize(Histogram::NUM_BINS * binSize + pixelCount);
+			float* pData = pState->Histogram.Data();
+			for (auto b = 0; b < Histogram::NUM_BINS; b++, pData += binSize)
+				Memory::Memcpy(pData, mSampleHistogram.histogramWeights[b].Data(), binSize * sizeof(float));
+			Memory::Memcpy(pData, mSampleHistogram.totalWeights.Data(), pixelCount * sizeof(float));
+		}
+
+		uint FilmRHF::GetStateHistogramSize() const
+		{
+			const int pixelCount = mSampleHistogram.totalWeights.LinearSize();
+			const int binSize = pixelCount * sizeof(Color) / sizeof(float);
+
+			return Histogram::NUM_BINS * binSize + pixelCount;
+		}
+
+		bool FilmRHF::RestoreState(const FilmState& state)
+		{
+			const int pixelCount = mSampleHistogram.totalWeights.LinearSize();
+			const int binSize = pixelCount * sizeof(Color) / sizeof(float);
+
+			// Checkpoints written by a plain film carry no histograms
+			if (state.Histogram.Size() != Histogram::NUM_BINS * binSize + pixelCount)
+				return false;
+
+			if (!Film::RestoreState(state))
+				return false;
+
+			ScopeLock scopeLock(&mCS);
+
+			const float* pData = state.Histogram.Data();
+			for (auto b = 0; b < Histogram::NUM_BINS; b++, pData += binSize)
+				Memory::Memcpy(mSampleHistogram.histogramWeights[b].Data(), pData, binSize * sizeof(float));
+			Memory::Memcpy(mSampleHistogram.totalWeights.Data(), pData, pixelCount * sizeof(float));
+
+			return true;
+		}
+
+		bool FilmRHF::MergeState(const FilmState& state)
+		{
+			const int pixelCount = mSampleHistogram.totalWeights.LinearSize();
+			const int binSize = pixelCount * sizeof(Color) / sizeof(float);
+
+			if (state.Histogram.Size() != Histogram::NUM_BINS * binSize + pixelCount)
+				return false;
+
+			if (!Film::MergeState(state))
+				return false;
+
+			ScopeLock scopeLock(&mCS);
+
+			const float* pData = state.Histogram.Data();
+			for (auto b = 0; b < Histogram::NUM_BINS; b++, pData += binSize)
+			{
+				float* pBin = (float*)mSampleHistogram.histogramWeights[b].Data();
+				for (auto i = 0; i < binSize; i++)
+					pBin[i] += pData[i];
+			}
+			for (auto i = 0; i < pixelCount; i++)
+				mSampleHistogram.totalWeights[i] += pData[i];
+
+			return true;
+		}
+
 		void FilmRHF::Denoise()
 		{
 			DimensionalArray<2, Color> scaledImage;
@@ -274,50 +438,60 @@ namespace EDX
 			const int width = input.Size(0);
 			const int height = input.Size(1);
 
-			parallel_for(0, height, [&](int y)
+			// Each row scatters its patches into the rows [y - halfPatchSize, y + halfPatchSize], so rows that are
+			// (2 * halfPatchSize + 1) apart never write to the same pixels. Processing the rows in that many
+			// interleaved passes keeps every pass free of shared writes without any locking.
+			const int rowStride = 2 * mHalfPatchSize + 1;
+			for (auto pass = 0; pass < rowStride; pass++)
 			{
-				static const int MAX_PATCH_SIZE = 3;
-				Color tempPatchBuffer[MAX_PATCH_SIZE * MAX_PATCH_SIZE];
-				for (int x = 0; x < width; x++)
+				const int numRows = (height - pass + rowStride - 1) / rowStride;
+				parallel_for(0, numRows, [&](int row)
 				{
-					const auto halfPatchSize = Math::Min(mHalfPatchSize, Math::Min(Math::Min(x, y), Math::Min(width - 1 - x, height - 1 - y)));
-					const auto minX = Math::Max(x - mHalfWindowSize, halfPatchSize);
-					const auto minY = Math::Max(y - mHalfWindowSize, halfPatchSize);
-					const auto maxX = Math::Min(x + mHalfWindowSize, width - 1 - halfPatchSize);
-					const auto maxY = Math::Min(y + mHalfWindowSize, height - 1 - halfPatchSize);
-
-					auto num = 0;
-					Memory::Memset(tempPatchBuffer, 0, sizeof(Color) * MAX_PATCH_SIZE * MAX_PATCH_SIZE);
-					for (auto i = minY; i <= maxY; i++)
+					static const int MAX_PATCH_SIZE = 3;
+					Color tempPatchBuffer[MAX_PATCH_SIZE * MAX_PATCH_SIZE];
+
+					const int y = pass + row * rowStride;
+					for (int x = 0; x < width; x++)
 					{
-						for (auto j = minX; j <= maxX; j++)
+						const auto halfPatchSize = Math::Min(mHalfPatchSize, Math::Min(Math::Min(x, y), Math::Min(width - 1 - x, height - 1 - y)));
+						const auto minX = Math::Max(x - mHalfWindowSize, halfPatchSize);
+						const auto minY = Math::Max(y - mHalfWindowSize, halfPatchSize);
+						const auto maxX = Math::Min(x + mHalfWindowSize, width - 1 - halfPatchSize);
+						const auto maxY = Math::Min(y + mHalfWindowSize, height - 1 - halfPatchSize);
+
+						auto num = 0;
+						Memory::Memset(tempPatchBuffer, 0, sizeof(Color) * MAX_PATCH_SIZE * MAX_PATCH_SIZE);
+						for (auto i = minY; i <= maxY; i++)
 						{
-							float dist = (x != j || y != i) ? ChiSquareDistance(Vector2i(x, y), Vector2i(j, i), halfPatchSize, histogram) : Math::EDX_NEG_INFINITY;
-							if (dist < mMaxDist)
+							for (auto j = minX; j <= maxX; j++)
 							{
-								for (auto h = -halfPatchSize; h <= halfPatchSize; h++)
-									for (auto w = -halfPatchSize; w <= halfPatchSize; w++)
-										tempPatchBuffer[(h + halfPatchSize) * MAX_PATCH_SIZE + w + halfPatchSize] += input[Vector2i(j + w, i + h)];
-
-								num++;
+								float dist = (x != j || y != i) ? ChiSquareDistance(Vector2i(x, y), Vector2i(j, i), halfPatchSize, histogram) : Math::EDX_NEG_INFINITY;
+								if (dist < mMaxDist)
+								{
+									for (auto h = -halfPatchSize; h <= halfPatchSize; h++)
+										for (auto w = -halfPatchSize; w <= halfPatchSize; w++)
+											tempPatchBuffer[(h + halfPatchSize) * MAX_PATCH_SIZE + w + halfPatchSize] += input[Vector2i(j + w, i + h)];
+
+									num++;
+								}
 							}
 						}
-					}
 
-					if (num > 0)
-					{
-						ScopeLock lock(&mRHFLock);
-						for (auto h = -halfPatchSize; h <= halfPatchSize; h++)
+						if (num > 0)
 						{
-							for (auto w = -halfPatchSize; w <= halfPatchSize; w++)
+							const float invNum = 1.0f / float(num);
+							for (auto h = -halfPatchSize; h <= halfPatchSize; h++)
 							{
-								mDenoisedPixelBuffer[Vector2i(x + w, y + h)] += tempPatchBuffer[(h + halfPatchSize) * MAX_PATCH_SIZE + w + halfPatchSize] / float(num);
-								mRHFSampleCount[Vector2i(x + w, y + h)]++;
+								for (auto w = -halfPatchSize; w <= halfPatchSize; w++)
+								{
+									mDenoisedPixelBuffer[Vector2i(x + w, y + h)] += tempPatchBuffer[(h + halfPatchSize) * MAX_PATCH_SIZE + w + halfPatchSize] * invNum;
+									mRHFSampleCount[Vector2i(x + w, y + h)]++;
+								}
 							}
 						}
 					}
-				}
-			});
+				});
+			}
 
 			parallel_for(0, height, [&](int y)
 			{
@@ -332,46 +506,56 @@ namespace EDX
 
 		float FilmRHF::ChiSquareDistance(const Vector2i& coord0, const Vector2i& coord1, const int halfPatchSize, const Histogram& histogram)
 		{
-			int normFactor = 0;
-			int count = 0;
-			auto PixelWiseDist = [this, &normFactor, &count, &histogram](const Vector2i& c0, const Vector2i& c1, const int binIdx) -> float
-			{
-				float ret = 0.0f;
-				for (auto c = 0; c < 3; c++)
-				{
-					const float histo0 = histogram.histogramWeights[binIdx][c0][c];
-					const float histo1 = histogram.histogramWeights[binIdx][c1][c];
-					const float sum = histo0 + histo1;
-					if (sum > 1.0f)
-					{
-						const float weight0 = histogram.totalWeights[c0];
-						const float weight1 = histogram.totalWeights[c1];
+			static_assert(Histogram::NUM_BINS % 4 == 0, "Number of histogram bins must be a multiple of the SSE width.");
 
-						const float diff = weight1 * histo0 - weight0 * histo1;
-
-						ret += diff * diff / ((weight0 * weight1) * sum);
-						normFactor++;
-					}
-					else
-						count++;
-				}
-
-				return ret;
-			};
+			const FloatSSE zero = FloatSSE(Math::EDX_ZERO);
+			const FloatSSE one = FloatSSE(1.0f);
+			const float maxNormFac = 3 * Histogram::NUM_BINS * (2 * halfPatchSize + 1) * (2 * halfPatchSize + 1);
 
 			float patchWiseDist = 0.0f;
-			const float maxNormFac = 3 * Histogram::NUM_BINS * (2 * halfPatchSize + 1) * (2 * halfPatchSize + 1);
-			for (auto binIdx = 0; binIdx < Histogram::NUM_BINS; binIdx++)
+			float normFactor = 0.0f;
+			float processed = 0.0f;
+			for (auto i = -halfPatchSize; i <= halfPatchSize; i++)
 			{
-				for (auto i = -halfPatchSize; i <= halfPatchSize; i++)
+				for (auto j = -halfPatchSize; j <= halfPatchSize; j++)
 				{
-					for (auto j = -halfPatchSize; j <= halfPatchSize; j++)
+					const Vector2i c0 = coord0 + Vector2i(i, j);
+					const Vector2i c1 = coord1 + Vector2i(i, j);
+
+					const FloatSSE weight0 = FloatSSE(histogram.totalWeights[c0]);
+					const FloatSSE weight1 = FloatSSE(histogram.totalWeights[c1]);
+					const FloatSSE weightProd = weight0 * weight1;
+
+					// 4 bins per vector, the 3 channels are accumulated before checking for early termination
+					for (auto binIdx = 0; binIdx < Histogram::NUM_BINS; binIdx += 4)
 					{
-						Vector2i c0 = coord0 + Vector2i(i, j);
-						Vector2i c1 = coord1 + Vector2i(i, j);
+						FloatSSE vecDist = zero;
+						FloatSSE vecNorm = zero;
+						for (auto c = 0; c < 3; c++)
+						{
+							const FloatSSE histo0 = FloatSSE(histogram.histogramWeights[binIdx][c0][c],
+								histogram.histogramWeights[binIdx + 1][c0][c],
+								histogram.histogramWeights[binIdx + 2][c0][c],
+								histogram.histogramWeights[binIdx + 3][c0][c]);
+							const FloatSSE histo1 = FloatSSE(histogram.histogramWeights[binIdx][c1][c],
+								histogram.histogramWeights[binIdx + 1][c1][c],
+								histogram.histogramWeights[binIdx + 2][c1][c],
+								histogram.histogramWeights[binIdx + 3][c1][c]);
+
+							const FloatSSE sum = histo0 + histo1;
+							const BoolSSE valid = sum > 1.0f;
+							const FloatSSE diff = weight1 * histo0 - weight0 * histo1;
+
+							vecDist += SSE::Select(valid, diff * diff / (weightProd * sum), zero);
+							vecNorm += SSE::Select(valid, one, zero);
+						}
 
-						patchWiseDist += PixelWiseDist(c0, c1, binIdx);
+						patchWiseDist += vecDist[0] + vecDist[1] + vecDist[2] + vecDist[3];
+						normFactor += vecNorm[0] + vecNorm[1] + vecNorm[2] + vecNorm[3];
+						processed += 12.0f;
 
+						// Skipped elements so far can no longer contribute to the normalization, so this is a lower bound of the final distance
+						const float count = processed - normFactor;
 						if (patchWiseDist / (maxNormFac - count) >= mMaxDist)
 							return Math::EDX_INFINITY;
 					}
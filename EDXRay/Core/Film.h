@@ -3,6 +3,7 @@
 #include "Filter.h"
 #include "../ForwardDecl.h"
 #include "Graphics/Color.h"
+#include "Containers/Array.h"
 #include "Containers/DimensionalArray.h"
 #include "Core/SmartPointer.h"
 #include "Windows/Threading.h"
@@ -11,6 +12,16 @@ namespace EDX
 {
 	namespace RayTracer
 	{
+		// Raw accumulation state of a film, used for checkpointing
+		struct FilmState
+		{
+			int Width, Height;
+			int SampleCount;
+			float SplatScale;
+			Array<float> Accumulation;
+			Array<float> Histogram;
+		};
+
 		class Film
 		{
 		protected:
@@ -23,15 +34,21 @@ namespace EDX
 
 			int mWidth, mHeight;
 			int mSampleCount;
+			float mSplatScale;
 			DimensionalArray<2, Color>	mPixelBuffer;
 			DimensionalArray<2, Pixel>	mAccumulateBuffer;
 			UniquePtr<Filter> mpFilter;
+			RenderCheckpoint* mpCheckpoint;
 
 			mutable CriticalSection mCS;
 
+		public:
 			static const float INV_GAMMA;
 
-		public:
+			Film()
+				: mpCheckpoint(nullptr)
+			{
+			}
 			virtual ~Film()
 			{
 				Release();
@@ -42,11 +59,24 @@ namespace EDX
 			virtual void Clear();
 			void Release();
 			int GetPixelCount() const { return mPixelBuffer.LinearSize(); }
+			int GetWidth() const { return mWidth; }
+			int GetHeight() const { return mHeight; }
 
 			virtual void AddSample(float x, float y, const Color& sample);
 			virtual void Splat(float x, float y, const Color& sample);
 			void ScaleToPixel(const float splatScale = 0.0f);
-			inline void IncreSampleCount() { mSampleCount++; }
+			void ResolveLinear(Color* pOutput, const int startRow, const int endRow) const;
+			// Checkpoints the film at pass boundaries, callers that keep writing to the film concurrently have to
+			// pass false since the saved state would be torn
+			void IncreSampleCount(const bool allowCheckpoint = true);
+
+			virtual void SaveState(FilmState* pState) const;
+			virtual bool RestoreState(const FilmState& state);
+			virtual bool MergeState(const FilmState& state);
+			// Float counts of the buffers in a state saved by this film, for validating states from outside
+			virtual uint GetStateAccumulationSize() const;
+			virtual uint GetStateHistogramSize() const { return 0; }
+			void SetCheckpoint(RenderCheckpoint* pCheckpoint) { mpCheckpoint = pCheckpoint; }
 
 			const Color* GetPixelBuffer() const { return mPixelBuffer.Data(); }
 			const int GetSampleCount() const { return mSampleCount; }
@@ -86,8 +116,6 @@ namespace EDX
 			int			mHalfWindowSize;
 			int			mScale;
 
-			CriticalSection mRHFLock;
-
 		public:
 			void Init(int width, int height, Filter* pFilter);
 			void Resize(int width, int height);
@@ -96,6 +124,11 @@ namespace EDX
 			void AddSample(float x, float y, const Color& sample);
 			void Denoise();
 
+			void SaveState(FilmState* pState) const;
+			bool RestoreState(const FilmState& state);
+			bool MergeState(const FilmState& state);
+			uint GetStateHistogramSize() const;
+
 		private:
 			void HistogramFusion(DimensionalArray<2, Color>& input, const Histogram& histogram);
 			float ChiSquareDistance(const Vector2i& x, const Vector2i& y, const int halfPatchSize, const Histogram& histogram);
@@ -1,4 +1,5 @@
 #include "Integrator.h"
+#include "TiledRender.h"
 #include "Scene.h"
 #include "Light.h"
 #include "Medium.h"
@@ -20,62 +21,64 @@ namespace EDX
 	{
 		void TiledIntegrator::Render(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const
 		{
-			for (int spp = 0; spp < mJobDesc.SamplesPerPixel; spp++)
-			{
-				int numTiles = mTaskSync.GetNumTiles();
+			if (!RenderSpecialized(pScene, pCamera, pSampler, pFilm))
+				RenderTiles<TiledIntegrator, Sampler>(pScene, pCamera, pSampler, pFilm);
+		}
 
-				parallel_for(0, numTiles, [&](int i)
-				{
-					const RenderTile& tile = mTaskSync.GetTile(i);
+		Color Integrator::EstimateDirectLighting(const Scatter& scatter,
+			const Vector3& outDir,
+			const Light* pLight,
+			const Scene* pScene,
+			Sampler* pSampler,
+			ScatterType scatterType)
+		{
+			DirectLightingSample sample;
+			GetSampleVector(pSampler, &sample);
 
-					// Clone a sampler for this tile
-					UniquePtr<Sampler> pTileSampler(pSampler->Clone(spp * numTiles + i));
+			return EstimateDirectLighting(scatter, outDir, pLight, pScene, sample, pSampler, scatterType);
+		}
 
-					RandomGen random;
-					MemoryPool memory;
+		Color Integrator::EstimateEquiangularScattering(const Ray& ray,
+			const Vector3& lightPoint,
+			const Light* pLight,
+			const Scene* pScene,
+			const float distanceSample,
+			const DirectLightingSample& sample,
+			Sampler* pSampler)
+		{
+			const Medium* pMedium = ray.mpMedium;
 
-					for (auto y = tile.minY; y < tile.maxY; y++)
-					{
-						for (auto x = tile.minX; x < tile.maxX; x++)
-						{
-							if (mTaskSync.Aborted())
-								return;
-
-							pTileSampler->StartPixel(x, y);
-							CameraSample camSample;
-							pTileSampler->GenerateSamples(x, y, &camSample, random);
-							camSample.imageX += x;
-							camSample.imageY += y;
-
-							RayDifferential ray;
-							Color L = Color::BLACK;
-							if (pCamera->GenRayDifferential(camSample, &ray))
-							{
-								L = Li(ray, pScene, pTileSampler.Get(), random, memory);
-							}
+			float dist, equiangularPdf;
+			if (!Sampling::SampleEquiangular(distanceSample, ray.mOrg, ray.mDir, ray.mMax, lightPoint, &dist, &equiangularPdf))
+				return Color::BLACK;
 
-							pFilm->AddSample(camSample.imageX, camSample.imageY, L);
-							memory.FreeAll();
-						}
-					}
-				});
+			Color transmittance, sigmaS;
+			float distancePdf;
+			if (!pMedium->EvalScattering(ray, dist, &transmittance, &sigmaS, &distancePdf))
+				return Color::BLACK;
 
-				pSampler->AdvanceSampleIndex();
+			MediumScatter mediumScatter = MediumScatter(ray.CalcPoint(dist), pMedium->GetPhaseFunction(), MediumInterface(pMedium));
+			Color L = EstimateDirectLighting(mediumScatter, -ray.mDir, pLight, pScene, sample, pSampler);
 
-				pFilm->IncreSampleCount();
-				pFilm->ScaleToPixel();
+			return L * transmittance * sigmaS / (equiangularPdf + distancePdf);
+		}
 
-				if (mTaskSync.Aborted())
-					break;
+		float Integrator::DistanceSamplingWeight(const Ray& ray, const Vector3& lightPoint, const float dist)
+		{
+			Color transmittance, sigmaS;
+			float distancePdf;
+			if (!ray.mpMedium->EvalScattering(ray, dist, &transmittance, &sigmaS, &distancePdf))
+				return 1.0f;
 
-				//mFrameTime = mTimer.GetElapsedTime();
-			}
+			const float equiangularPdf = Sampling::EquiangularPdf(dist, ray.mOrg, ray.mDir, ray.mMax, lightPoint);
+			return distancePdf / (distancePdf + equiangularPdf);
 		}
 
 		Color Integrator::EstimateDirectLighting(const Scatter& scatter,
 			const Vector3& outDir,
 			const Light* pLight,
 			const Scene* pScene,
+			const DirectLightingSample& sample,
 			Sampler* pSampler,
 			ScatterType scatterType)
 		{
@@ -85,12 +88,18 @@ namespace EDX
 			Color L;
 
 			bool requireMIS = false;
+			bool reflectOnly = false;
+			Vector3 hemisphereNormal;
 			if (scatter.IsSurfaceScatter()) // Handle surface scattering
 			{
 				const DifferentialGeom& diffGeom = static_cast<const DifferentialGeom&>(scatter);
 				const BSDF* pBSDF = diffGeom.mpBSDF;
 
 				requireMIS = (pBSDF->GetScatterType() & BSDF_GLOSSY);
+
+				// Reflection is only evaluated on the side of the geometric normal facing outDir
+				reflectOnly = !(pBSDF->GetScatterType() & BSDF_TRANSMISSION);
+				hemisphereNormal = Math::Dot(outDir, diffGeom.mGeomNormal) > 0.0f ? diffGeom.mGeomNormal : -diffGeom.mGeomNormal;
 			}
 
 			// Sample light sources
@@ -99,7 +108,9 @@ namespace EDX
 				VisibilityTester visibility;
 				float lightPdf, shadingPdf;
 				Color transmittance;
-				const Color Li = pLight->Illuminate(scatter, pSampler->GetSample(), &lightDir, &visibility, &lightPdf);
+				const Color Li = reflectOnly ?
+					pLight->IlluminateHemisphere(scatter, hemisphereNormal, sample.Light, &lightDir, &visibility, &lightPdf) :
+					pLight->Illuminate(scatter, sample.Light, &lightDir, &visibility, &lightPdf);
 
 				if (lightPdf > 0.0f && !Li.IsBlack())
 				{
@@ -151,7 +162,7 @@ namespace EDX
 						const BSDF* pBSDF = diffGeom.mpBSDF;
 
 						ScatterType types;
-						f = pBSDF->SampleScattered(outDir, pSampler->GetSample(), diffGeom, &lightDir, &shadingPdf, scatterType, &types);
+						f = pBSDF->SampleScattered(outDir, sample.Scatter, diffGeom, &lightDir, &shadingPdf, scatterType, &types);
 						f *= Math::AbsDot(lightDir, normal);
 					}
 					else
@@ -159,21 +170,23 @@ namespace EDX
 						const MediumScatter& mediumScatter = static_cast<const MediumScatter&>(scatter);
 						const PhaseFunctionHG* pPhaseFunc = mediumScatter.mpPhaseFunc;
 
-						const float phase = pPhaseFunc->Sample(outDir, &lightDir, pSampler->Get2D());
+						const float phase = pPhaseFunc->Sample(outDir, &lightDir, Vector2(sample.Scatter.u, sample.Scatter.v));
 						f = Color(phase);
 						shadingPdf = phase;
 					}
 
 					if (shadingPdf > 0.0f && !f.IsBlack())
 					{
-						float lightPdf = pLight->Pdf(position, lightDir);
+						float lightPdf = reflectOnly ?
+							pLight->PdfHemisphere(position, lightDir, hemisphereNormal) :
+							pLight->Pdf(position, lightDir);
 						if (lightPdf > 0.0f)
 						{
 							float misWeight = Sampling::PowerHeuristic(1, shadingPdf, 1, lightPdf);
 
 							Vector3 center;
 							float radius;
-							pScene->WorldBounds().BoundingSphere(&center, &radius);
+							pScene->BoundingSphere(&center, &radius);
 
 							DifferentialGeom diffGeom;
 							Ray rayLight = Ray(position, lightDir, scatter.mMediumInterface.GetMedium(lightDir, normal), 2.0f * radius);
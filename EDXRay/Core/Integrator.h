@@ -33,6 +33,15 @@ namespace EDX
 		public:
 			static Color EstimateDirectLighting(const Scatter& scatter, const Vector3& outVec, const Light* pLight,
 				const Scene* pScene, Sampler* pSampler, ScatterType scatterType = ScatterType(BSDF_ALL & ~BSDF_SPECULAR));
+			// Same as above with the sample dimensions already fetched, pSampler is only used for medium transmittance
+			static Color EstimateDirectLighting(const Scatter& scatter, const Vector3& outVec, const Light* pLight,
+				const Scene* pScene, const DirectLightingSample& sample, Sampler* pSampler, ScatterType scatterType = ScatterType(BSDF_ALL & ~BSDF_SPECULAR));
+			// Single scattered direct lighting along a ray inside a medium, at a distance drawn by equiangular sampling
+			// toward lightPoint. Combined with the medium's own distance sampling by the balance heuristic, the scatter
+			// found by that strategy takes DistanceSamplingWeight for the same light point
+			static Color EstimateEquiangularScattering(const Ray& ray, const Vector3& lightPoint, const Light* pLight,
+				const Scene* pScene, const float distanceSample, const DirectLightingSample& sample, Sampler* pSampler);
+			static float DistanceSamplingWeight(const Ray& ray, const Vector3& lightPoint, const float dist);
 			static Color SpecularReflect(const TiledIntegrator* pIntegrator, const Scene* pScene, Sampler* pSampler, const RayDifferential& ray,
 				const DifferentialGeom& diffGeom, RandomGen& random, MemoryPool& memory);
 			static Color SpecularTransmit(const TiledIntegrator* pIntegrator, const Scene* pScene, Sampler* pSampler, const RayDifferential& ray,
@@ -52,6 +61,25 @@ namespace EDX
 			virtual void Render(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const override;
 			virtual Color Li(const RayDifferential& ray, const Scene* pScene, Sampler* pSampler, RandomGen& random, MemoryPool& memory) const = 0;
 			virtual ~TiledIntegrator() {}
+
+			// Statically typed entry used by RenderTiles, integrators with a specialized render path hide it
+			// with a template over the sampler type
+			template<typename SamplerImpl>
+			Color LiT(const RayDifferential& ray, const Scene* pScene, SamplerImpl* pSampler, RandomGen& random, MemoryPool& memory) const
+			{
+				return Li(ray, pScene, pSampler, random, memory);
+			}
+
+		protected:
+			// Runs the render loop instantiated for the sampler of the job, returns false to use the generic virtual path
+			virtual bool RenderSpecialized(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const
+			{
+				return false;
+			}
+
+			// Render loop with LiT and the sampler calls bound to IntegratorImpl and SamplerImpl, defined in TiledRender.h
+			template<typename IntegratorImpl, typename SamplerImpl>
+			void RenderTiles(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const;
 		};
 	}
 }
\ No newline at end of file
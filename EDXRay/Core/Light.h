@@ -64,6 +64,21 @@ namespace EDX
 				float* pPdf = nullptr,
 				float* pDirectPdf = nullptr) const = 0;
 			virtual float Pdf(const Vector3& pos, const Vector3& dir) const = 0;
+			// Sampling restricted to the hemisphere around hemisphereNormal, for receivers that only reflect light.
+			// Lights without a cheaper restricted strategy fall back to the unrestricted one
+			virtual Color IlluminateHemisphere(const Scatter& scatter,
+				const Vector3& hemisphereNormal,
+				const RayTracer::Sample& lightSample,
+				Vector3* pDir,
+				VisibilityTester* pVisTest,
+				float* pPdf) const
+			{
+				return Illuminate(scatter, lightSample, pDir, pVisTest, pPdf);
+			}
+			virtual float PdfHemisphere(const Vector3& pos, const Vector3& dir, const Vector3& hemisphereNormal) const
+			{
+				return Pdf(pos, dir);
+			}
 			virtual bool IsEnvironmentLight() const { return false; }
 			virtual bool IsAreaLight() const { return false; }
 			virtual bool IsDelta() const = 0;
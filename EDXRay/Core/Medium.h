@@ -44,6 +44,18 @@ namespace EDX
 
 			virtual Color Transmittance(const Ray& ray, Sampler*pSampler) const = 0;
 			virtual Color Sample(const Ray& ray, Sampler* pSampler, MediumScatter* pMS) const = 0;
+
+			// Evaluates the transmittance and scattering coefficient at dist along the ray, together with the density
+			// with which Sample scatters there. Media that cannot evaluate it in closed form return false
+			virtual bool EvalScattering(const Ray& ray, const float dist, Color* pTransmittance, Color* pSigmaS, float* pPdf) const
+			{
+				return false;
+			}
+
+			const PhaseFunctionHG* GetPhaseFunction() const
+			{
+				return mpPhaseFunc.Get();
+			}
 		};
 
 		class MediumInterface
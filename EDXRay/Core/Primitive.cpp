@@ -170,6 +170,17 @@ namespace EDX
 			return mpBSSRDFs[mpMaterialIndices[triId]].Get();
 		}
 
+		bool Primitive::HasBSSRDF() const
+		{
+			for (const auto& it : mpBSSRDFs)
+			{
+				if (it.Get())
+					return true;
+			}
+
+			return false;
+		}
+
 		MediumInterface* Primitive::GetMediumInterface(const uint triId)
 		{
 			return &mMediumInterfaces[mpMaterialIndices[triId]];
@@ -200,5 +211,11 @@ namespace EDX
 			auto& materialInterface = mMediumInterfaces[mpMaterialIndices[triId]];
 			materialInterface.SetInside(!setNull ? new HomogeneousMedium(Vector3(0.1f), Vector3(0.02f), 0.0f) : nullptr);
 		}
+
+		void Primitive::SetInsideMedium(const Medium* pMedium)
+		{
+			for (auto& materialInterface : mMediumInterfaces)
+				materialInterface = MediumInterface(pMedium, materialInterface.GetOutside());
+		}
 	}
 }
\ No newline at end of file
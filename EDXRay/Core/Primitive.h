@@ -71,11 +71,14 @@ namespace EDX
 
 			BSDF* GetBSDF(const uint triId);
 			BSSRDF* GetBSSRDF(const uint triId);
+			bool HasBSSRDF() const;
 			MediumInterface* GetMediumInterface(const uint triId);
 			BSDF* GetBSDF_FromIdx(const uint idx) const;
 			void SetBSDF(const BSDFType type, const int triId);
 			void SetBSSRDF(const int triId, const bool setNull = false);
 			void SetMediumInterface(const int triId, const bool setNull = false);
+			// Fills the inside of every material with pMedium, the medium is shared and not deleted by the primitive
+			void SetInsideMedium(const Medium* pMedium);
 			void SetAreaLight(const AreaLight* pAreaLt)
 			{
 				mpAreaLight = pAreaLt;
@@ -18,12 +18,20 @@ namespace EDX
 			QueuedRenderTask(Renderer* pRenderer, const int idx)
 				: mpRenderer(pRenderer)
 				, mIndex(idx)
+				, mFinished(false)
 			{
 			}
 
 			void DoThreadedWork()
 			{
 				mpRenderer->GetIntegrator()->Render(mpRenderer->GetScene(), mpRenderer->GetCamera(), mpRenderer->GetSampler(), mpRenderer->GetFilm());
+				mFinished = true;
+			}
+
+			// Set once Render returns, whether it completed the job or was aborted
+			bool Finished() const
+			{
+				return mFinished;
 			}
 
 			void Abandon()
@@ -34,6 +42,7 @@ namespace EDX
 		private:
 			Renderer*	mpRenderer;
 			int			mIndex;
+			volatile bool mFinished;
 		};
 	}
 }
@@ -10,11 +10,16 @@
 #include "../Integrators/BidirectionalPathTracing.h"
 #include "../Integrators/MultiplexedMLT.h"
 #include "../Integrators/RLPathTracing.h"
+#include "../Integrators/StochasticPPM.h"
+#include "../Integrators/PathGuiding.h"
 #include "../Sampler/RandomSampler.h"
 #include "../Sampler/SobolSampler.h"
+#include "../Sampler/ZSobolSampler.h"
 #include "../Tracer/BVH.h"
 #include "../Tracer/BVHBuildTask.h"
 #include "Film.h"
+#include "Checkpoint.h"
+#include "DistributedRender.h"
 #include "DifferentialGeom.h"
 #include "Graphics/Color.h"
 #include "RenderTask.h"
@@ -30,6 +35,7 @@ namespace EDX
 	namespace RayTracer
 	{
 		Renderer::Renderer()
+			: mResumed(false)
 		{
 			// Initialize scene
 			mpCamera.Reset(new Camera());
@@ -39,6 +45,7 @@ namespace EDX
 
 		Renderer::~Renderer()
 		{
+			mpCheckpoint.Reset();
 			QueuedThreadPool::DeleteInstance();
 		}
 
@@ -75,6 +82,8 @@ namespace EDX
 
 			mpFilm.Reset(new Film);
 			mpFilm->Init(mJobDesc.ImageWidth, mJobDesc.ImageHeight, pFilter);
+			mpFilm->SetCheckpoint(mpCheckpoint.Get());
+			mResumed = false;
 
 			switch (mJobDesc.SamplerType)
 			{
@@ -87,7 +96,11 @@ namespace EDX
 			case ESamplerType::Metropolis:
 				mpSampler.Reset(new RandomSampler);
 				break;
+			case ESamplerType::ZSobol:
+				mpSampler.Reset(new ZSobolSampler(mJobDesc.ImageWidth, mJobDesc.ImageHeight, mJobDesc.SamplesPerPixel));
+				break;
 			}
+			mpSampler->SetSampleIndex(mJobDesc.PassOffset);
 
 			switch (mJobDesc.IntegratorType)
 			{
@@ -104,6 +117,12 @@ namespace EDX
 				mpIntegrator.Reset(new MultiplexedMLTIntegrator(mJobDesc.MaxPathLength, mpCamera.Get(), mpFilm.Get(), mJobDesc, mTaskSync));
 				break;
 			case EIntegratorType::StochasticPPM:
+				mpIntegrator.Reset(new StochasticPPMIntegrator(mJobDesc.MaxPathLength, mJobDesc, mTaskSync));
+				break;
+			case EIntegratorType::PathGuiding:
+				mpIntegrator.Reset(new PathGuidingIntegrator(mJobDesc.MaxPathLength, mJobDesc, mTaskSync));
+				break;
+			case EIntegratorType::RLPathTracing:
 				mpIntegrator.Reset(new RLPathTracingIntegrator(mJobDesc.MaxPathLength, 1 << 16, mJobDesc, mTaskSync));
 				break;
 			}
@@ -134,7 +153,9 @@ namespace EDX
 
 		void Renderer::QueueRenderTasks()
 		{
-			mpFilm->Clear();
+			if (!mResumed)
+				mpFilm->Clear();
+			mResumed = false;
 			mTaskSync.SetAbort(false);
 
 			mTask = MakeUnique<QueuedRenderTask>(this, 0);
@@ -148,6 +169,64 @@ namespace EDX
 			mTask.Reset();
 		}
 
+		bool Renderer::RenderFinished() const
+		{
+			return !mTask || mTask->Finished();
+		}
+
+		void Renderer::EnableCheckpoint(const char* path, const float interval)
+		{
+			mpCheckpoint.Reset(new RenderCheckpoint(path, interval, mJobDesc, mTaskSync));
+			if (mpFilm)
+				mpFilm->SetCheckpoint(mpCheckpoint.Get());
+		}
+
+		bool Renderer::ResumeFromCheckpoint(const char* path)
+		{
+			Assert(mpFilm);
+
+			FilmState state;
+			EIntegratorType integratorType;
+			CameraParameters cameraParams;
+			if (!RenderCheckpoint::Load(path, &state, &integratorType, &cameraParams))
+				return false;
+
+			// Accumulated samples are only meaningful for the integrator and view that produced them
+			if (integratorType != mJobDesc.IntegratorType)
+				return false;
+			if (!RenderCheckpoint::SameView(cameraParams, mJobDesc.CameraParams))
+				return false;
+
+			if (!mpFilm->RestoreState(state))
+				return false;
+
+			// One sampler index is consumed per finished pass
+			mpSampler->SetSampleIndex(mJobDesc.PassOffset + state.SampleCount);
+			mResumed = true;
+
+			return true;
+		}
+
+		bool Renderer::FlushCheckpoint()
+		{
+			if (!mpCheckpoint || !mpFilm)
+				return false;
+
+			return mpCheckpoint->Flush(mpFilm.Get());
+		}
+
+		bool Renderer::ConnectToCoordinator(const char* host, const int port, const int workerIndex, const int numWorkers, const float interval)
+		{
+			RenderCoordinator::AssignPassRange(&mJobDesc, workerIndex, numWorkers);
+
+			RenderWorkerStream* pStream = new RenderWorkerStream(workerIndex, interval, mJobDesc, mTaskSync);
+			mpCheckpoint.Reset(pStream);
+			if (mpFilm)
+				mpFilm->SetCheckpoint(mpCheckpoint.Get());
+
+			return pStream->Connect(host, port);
+		}
+
 		void Renderer::SetJobDesc(const RenderJobDesc& jobDesc)
 		{
 			mJobDesc = jobDesc;
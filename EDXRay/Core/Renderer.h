@@ -21,6 +21,8 @@ namespace EDX
 			UniquePtr<Integrator> mpIntegrator;
 			UniquePtr<Sampler>	mpSampler;
 			UniquePtr<Film>	mpFilm;
+			UniquePtr<RenderCheckpoint> mpCheckpoint;
+			bool mResumed;
 
 			RenderJobDesc	mJobDesc;
 
@@ -43,6 +45,15 @@ namespace EDX
 
 			void QueueRenderTasks();
 			void StopRenderTasks();
+			// True once the queued render returned, callers polling the film should stop waiting then
+			bool RenderFinished() const;
+
+			void EnableCheckpoint(const char* path, const float interval);
+			bool ResumeFromCheckpoint(const char* path);
+			bool FlushCheckpoint();
+
+			// Renders a share of the job's passes and streams the film to a coordinator, call before InitComponent
+			bool ConnectToCoordinator(const char* host, const int port, const int workerIndex, const int numWorkers, const float interval);
 
 			RenderJobDesc* GetJobDesc()
 			{
@@ -2,6 +2,7 @@
 
 #include "Core/Memory.h"
 #include "Core/Random.h"
+#include "Math/Vec2.h"
 
 namespace EDX
 {
@@ -13,5 +14,45 @@ namespace EDX
 			v = random.Float();
 			w = random.Float();
 		}
+
+		const int DirectLightingSample::Layout[] = { 3, 3, 1 };
+		const int BounceSample::Layout[] = { 3, 3, 1, 3 };
+		const int LightEmissionSample::Layout[] = { 3, 3, 1 };
+		const int LightConnectionSample::Layout[] = { 1, 3 };
+
+		static_assert(sizeof(DirectLightingSample) == 7 * sizeof(float), "Layout does not match DirectLightingSample");
+		static_assert(sizeof(BounceSample) == 10 * sizeof(float), "Layout does not match BounceSample");
+		static_assert(sizeof(LightEmissionSample) == 7 * sizeof(float), "Layout does not match LightEmissionSample");
+		static_assert(sizeof(LightConnectionSample) == 4 * sizeof(float), "Layout does not match LightConnectionSample");
+
+		void Sampler::GetSampleVector(const int* pGroupSizes, const int numGroups, float* pSamples)
+		{
+			for (auto i = 0; i < numGroups; i++)
+			{
+				switch (pGroupSizes[i])
+				{
+				case 1:
+					*pSamples++ = Get1D();
+					break;
+				case 2:
+				{
+					const Vector2 sample = Get2D();
+					*pSamples++ = sample.x;
+					*pSamples++ = sample.y;
+					break;
+				}
+				case 3:
+				{
+					const Sample sample = GetSample();
+					*pSamples++ = sample.u;
+					*pSamples++ = sample.v;
+					*pSamples++ = sample.w;
+					break;
+				}
+				default:
+					Assert(false);
+				}
+			}
+		}
 	}
 }
\ No newline at end of file
@@ -29,6 +29,52 @@ namespace EDX
 
 			Sample(RandomGen& random);
 		};
+
+		// Fixed dimension layouts fetched with a single Sampler::GetSampleVector call. Layout lists the
+		// sizes of the groups of dimensions that are stratified together, in memory order
+
+		// Next event estimation at one scattering vertex: light pick, light sample and the BSDF or phase sample for MIS
+		struct DirectLightingSample
+		{
+			Sample Light;
+			Sample Scatter;
+			float LightIndex;
+
+			static const int Layout[];
+			static const int LayoutSize = 3;
+		};
+
+		// Connection of a camera vertex to a light without MIS scatter sample: light pick and light sample
+		struct LightConnectionSample
+		{
+			float LightIndex;
+			Sample Light;
+
+			static const int Layout[];
+			static const int LayoutSize = 2;
+		};
+
+		// One path vertex: next event estimation followed by the sample that continues the path
+		struct BounceSample
+		{
+			DirectLightingSample Direct;
+			Sample Scatter;
+
+			static const int Layout[];
+			static const int LayoutSize = 4;
+		};
+
+		// Emission from a light source: light pick, position and direction samples
+		struct LightEmissionSample
+		{
+			Sample Position;
+			Sample Direction;
+			float LightIndex;
+
+			static const int Layout[];
+			static const int LayoutSize = 3;
+		};
+
 		class Sampler
 		{
 		public:
@@ -40,13 +86,36 @@ namespace EDX
 				CameraSample* pSamples,
 				RandomGen& random) = 0;
 			virtual void AdvanceSampleIndex() {}
+			virtual void SetSampleIndex(const uint64 index) {}
 
 			virtual void StartPixel(const int pixelX, const int pixelY) {}
 			virtual float Get1D() = 0;
 			virtual Vector2 Get2D() = 0;
 			virtual Sample GetSample() = 0;
 
+			// Fills a contiguous vector of dimensions with one virtual call, groups of 1, 2 and 3 dimensions
+			// are generated the same way as Get1D, Get2D and GetSample
+			virtual void GetSampleVector(const int* pGroupSizes, const int numGroups, float* pSamples);
+
 			virtual UniquePtr<Sampler> Clone(const int seed) const = 0;
+
+		protected:
+			static int NumDimensions(const int* pGroupSizes, const int numGroups)
+			{
+				int ret = 0;
+				for (auto i = 0; i < numGroups; i++)
+					ret += pGroupSizes[i];
+
+				return ret;
+			}
 		};
+
+		// Fetches one of the layouts above, the call is statically bound when SamplerType is a final sampler class
+		template<typename SamplerType, typename LayoutType>
+		inline void GetSampleVector(SamplerType* pSampler, LayoutType* pSample)
+		{
+			static_assert(sizeof(LayoutType) % sizeof(float) == 0, "Sample layouts must only contain floats");
+			pSampler->GetSampleVector(LayoutType::Layout, LayoutType::LayoutSize, reinterpret_cast<float*>(pSample));
+		}
 	}
 }
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include "Core/Random.h"
 #include "Containers/DimensionalArray.h"
 
+#include <ppl.h>
+
 namespace EDX
 {
 	namespace RayTracer
@@ -131,6 +133,233 @@ namespace EDX
 				}
 			};
 
+			// Walker's alias method over discrete weights, samples in O(1) with a single uniform number
+			class AliasTable
+			{
+			private:
+				struct Bin
+				{
+					float Prob;		// Probability of keeping this bin rather than its alias
+					int Alias;
+					float Pmf;
+				};
+
+				Array<Bin> mBins;
+				float mSum = 0.0f;
+
+			public:
+				AliasTable() = default;
+
+				AliasTable(const float* pWeights, int size)
+				{
+					SetWeights(pWeights, size);
+				}
+
+				void SetWeights(const float* pWeights, int size)
+				{
+					Assert(pWeights);
+					Assert(size > 0);
+
+					mBins.Resize(size);
+
+					double sum = 0.0;
+					for (auto i = 0; i < size; i++)
+						sum += Math::Max(pWeights[i], 0.0f);
+					mSum = float(sum);
+
+					for (auto i = 0; i < size; i++)
+						mBins[i].Pmf = sum > 0.0 ? float(Math::Max(pWeights[i], 0.0f) / sum) : 1.0f / float(size);
+
+					// Split bins into the ones under and over the average, then pair them up (Vose)
+					Array<float> scaled;
+					Array<int> under, over;
+					scaled.Resize(size);
+					under.Resize(size);
+					over.Resize(size);
+					int numUnder = 0, numOver = 0;
+					for (auto i = 0; i < size; i++)
+					{
+						scaled[i] = mBins[i].Pmf * size;
+						if (scaled[i] < 1.0f)
+							under[numUnder++] = i;
+						else
+							over[numOver++] = i;
+					}
+
+					while (numUnder > 0 && numOver > 0)
+					{
+						const int u = under[--numUnder];
+						const int o = over[--numOver];
+
+						mBins[u].Prob = scaled[u];
+						mBins[u].Alias = o;
+
+						scaled[o] = (scaled[o] + scaled[u]) - 1.0f;
+						if (scaled[o] < 1.0f)
+							under[numUnder++] = o;
+						else
+							over[numOver++] = o;
+					}
+
+					// Leftovers are only off from 1 by rounding error
+					while (numOver > 0)
+					{
+						const int o = over[--numOver];
+						mBins[o].Prob = 1.0f;
+						mBins[o].Alias = o;
+					}
+					while (numUnder > 0)
+					{
+						const int u = under[--numUnder];
+						mBins[u].Prob = 1.0f;
+						mBins[u].Alias = u;
+					}
+				}
+
+				// pRemapped receives a new uniform number in [0, 1) recovered from the unused precision of u
+				int Sample(float u, float* pPmf = nullptr, float* pRemapped = nullptr) const
+				{
+					const int size = mBins.Size();
+					const float scaledU = u * size;
+					int index = Math::Min(int(scaledU), size - 1);
+					const float up = Math::Min(scaledU - index, 0.99999994f);
+
+					const Bin& bin = mBins[index];
+					float remapped;
+					if (up < bin.Prob)
+					{
+						remapped = up / bin.Prob;
+					}
+					else
+					{
+						remapped = (up - bin.Prob) / (1.0f - bin.Prob);
+						index = bin.Alias;
+					}
+
+					if (pPmf)
+						*pPmf = mBins[index].Pmf;
+					if (pRemapped)
+						*pRemapped = Math::Min(remapped, 0.99999994f);
+
+					return index;
+				}
+
+				float Pmf(const int index) const
+				{
+					return mBins[index].Pmf;
+				}
+
+				int Size() const
+				{
+					return mBins.Size();
+				}
+
+				float GetSum() const
+				{
+					return mSum;
+				}
+			};
+
+			// Drop-in replacement for Distribution1D sampling through an alias table in O(1) instead of a binary
+			// search over the CDF. The mapping from u is not monotonic, so stratification of u is not preserved
+			class AliasDistribution1D
+			{
+			private:
+				AliasTable mTable;
+				int mSize = INDEX_NONE;
+				float mIntegralVal;
+				friend class AliasDistribution2D;
+
+			public:
+				AliasDistribution1D() = default;
+
+				AliasDistribution1D(const float* pFunc, int size)
+				{
+					SetFunction(pFunc, size);
+				}
+
+				void SetFunction(const float* pFunc, int size)
+				{
+					Assert(pFunc);
+					Assert(size > 0);
+
+					mSize = size;
+					mTable.SetWeights(pFunc, size);
+					mIntegralVal = mTable.GetSum() / float(size);
+				}
+
+				float SampleContinuous(float u, float* pPdf, int* pOffset = nullptr) const
+				{
+					float pmf, du;
+					const int offset = mTable.Sample(u, &pmf, &du);
+					if (pPdf)
+						*pPdf = pmf * mSize;
+					if (pOffset)
+						*pOffset = offset;
+
+					return (offset + du) / float(mSize);
+				}
+
+				int SampleDiscrete(float u, float* pPdf) const
+				{
+					return mTable.Sample(u, pPdf);
+				}
+
+				float GetIntegral() const
+				{
+					return mIntegralVal;
+				}
+			};
+
+			// Drop-in replacement for Distribution2D built from alias tables, the conditional rows are built in parallel
+			class AliasDistribution2D
+			{
+			private:
+				Array<UniquePtr<AliasDistribution1D>>	mConditional;
+				UniquePtr<AliasDistribution1D>			mpMarginal;
+
+			public:
+				AliasDistribution2D(const float* pFunc, int sizeX, int sizeY)
+				{
+					Assert(pFunc);
+					Assert(sizeX > 0);
+					Assert(sizeY > 0);
+
+					mConditional.Resize(sizeY);
+					concurrency::parallel_for(0, sizeY, [&](int i)
+					{
+						mConditional[i] = MakeUnique<AliasDistribution1D>(&pFunc[i * sizeX], sizeX);
+					});
+
+					Array<float> marginalFunc;
+					marginalFunc.Resize(sizeY);
+					for (auto i = 0; i < sizeY; i++)
+						marginalFunc[i] = mConditional[i]->GetIntegral();
+					mpMarginal = MakeUnique<AliasDistribution1D>(marginalFunc.Data(), sizeY);
+				}
+
+				void SampleContinuous(float u, float v, float* pSampledU, float* pSampledV, float* pPdf) const
+				{
+					float pdfs[2];
+					int iv;
+					*pSampledV = mpMarginal->SampleContinuous(v, &pdfs[1], &iv);
+					*pSampledU = mConditional[iv]->SampleContinuous(u, &pdfs[0]);
+					*pPdf = pdfs[0] * pdfs[1];
+					Assert(Math::NumericValid(*pPdf));
+				}
+				float Pdf(float u, float v) const
+				{
+					const int sizeX = mConditional[0]->mSize;
+					const int sizeY = mpMarginal->mSize;
+					int iu = Math::Clamp(u * sizeX, 0, sizeX - 1);
+					int iv = Math::Clamp(v * sizeY, 0, sizeY - 1);
+					if (mConditional[iv]->GetIntegral() * mpMarginal->GetIntegral() == 0.0f)
+						return 0.f;
+
+					return (mConditional[iv]->mTable.Pmf(iu) * sizeX) * (mpMarginal->mTable.Pmf(iv) * sizeY);
+				}
+			};
+
 			inline void ConcentricSampleDisk(float u1, float u2, float *dx, float *dy)
 			{
 				float r1 = 2.0f * u1 - 1.0f;
@@ -163,6 +392,87 @@ namespace EDX
 				*u = 1.f - su1;
 				*v = u2 * su1;
 			}
+			// Solid angle subtended by the spherical triangle with the normalized vertex directions a, b, c
+			inline float SphericalTriangleArea(const Vector3& a, const Vector3& b, const Vector3& c)
+			{
+				return Math::Abs(2.0f * Math::Atan2(Math::Dot(a, Math::Cross(b, c)), 1.0f + Math::Dot(a, b) + Math::Dot(a, c) + Math::Dot(b, c)));
+			}
+
+			// Uniformly samples the solid angle of triangle p0 p1 p2 seen from pos (Arvo 1995), returns the barycentrics
+			// of the sampled point. pPdf receives the solid angle pdf, 0 for degenerate triangles
+			inline void SampleSphericalTriangle(const Vector3& p0, const Vector3& p1, const Vector3& p2, const Vector3& pos,
+				float u1, float u2, float* pB0, float* pB1, float* pPdf)
+			{
+				auto AngleBetween = [](const Vector3& v1, const Vector3& v2)
+				{
+					return 2.0f * Math::Atan2(Math::Length(v1 - v2), Math::Length(v1 + v2));
+				};
+
+				*pPdf = 0.0f;
+
+				const Vector3 a = Math::Normalize(p0 - pos);
+				const Vector3 b = Math::Normalize(p1 - pos);
+				const Vector3 c = Math::Normalize(p2 - pos);
+
+				Vector3 nAB = Math::Cross(a, b), nBC = Math::Cross(b, c), nCA = Math::Cross(c, a);
+				if (Math::Dot(nAB, nAB) == 0.0f || Math::Dot(nBC, nBC) == 0.0f || Math::Dot(nCA, nCA) == 0.0f)
+					return;
+				nAB = Math::Normalize(nAB);
+				nBC = Math::Normalize(nBC);
+				nCA = Math::Normalize(nCA);
+
+				// Angles at the spherical triangle vertices
+				const float alpha = AngleBetween(nAB, -nCA);
+				const float beta = AngleBetween(nBC, -nAB);
+				const float gamma = AngleBetween(nCA, -nBC);
+
+				// Uniformly sample the sub-triangle area A'
+				const float areaPlusPi = alpha + beta + gamma;
+				const float area = areaPlusPi - float(Math::EDX_PI);
+				if (area <= 0.0f)
+					return;
+				const float sampledAreaPlusPi = Math::Lerp(float(Math::EDX_PI), areaPlusPi, u1);
+
+				// Find cos(beta') of the point c' along the arc a c
+				const float cosAlpha = Math::Cos(alpha), sinAlpha = Math::Sin(alpha);
+				const float sinPhi = Math::Sin(sampledAreaPlusPi) * cosAlpha - Math::Cos(sampledAreaPlusPi) * sinAlpha;
+				const float cosPhi = Math::Cos(sampledAreaPlusPi) * cosAlpha + Math::Sin(sampledAreaPlusPi) * sinAlpha;
+				const float k1 = cosPhi + cosAlpha;
+				const float k2 = sinPhi - sinAlpha * Math::Dot(a, b);
+				float cosBp = (k2 + (k2 * cosPhi - k1 * sinPhi) * cosAlpha) / ((k2 * sinPhi + k1 * cosPhi) * sinAlpha);
+				cosBp = Math::Clamp(cosBp, -1.0f, 1.0f);
+
+				const float sinBp = Math::Sqrt(Math::Max(0.0f, 1.0f - cosBp * cosBp));
+				const Vector3 cp = cosBp * a + sinBp * Math::Normalize(c - Math::Dot(c, a) * a);
+
+				// Sample the direction along the arc b c'
+				const float cosTheta = 1.0f - u2 * (1.0f - Math::Dot(cp, b));
+				const float sinTheta = Math::Sqrt(Math::Max(0.0f, 1.0f - cosTheta * cosTheta));
+				const Vector3 dir = cosTheta * b + sinTheta * Math::Normalize(cp - Math::Dot(cp, b) * b);
+
+				// Barycentrics of the ray pos + t * dir on the planar triangle
+				const Vector3 e1 = p1 - p0, e2 = p2 - p0;
+				const Vector3 s1 = Math::Cross(dir, e2);
+				const float divisor = Math::Dot(s1, e1);
+				if (divisor == 0.0f)
+					return;
+
+				const float invDivisor = 1.0f / divisor;
+				const Vector3 s = pos - p0;
+				float b1 = Math::Clamp(Math::Dot(s, s1) * invDivisor, 0.0f, 1.0f);
+				float b2 = Math::Clamp(Math::Dot(dir, Math::Cross(s, e1)) * invDivisor, 0.0f, 1.0f);
+				if (b1 + b2 > 1.0f)
+				{
+					const float sum = b1 + b2;
+					b1 /= sum;
+					b2 /= sum;
+				}
+
+				*pB0 = 1.0f - b1 - b2;
+				*pB1 = b1;
+				*pPdf = 1.0f / area;
+			}
+
 			inline Vector3 CosineSampleHemisphere(float u1, float u2)
 			{
 				Vector3 ret;
@@ -234,6 +544,38 @@ namespace EDX
 				return pdfW * Math::Abs(cos) / (dist * dist);
 			}
 
+			// Equiangular sampling of the distance along the ray segment [0, tMax] toward center, the density is
+			// proportional to the inverse squared distance to center. Fails when the ray passes through center
+			inline bool SampleEquiangular(float u, const Vector3& org, const Vector3& dir, float tMax, const Vector3& center,
+				float* pDist, float* pPdf)
+			{
+				const float delta = Math::Dot(center - org, dir);
+				const float D = Math::Length(center - (org + delta * dir));
+				if (D < 1e-6f)
+					return false;
+
+				const float thetaA = Math::Atan2(-delta, D);
+				const float thetaB = Math::Atan2(tMax - delta, D);
+				const float t = D * Math::Tan(Math::Lerp(thetaA, thetaB, u));
+
+				*pDist = Math::Clamp(delta + t, 0.0f, tMax);
+				*pPdf = D / ((thetaB - thetaA) * (D * D + t * t));
+				return true;
+			}
+			inline float EquiangularPdf(float dist, const Vector3& org, const Vector3& dir, float tMax, const Vector3& center)
+			{
+				const float delta = Math::Dot(center - org, dir);
+				const float D = Math::Length(center - (org + delta * dir));
+				if (D < 1e-6f || dist < 0.0f || dist > tMax)
+					return 0.0f;
+
+				const float thetaA = Math::Atan2(-delta, D);
+				const float thetaB = Math::Atan2(tMax - delta, D);
+				const float t = dist - delta;
+
+				return D / ((thetaB - thetaA) * (D * D + t * t));
+			}
+
 			inline float VanDerCorput(uint n, uint scramble)
 			{
 				// Reverse the bits of n
@@ -21,6 +21,8 @@ namespace EDX
 		Scene::Scene()
 			: mEnvMap(nullptr)
 			, mDirty(true)
+			, mVersion(0)
+			, mScale(1.0f)
 		{
 		}
 
@@ -37,18 +39,16 @@ namespace EDX
 
 		bool Scene::Intersect(const Ray& ray, Intersection* pIsect) const
 		{
-			Ray transformedRay = TransformRay(ray, mSceneScaleInv);
-
 #if USE_EMBREE
 			RTCRay embreeRay;
-			embreeRay.org[0] = transformedRay.mOrg.x;
-			embreeRay.org[1] = transformedRay.mOrg.y;
-			embreeRay.org[2] = transformedRay.mOrg.z;
-			embreeRay.dir[0] = transformedRay.mDir.x;
-			embreeRay.dir[1] = transformedRay.mDir.y;
-			embreeRay.dir[2] = transformedRay.mDir.z;
-			embreeRay.tnear = transformedRay.mMin;
-			embreeRay.tfar = transformedRay.mMax;
+			embreeRay.org[0] = ray.mOrg.x;
+			embreeRay.org[1] = ray.mOrg.y;
+			embreeRay.org[2] = ray.mOrg.z;
+			embreeRay.dir[0] = ray.mDir.x;
+			embreeRay.dir[1] = ray.mDir.y;
+			embreeRay.dir[2] = ray.mDir.z;
+			embreeRay.tnear = ray.mMin;
+			embreeRay.tfar = ray.mMax;
 			embreeRay.time = 0.0f;
 			embreeRay.mask = -1;
 			embreeRay.geomID = RTC_INVALID_GEOMETRY_ID;
@@ -67,7 +67,7 @@ namespace EDX
 			pIsect->mV = embreeRay.v;
 
 #else
-			if (!mAccel->Intersect(transformedRay, pIsect))
+			if (!mAccel->Intersect(ray, pIsect))
 				return false;
 
 #endif // USE_EMBREE
@@ -79,18 +79,16 @@ namespace EDX
 
 		bool Scene::Occluded(const Ray& ray) const
 		{
-			Ray transformedRay = TransformRay(ray, mSceneScaleInv);
-
 #if USE_EMBREE
 			RTCRay embreeRay;
-			embreeRay.org[0] = transformedRay.mOrg.x;
-			embreeRay.org[1] = transformedRay.mOrg.y;
-			embreeRay.org[2] = transformedRay.mOrg.z;
-			embreeRay.dir[0] = transformedRay.mDir.x;
-			embreeRay.dir[1] = transformedRay.mDir.y;
-			embreeRay.dir[2] = transformedRay.mDir.z;
-			embreeRay.tnear = transformedRay.mMin;
-			embreeRay.tfar = transformedRay.mMax;
+			embreeRay.org[0] = ray.mOrg.x;
+			embreeRay.org[1] = ray.mOrg.y;
+			embreeRay.org[2] = ray.mOrg.z;
+			embreeRay.dir[0] = ray.mDir.x;
+			embreeRay.dir[1] = ray.mDir.y;
+			embreeRay.dir[2] = ray.mDir.z;
+			embreeRay.tnear = ray.mMin;
+			embreeRay.tfar = ray.mMax;
 			embreeRay.time = 0.0f;
 			embreeRay.geomID = RTC_INVALID_GEOMETRY_ID;
 			embreeRay.primID = RTC_INVALID_GEOMETRY_ID;
@@ -100,28 +98,52 @@ namespace EDX
 
 			return embreeRay.geomID != RTC_INVALID_GEOMETRY_ID;
 #else
-			return mAccel->Occluded(transformedRay);
+			return mAccel->Occluded(ray);
 
 #endif // USE_EMBREE
 		}
 
+		int Scene::IntersectAll(const uint primId, const Ray& ray, Intersection* pIsects, const int maxIsects) const
+		{
+			int numIsects = 0;
+			if (primId < mProbeAccels.Size() && mProbeAccels[primId])
+			{
+				numIsects = mProbeAccels[primId]->IntersectAll(ray, pIsects, maxIsects);
+
+				// Hits report the index within the probe structure
+				for (auto i = 0; i < numIsects; i++)
+					pIsects[i].mPrimId = primId;
+			}
+			else
+			{
+				// Subsurface scattering enabled after the accelerators were built, step through the whole scene
+				Ray probeRay = ray;
+				Intersection isect;
+				while (numIsects < maxIsects && Intersect(probeRay, &isect))
+				{
+					if (isect.mPrimId == primId)
+						pIsects[numIsects++] = isect;
+
+					probeRay.mMin = isect.mDist;
+					probeRay.mMax = ray.mMax;
+					isect = Intersection();
+				}
+			}
+
+			return numIsects;
+		}
+
 		void Scene::PostIntersect(const Ray& ray, DifferentialGeom* pDiffGeom) const
 		{
 			Assert(pDiffGeom);
 			mPrimitives[pDiffGeom->mPrimId]->PostIntersect(ray, pDiffGeom);
 
-			pDiffGeom->mPosition = Matrix::TransformPoint(pDiffGeom->mPosition, mSceneScale);
-			pDiffGeom->mNormal = Math::Normalize(Matrix::TransformNormal(pDiffGeom->mNormal, mSceneScaleInv));
-			pDiffGeom->mGeomNormal = Math::Normalize(Matrix::TransformNormal(pDiffGeom->mGeomNormal, mSceneScaleInv));
+			// Geometry is already scaled, only the interpolated shading normal needs normalizing
+			pDiffGeom->mNormal = Math::Normalize(pDiffGeom->mNormal);
 			pDiffGeom->mShadingFrame = Frame(pDiffGeom->mNormal);
-
-			pDiffGeom->mDpdu = Matrix::TransformVector(pDiffGeom->mDpdu, mSceneScale);
-			pDiffGeom->mDpdv = Matrix::TransformVector(pDiffGeom->mDpdv, mSceneScale);
-			pDiffGeom->mDndu = Matrix::TransformVector(pDiffGeom->mDndu, mSceneScale);
-			pDiffGeom->mDndv = Matrix::TransformVector(pDiffGeom->mDndv, mSceneScale);
 		}
 
-		BoundingBox Scene::WorldBounds() const
+		BoundingBox Scene::ComputeWorldBounds() const
 		{
 #if USE_EMBREE
 			RTCBounds embreeBounds;
@@ -132,22 +154,36 @@ namespace EDX
 					Vector3(embreeBounds.upper_x, embreeBounds.upper_y, embreeBounds.upper_z)
 				);
 
-			return Matrix::TransformBBox(worldBounds, mSceneScale);
+			return worldBounds;
 
 #else
-			return Matrix::TransformBBox(mAccel->WorldBounds(), mSceneScale);
+			return mAccel->WorldBounds();
 
 #endif // USE_EMBREE
 		}
 
 		void Scene::AddPrimitive(Primitive* pPrim)
 		{
+			if (mScale != 1.0f)
+				pPrim->mpMesh->SetScale(mScale);
+
 			mPrimitives.Add(UniquePtr<Primitive>(pPrim));
 			mDirty = true;
+			mVersion++;
+		}
+
+		const Medium* Scene::AddMedium(const Medium* pMedium)
+		{
+			mMedia.Add(UniquePtr<const Medium>(pMedium));
+			mVersion++;
+
+			return pMedium;
 		}
 
 		void Scene::AddLight(Light* pLight)
 		{
+			mVersion++;
+
 			if (pLight->IsEnvironmentLight())
 			{
 				bool foundEnvLight = false;
@@ -166,8 +202,16 @@ namespace EDX
 			}
 			else if (pLight->IsAreaLight())
 			{
-				mPrimitives.Add(UniquePtr<Primitive>(((AreaLight*)pLight)->GetPrimitive()));
+				AreaLight* pAreaLight = (AreaLight*)pLight;
+				if (mScale != 1.0f)
+				{
+					pAreaLight->GetPrimitive()->mpMesh->SetScale(mScale);
+					pAreaLight->UpdateGeometry();
+				}
+
+				mPrimitives.Add(UniquePtr<Primitive>(pAreaLight->GetPrimitive()));
 				mLights.Add(UniquePtr<Light>(pLight));
+				mDirty = true;
 			}
 			else
 				mLights.Add(UniquePtr<Light>(pLight));
@@ -201,7 +245,13 @@ namespace EDX
 			_MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
 
 #if USE_EMBREE
-			mpEmbreeDevice = rtcNewDevice(nullptr);
+			if (!mpEmbreeDevice)
+				mpEmbreeDevice = rtcNewDevice(nullptr);
+
+			// Rebuilt from scratch, the positions may have been rescaled
+			if (mpEmbreeScene)
+				rtcDeleteScene(mpEmbreeScene);
+
 			mpEmbreeScene = rtcDeviceNewScene(mpEmbreeDevice, RTC_SCENE_STATIC | RTC_SCENE_INCOHERENT | RTC_SCENE_HIGH_QUALITY, RTC_INTERSECT1);
 
 			for (auto& it : mPrimitives)
@@ -221,6 +271,7 @@ namespace EDX
 			}
 
 			rtcCommit(mpEmbreeScene);
+			mDirty = false;
 #else
 			if (mDirty)
 			{
@@ -238,14 +289,69 @@ namespace EDX
 				mDirty = false;
 			}
 #endif // USE_EMBREE
+
+			// Subsurface probe rays only need to find the primitive they started on
+			mProbeAccels.Clear();
+			for (auto& it : mPrimitives)
+			{
+				if (!it->HasBSSRDF())
+				{
+					mProbeAccels.Add(nullptr);
+					continue;
+				}
+
+				Array<Primitive*> primArray;
+				primArray.Add(it.Get());
+				mProbeAccels.Add(MakeUnique<BVH2>());
+				mProbeAccels.Top()->Construct(primArray);
+			}
+
+			UpdateConstants();
+		}
+
+		void Scene::UpdateConstants()
+		{
+			// Bounds can only be queried once the accelerator exists
+#if USE_EMBREE
+			if (!mpEmbreeScene)
+				return;
+#else
+			if (!mAccel)
+				return;
+#endif // USE_EMBREE
+
+			mConstants.WorldBounds = ComputeWorldBounds();
+			mConstants.WorldBounds.BoundingSphere(&mConstants.SphereCenter, &mConstants.SphereRadius);
 		}
 
 		void Scene::SetScale(const float scale)
 		{
+			if (scale <= 0.0f)
+				return;
+
+			mScale = scale;
 			mSceneScale = Matrix::Scale(scale, scale, scale);
 
-			const float invScale = 1.0f / scale;
-			mSceneScaleInv = Matrix::Scale(invScale, invScale, invScale);
+			// The scale is baked into the mesh positions, so rays and hits need no transformation
+			for (auto& it : mPrimitives)
+				it->mpMesh->SetScale(scale);
+
+			for (auto& it : mLights)
+			{
+				if (it->IsAreaLight())
+					((AreaLight*)it.Get())->UpdateGeometry();
+			}
+
+			mDirty = true;
+			mVersion++;
+
+#if USE_EMBREE
+			const bool built = mpEmbreeScene != nullptr;
+#else
+			const bool built = mAccel.Get() != nullptr;
+#endif // USE_EMBREE
+			if (built)
+				InitAccelerator();
 		}
 	}
 }
\ No newline at end of file
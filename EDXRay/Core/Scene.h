@@ -17,6 +17,21 @@ namespace EDX
 {
 	namespace RayTracer
 	{
+		// Scene wide quantities that only change with the geometry or its scale, computed once the accelerator is
+		// built instead of querying it for every light sample
+		struct SceneConstants
+		{
+			BoundingBox WorldBounds;
+			Vector3 SphereCenter;
+			float SphereRadius;
+
+			SceneConstants()
+				: SphereCenter(Vector3::ZERO)
+				, SphereRadius(0.0f)
+			{
+			}
+		};
+
 		class Scene
 		{
 		private:
@@ -24,11 +39,15 @@ namespace EDX
 			Array<UniquePtr<Light>>		mLights;
 			Light*						mEnvMap;
 			UniquePtr<BVH2>				mAccel;
+			// Per primitive structures for subsurface probe rays, null for primitives without a BSSRDF
+			Array<UniquePtr<BVH2>>		mProbeAccels;
 			bool						mDirty;
+			uint						mVersion;		// Bumped whenever geometry or lights change
 			Array<UniquePtr<const Medium>> mMedia;
 
-			Matrix						mSceneScale;
-			Matrix						mSceneScaleInv;
+			float						mScale;			// Applied to every primitive, including ones added afterwards
+			Matrix						mSceneScale;	// Already applied to the geometry, kept for drawing the loaded meshes
+			SceneConstants				mConstants;
 
 #if USE_EMBREE
 			// Embree
@@ -44,12 +63,24 @@ namespace EDX
 			bool Intersect(const Ray& ray, Intersection* pIsect) const;
 			void PostIntersect(const Ray& ray, DifferentialGeom* pDiffGeom) const;
 			bool Occluded(const Ray& ray) const;
+			// Gathers up to maxIsects hits of the ray segment with a single primitive in no particular order, returns their number
+			int IntersectAll(const uint primId, const Ray& ray, Intersection* pIsects, const int maxIsects) const;
 
-			BoundingBox WorldBounds() const;
+			const BoundingBox& WorldBounds() const
+			{
+				return mConstants.WorldBounds;
+			}
+			void BoundingSphere(Vector3* pCenter, float* pRadius) const
+			{
+				*pCenter = mConstants.SphereCenter;
+				*pRadius = mConstants.SphereRadius;
+			}
 
 			// Scene management
 			void AddPrimitive(Primitive* pPrim);
 			void AddLight(Light* pLight);
+			// Takes ownership of a medium referenced by primitive medium interfaces, returns it for chaining
+			const Medium* AddMedium(const Medium* pMedium);
 
 			// Scene elements getter
 			const Array<UniquePtr<Primitive>>& GetPrimitives() const { return mPrimitives; }
@@ -77,11 +108,22 @@ namespace EDX
 
 			void InitAccelerator();
 
+			// Lets caches built from the scene detect changes, MarkModified covers edits made through the elements directly
+			uint GetVersion() const { return mVersion; }
+			void MarkModified() { mVersion++; }
+
+			// Scales the geometry relative to the loaded meshes, rebuilding the accelerators if they exist. Primitives and
+			// area lights added later are scaled on insertion. Point and directional light positions and medium bounds
+			// stay in world units, as they did when rays were transformed instead
 			void SetScale(const float scale);
 			const Matrix& GetScaleMatrix() const
 			{
 				return mSceneScale;
 			}
+
+		private:
+			BoundingBox ComputeWorldBounds() const;
+			void UpdateConstants();
 		};
 	}
 }
\ No newline at end of file
@@ -0,0 +1,293 @@
+#include "SnapshotWriter.h"
+#include "Film.h"
+#include "Math/EDXMath.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		SnapshotWriter::SnapshotWriter()
+			: mSequence(0)
+			, mTaskQueued(false)
+			, mWriteTask(this)
+		{
+			for (auto& it : mBuffers)
+			{
+				it.pFilm = nullptr;
+				it.State = EBufferState::Free;
+				it.Sequence = 0;
+			}
+		}
+
+		bool SnapshotWriter::RequestSnapshot(const Film* pFilm, const char* path, const EImageFormat format)
+		{
+			Snapshot* pSnapshot = AcquireBuffer();
+			if (!pSnapshot)
+				return false;
+
+			// The resolve is a plain memory pass, only the disk write is deferred
+			pSnapshot->Width = pFilm->GetWidth();
+			pSnapshot->Height = pFilm->GetHeight();
+			pSnapshot->Pixels.Resize(pSnapshot->Width * pSnapshot->Height);
+			pFilm->ResolveLinear(pSnapshot->Pixels.Data(), 0, pSnapshot->Height);
+
+			pSnapshot->pFilm = nullptr;
+			pSnapshot->Format = format;
+			CStringUtil::Strcpy(pSnapshot->Path, MAX_PATH, path);
+
+			QueueBuffer(pSnapshot);
+			return true;
+		}
+
+		bool SnapshotWriter::RequestDisplaySnapshot(const Film* pFilm, const char* path, const EImageFormat format)
+		{
+			Snapshot* pSnapshot = AcquireBuffer();
+			if (!pSnapshot)
+				return false;
+
+			pSnapshot->Width = pFilm->GetWidth();
+			pSnapshot->Height = pFilm->GetHeight();
+			pSnapshot->Pixels.Resize(pSnapshot->Width * pSnapshot->Height);
+
+			// The display buffer is gamma encoded, snapshots hold linear radiance
+			const Color* pDisplay = pFilm->GetPixelBuffer();
+			const float gamma = 1.0f / Film::INV_GAMMA;
+			for (auto i = 0; i < pSnapshot->Pixels.Size(); i++)
+				pSnapshot->Pixels[i] = Math::Pow(pDisplay[i], gamma);
+
+			pSnapshot->pFilm = nullptr;
+			pSnapshot->Format = format;
+			CStringUtil::Strcpy(pSnapshot->Path, MAX_PATH, path);
+
+			QueueBuffer(pSnapshot);
+			return true;
+		}
+
+		bool SnapshotWriter::RequestIncrementalSnapshot(const Film* pFilm, const char* path, const EImageFormat format)
+		{
+			Snapshot* pSnapshot = AcquireBuffer();
+			if (!pSnapshot)
+				return false;
+
+			pSnapshot->Width = pFilm->GetWidth();
+			pSnapshot->Height = pFilm->GetHeight();
+			pSnapshot->Pixels.Clear();
+			pSnapshot->pFilm = pFilm;
+			pSnapshot->Format = format;
+			CStringUtil::Strcpy(pSnapshot->Path, MAX_PATH, path);
+
+			QueueBuffer(pSnapshot);
+			return true;
+		}
+
+		void SnapshotWriter::WaitForPendingWrites()
+		{
+			while (true)
+			{
+				{
+					ScopeLock lock(&mCS);
+					if (!mTaskQueued)
+						return;
+				}
+
+				Sleep(1);
+			}
+		}
+
+		EImageFormat SnapshotWriter::FormatFromPath(const char* path)
+		{
+			const char* pExtension = strrchr(path, '.');
+			if (pExtension && _stricmp(pExtension, ".pfm") == 0)
+				return EImageFormat::PFM;
+			if (pExtension && _stricmp(pExtension, ".hdr") == 0)
+				return EImageFormat::HDR;
+
+			return EImageFormat::BMP;
+		}
+
+		SnapshotWriter::Snapshot* SnapshotWriter::AcquireBuffer()
+		{
+			ScopeLock lock(&mCS);
+
+			// Prefer a free buffer, otherwise replace a snapshot that has not been picked up yet
+			Snapshot* pPending = nullptr;
+			for (auto& it : mBuffers)
+			{
+				if (it.State == EBufferState::Free)
+				{
+					it.State = EBufferState::Filling;
+					return &it;
+				}
+				if (it.State == EBufferState::Pending)
+					pPending = &it;
+			}
+
+			if (pPending)
+				pPending->State = EBufferState::Filling;
+
+			return pPending;
+		}
+
+		void SnapshotWriter::QueueBuffer(Snapshot* pSnapshot)
+		{
+			ScopeLock lock(&mCS);
+
+			pSnapshot->State = EBufferState::Pending;
+			pSnapshot->Sequence = mSequence++;
+
+			if (!mTaskQueued)
+			{
+				mTaskQueued = true;
+				QueuedThreadPool::Instance()->AddQueuedWork(&mWriteTask);
+			}
+		}
+
+		void SnapshotWriter::WritePendingSnapshots()
+		{
+			while (true)
+			{
+				Snapshot* pSnapshot = nullptr;
+				{
+					ScopeLock lock(&mCS);
+
+					// Oldest pending snapshot first
+					for (auto& it : mBuffers)
+					{
+						if (it.State == EBufferState::Pending && (!pSnapshot || it.Sequence < pSnapshot->Sequence))
+							pSnapshot = &it;
+					}
+
+					if (!pSnapshot)
+					{
+						mTaskQueued = false;
+						return;
+					}
+
+					pSnapshot->State = EBufferState::Writing;
+				}
+
+				WriteSnapshot(*pSnapshot);
+
+				ScopeLock lock(&mCS);
+				pSnapshot->State = EBufferState::Free;
+			}
+		}
+
+		bool SnapshotWriter::WriteSnapshot(const Snapshot& snapshot)
+		{
+			FILE* pFile = nullptr;
+			if (fopen_s(&pFile, snapshot.Path, "wb") != 0 || !pFile)
+				return false;
+
+			const int width = snapshot.Width;
+			const int height = snapshot.Height;
+
+			int rowSize = 0;
+			switch (snapshot.Format)
+			{
+			case EImageFormat::PFM:
+				rowSize = 3 * sizeof(float) * width;
+				fprintf(pFile, "PF\n%i %i\n-1.0\n", width, height);
+				break;
+			case EImageFormat::HDR:
+				rowSize = 4 * width;
+				fprintf(pFile, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %i +X %i\n", height, width);
+				break;
+			case EImageFormat::BMP:
+			{
+				rowSize = (3 * width + 3) & ~3;
+
+				const uint imageSize = rowSize * height;
+				const uint header[] = {
+					54 + imageSize, 0, 54,	// File header after the magic number
+					40, uint(width), uint(height), (24 << 16) | 1, 0, imageSize, 2835, 2835, 0, 0 // Info header
+				};
+				fwrite("BM", 1, 2, pFile);
+				fwrite(header, sizeof(header), 1, pFile);
+				break;
+			}
+			}
+
+			Array<unsigned char> rowBytes;
+			rowBytes.Init(0, rowSize);
+			Array<Color> strip;
+
+			// Film rows are stored bottom up, as PFM and BMP expect, Radiance files are top down
+			const bool bottomUp = snapshot.Format != EImageFormat::HDR;
+			bool succeeded = true;
+			for (auto fileRow = 0; fileRow < height && succeeded; fileRow += STRIP_HEIGHT)
+			{
+				const int numRows = Math::Min(STRIP_HEIGHT, height - fileRow);
+				const int startRow = bottomUp ? fileRow : height - fileRow - numRows;
+
+				const Color* pStrip = nullptr;
+				if (snapshot.pFilm)
+				{
+					strip.Resize(numRows * width);
+					snapshot.pFilm->ResolveLinear(strip.Data(), startRow, startRow + numRows);
+					pStrip = strip.Data();
+				}
+				else
+					pStrip = snapshot.Pixels.Data() + startRow * width;
+
+				for (auto r = 0; r < numRows && succeeded; r++)
+				{
+					const Color* pRow = pStrip + (bottomUp ? r : numRows - 1 - r) * width;
+					unsigned char* pBytes = rowBytes.Data();
+
+					for (auto x = 0; x < width; x++)
+					{
+						const Color& color = pRow[x];
+						switch (snapshot.Format)
+						{
+						case EImageFormat::PFM:
+						{
+							float* pFloats = (float*)pBytes + 3 * x;
+							pFloats[0] = color.r;
+							pFloats[1] = color.g;
+							pFloats[2] = color.b;
+							break;
+						}
+						case EImageFormat::HDR:
+						{
+							unsigned char* pRGBE = pBytes + 4 * x;
+							const float maxVal = Math::Max(color.r, Math::Max(color.g, color.b));
+							if (maxVal < 1e-32f)
+							{
+								pRGBE[0] = pRGBE[1] = pRGBE[2] = pRGBE[3] = 0;
+							}
+							else
+							{
+								int exponent;
+								const float scale = frexpf(maxVal, &exponent) * 256.0f / maxVal;
+								pRGBE[0] = (unsigned char)(color.r * scale);
+								pRGBE[1] = (unsigned char)(color.g * scale);
+								pRGBE[2] = (unsigned char)(color.b * scale);
+								pRGBE[3] = (unsigned char)(exponent + 128);
+							}
+							break;
+						}
+						case EImageFormat::BMP:
+						{
+							unsigned char* pBGR = pBytes + 3 * x;
+							pBGR[0] = (unsigned char)(Math::Pow(Math::Saturate(color.b), Film::INV_GAMMA) * 255.0f + 0.5f);
+							pBGR[1] = (unsigned char)(Math::Pow(Math::Saturate(color.g), Film::INV_GAMMA) * 255.0f + 0.5f);
+							pBGR[2] = (unsigned char)(Math::Pow(Math::Saturate(color.r), Film::INV_GAMMA) * 255.0f + 0.5f);
+							break;
+						}
+						}
+					}
+
+					succeeded = fwrite(pBytes, 1, rowSize, pFile) == rowSize;
+				}
+			}
+
+			fclose(pFile);
+			return succeeded;
+		}
+	}
+}
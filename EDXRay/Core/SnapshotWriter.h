@@ -0,0 +1,101 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Graphics/Color.h"
+#include "Windows/Threading.h"
+#include "../ForwardDecl.h"
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		enum class EImageFormat
+		{
+			PFM,	// Linear float RGB
+			HDR,	// Radiance RGBE
+			BMP		// Gamma corrected 8 bit
+		};
+
+		// Writes film snapshots on a pool thread. Full snapshots are resolved into one of two buffers on the
+		// calling thread so the next one can be taken while the previous is still being written. Incremental
+		// snapshots are resolved strip by strip on the I/O thread and never hold a copy of the whole image.
+		class SnapshotWriter
+		{
+		private:
+			enum class EBufferState
+			{
+				Free,
+				Filling,
+				Pending,
+				Writing
+			};
+
+			struct Snapshot
+			{
+				Array<Color> Pixels;
+				int Width, Height;
+				char Path[MAX_PATH];
+				EImageFormat Format;
+
+				// Set for incremental snapshots, the film has to outlive the write
+				const Film* pFilm;
+
+				EBufferState State;
+				uint Sequence;
+			};
+
+			class QueuedWriteTask : public QueuedWork
+			{
+			private:
+				SnapshotWriter* mpWriter;
+
+			public:
+				QueuedWriteTask(SnapshotWriter* pWriter)
+					: mpWriter(pWriter)
+				{
+				}
+
+				void DoThreadedWork()
+				{
+					mpWriter->WritePendingSnapshots();
+				}
+
+				void Abandon()
+				{
+				}
+			};
+
+			static const int NUM_BUFFERS = 2;
+			static const int STRIP_HEIGHT = 32;
+
+			Snapshot mBuffers[NUM_BUFFERS];
+			uint mSequence;
+			bool mTaskQueued;
+			QueuedWriteTask mWriteTask;
+			CriticalSection mCS;
+
+		public:
+			SnapshotWriter();
+			~SnapshotWriter()
+			{
+				WaitForPendingWrites();
+			}
+
+			bool RequestSnapshot(const Film* pFilm, const char* path, const EImageFormat format);
+			// Snapshots the displayed pixel buffer instead of the accumulation, which keeps post processing such as
+			// RHF denoising that only exists in the display image
+			bool RequestDisplaySnapshot(const Film* pFilm, const char* path, const EImageFormat format);
+			bool RequestIncrementalSnapshot(const Film* pFilm, const char* path, const EImageFormat format);
+			void WaitForPendingWrites();
+
+			static EImageFormat FormatFromPath(const char* path);
+
+		private:
+			Snapshot* AcquireBuffer();
+			void QueueBuffer(Snapshot* pSnapshot);
+			void WritePendingSnapshots();
+
+			static bool WriteSnapshot(const Snapshot& snapshot);
+		};
+	}
+}
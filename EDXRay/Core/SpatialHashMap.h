@@ -6,8 +6,13 @@
 #include "Windows/Atomics.h"
 #include "Windows/Threading.h"
 
+#include <new>
+
 namespace EDX
 {
+	// Concurrent open addressing hash map from integer keys to values owned by the map. Lookups and insertions
+	// run in parallel under a shared lock, the table only takes the exclusive lock to grow or clear.
+	// Values are constructed in an arena and never move, so returned pointers stay valid until Clear
 	template<typename KeyType, typename ValueType>
 	class SpatialHashMap
 	{
@@ -15,80 +20,216 @@ namespace EDX
 		struct Entry
 		{
 			KeyType Key = INDEX_NONE;
-			ValueType Value;
-
-			Entry() = default;
-			Entry(const KeyType& InKey, const ValueType& InVal)
-				: Key(InKey)
-				, Value(InVal)
-			{
-			}
+			ValueType* volatile pValue = nullptr;
 		};
 
+	private:
+		static const int ARENA_BLOCK_SIZE = 256;
+
 		uint32 mSize;
-		AtomicCounter mCounter;
-		Array<uint32> mUniqueIds;
 		Array<Entry> mEntries;
+		volatile long mCount;
+		mutable SRWLOCK mTableLock;
+
+		// Values are placement constructed in fixed size blocks
+		Array<ValueType*> mArenaBlocks;
+		int mArenaUsed;
+		CriticalSection mArenaLock;
 
-		SpatialHashMap(const uint32 size)
+	public:
+		SpatialHashMap(const uint32 initialSize)
+			: mCount(0)
+			, mArenaUsed(ARENA_BLOCK_SIZE)
 		{
-			Resize(size);
-			mCounter.Reset();
+			InitializeSRWLock(&mTableLock);
+			mSize = Math::RoundUpPowOfTwo(Math::Max(initialSize, 16u));
+			mEntries.Resize(mSize);
 		}
 
-		void Resize(const int newSize)
+		~SpatialHashMap()
 		{
-			mSize = Math::RoundUpPowOfTwo(newSize);
-			mEntries.Resize(mSize);
-			mUniqueIds.Resize(mSize);
+			Clear();
 		}
 
-		void Insert(const KeyType& key, const ValueType& value)
+		// Returns the value stored for key, constructing it from args if the key is new. Only one of several racing
+		// callers constructs the value, the others wait until it is published
+		template<typename... Args>
+		ValueType* FindOrInsert(const KeyType& key, const Args&... args)
 		{
-			const uint32 baseSlot = GetTypeHash(key) & (mSize - 1);
-			uint32 slot;
-			KeyType oldKey = INDEX_NONE;
+			Assert(key != KeyType(INDEX_NONE));
+
+			AcquireSRWLockShared(&mTableLock);
+
+			ValueType* pValue = nullptr;
+			bool inserted = false;
+
+			const uint32 mask = mSize - 1;
+			uint32 slot = GetTypeHash(key) & mask;
 
-			uint32 i = 0;
-			do {
-				slot = (baseSlot + i * i) & (mSize - 1);
-				i++;
+			// Triangular probing visits every slot of a power of two table
+			for (uint32 i = 1; i <= mSize; i++)
+			{
+				Entry& entry = mEntries[slot];
+
+				KeyType oldKey = entry.Key;
+				if (oldKey == KeyType(INDEX_NONE))
+					oldKey = (KeyType)WindowsAtomics::InterlockedCompareExchange((int64*)&entry.Key, (int64)key, (int64)INDEX_NONE);
+
+				if (oldKey == KeyType(INDEX_NONE))
+				{
+					// Construct before publishing, the exchange is a full barrier
+					pValue = AllocateValue(args...);
+					InterlockedExchangePointer((void* volatile*)&entry.pValue, pValue);
+					inserted = true;
+					break;
+				}
+				if (oldKey == key)
+				{
+					while ((pValue = entry.pValue) == nullptr)
+						YieldProcessor();
+					break;
+				}
+
+				slot = (slot + i) & mask;
+			}
+
+			const uint32 size = mSize;
+			ReleaseSRWLockShared(&mTableLock);
 
-				oldKey = WindowsAtomics::InterlockedCompareExchange((int64*)&mEntries[slot].Key, (int64)key, (int64)INDEX_NONE);
-			} while (oldKey != INDEX_NONE && oldKey != key);
+			// Keep the load factor under one half so probe sequences stay short and always find a free slot
+			if (inserted && uint32(InterlockedIncrement(&mCount)) * 2 > size)
+				Grow(size);
 
-			if (oldKey == INDEX_NONE)
+			// The table was full before this insertion could claim a slot
+			if (!pValue)
 			{
-				// Pack the 
-				int counter = mCounter.Add(1);
-				mUniqueIds[counter] = slot;
-				mEntries[slot].Value = value;
+				Grow(size);
+				return FindOrInsert(key, args...);
 			}
 
-			return;
+			return pValue;
 		}
 
-		ValueType* Find(const KeyType& key)
+		ValueType* Find(const KeyType& key) const
 		{
-			const uint32 baseSlot = GetTypeHash(key) & (mSize - 1);
-			uint32 slot = baseSlot;
+			AcquireSRWLockShared(&mTableLock);
+
+			ValueType* pValue = nullptr;
+
+			const uint32 mask = mSize - 1;
+			uint32 slot = GetTypeHash(key) & mask;
+			for (uint32 i = 1; i <= mSize; i++)
+			{
+				const Entry& entry = mEntries[slot];
+				const KeyType entryKey = entry.Key;
+				if (entryKey == KeyType(INDEX_NONE))
+					break;
+
+				// A value still under construction is reported as missing
+				if (entryKey == key)
+				{
+					pValue = entry.pValue;
+					break;
+				}
+
+				slot = (slot + i) & mask;
+			}
+
+			ReleaseSRWLockShared(&mTableLock);
+			return pValue;
+		}
 
-			for (uint32 i = 1; mEntries[slot].Key != INDEX_NONE && mEntries[slot].Key != key; i++)
+		// Calls func(key, value) for every published entry, insertions may proceed concurrently
+		template<typename Func>
+		void ForEach(Func func)
+		{
+			AcquireSRWLockShared(&mTableLock);
+			for (auto i = 0; i < int(mSize); i++)
 			{
-				slot = (baseSlot + i * i) & (mSize - 1);
+				ValueType* pValue = mEntries[i].pValue;
+				if (pValue)
+					func(mEntries[i].Key, *pValue);
 			}
+			ReleaseSRWLockShared(&mTableLock);
+		}
+
+		// Removes all entries and destroys their values, must not overlap with other calls
+		void Clear()
+		{
+			AcquireSRWLockExclusive(&mTableLock);
 
-			if (mEntries[slot].Key == key)
+			for (auto& entry : mEntries)
 			{
-				return &mEntries[slot].Value;
+				if (entry.pValue)
+					entry.pValue->~ValueType();
+
+				entry.Key = INDEX_NONE;
+				entry.pValue = nullptr;
 			}
 
-			return nullptr;
+			for (auto pBlock : mArenaBlocks)
+				::operator delete(pBlock);
+
+			mArenaBlocks.Clear();
+			mArenaUsed = ARENA_BLOCK_SIZE;
+			mCount = 0;
+
+			ReleaseSRWLockExclusive(&mTableLock);
+		}
+
+		uint32 GetCount() const
+		{
+			return mCount;
 		}
 
 		SIZE_T GetSize() const
 		{
 			return mSize;
 		}
+
+	private:
+		template<typename... Args>
+		ValueType* AllocateValue(const Args&... args)
+		{
+			ScopeLock lock(&mArenaLock);
+			if (mArenaUsed == ARENA_BLOCK_SIZE)
+			{
+				mArenaBlocks.Add((ValueType*)::operator new(sizeof(ValueType) * ARENA_BLOCK_SIZE));
+				mArenaUsed = 0;
+			}
+
+			ValueType* pMemory = mArenaBlocks[mArenaBlocks.Size() - 1] + mArenaUsed++;
+			return new (pMemory) ValueType(args...);
+		}
+
+		void Grow(const uint32 observedSize)
+		{
+			AcquireSRWLockExclusive(&mTableLock);
+
+			// Another thread may already have grown the table
+			if (mSize == observedSize)
+			{
+				const uint32 newSize = mSize * 2;
+				Array<Entry> newEntries;
+				newEntries.Resize(newSize);
+
+				for (auto& entry : mEntries)
+				{
+					if (entry.Key == KeyType(INDEX_NONE))
+						continue;
+
+					uint32 slot = GetTypeHash(entry.Key) & (newSize - 1);
+					for (uint32 i = 1; newEntries[slot].Key != KeyType(INDEX_NONE); i++)
+						slot = (slot + i) & (newSize - 1);
+
+					newEntries[slot] = entry;
+				}
+
+				mEntries = newEntries;
+				mSize = newSize;
+			}
+
+			ReleaseSRWLockExclusive(&mTableLock);
+		}
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Integrator.h"
+#include "Camera.h"
+#include "Sampler.h"
+#include "Film.h"
+#include "Config.h"
+#include "Ray.h"
+#include "Graphics/Color.h"
+
+#include <ppl.h>
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		template<typename IntegratorImpl, typename SamplerImpl>
+		void TiledIntegrator::RenderTiles(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const
+		{
+			const IntegratorImpl* pIntegrator = static_cast<const IntegratorImpl*>(this);
+
+			// Passes already accumulated in the film (e.g. restored from a checkpoint) are skipped
+			for (int spp = pFilm->GetSampleCount(); spp < mJobDesc.SamplesPerPixel; spp++)
+			{
+				int numTiles = mTaskSync.GetNumTiles();
+
+				concurrency::parallel_for(0, numTiles, [&](int i)
+				{
+					const RenderTile& tile = mTaskSync.GetTile(i);
+
+					// Clone a sampler for this tile, clones have the same type as pSampler
+					UniquePtr<Sampler> pClone(pSampler->Clone((mJobDesc.PassOffset + spp) * numTiles + i));
+					SamplerImpl* pTileSampler = static_cast<SamplerImpl*>(pClone.Get());
+
+					RandomGen random;
+					MemoryPool memory;
+
+					for (auto y = tile.minY; y < tile.maxY; y++)
+					{
+						for (auto x = tile.minX; x < tile.maxX; x++)
+						{
+							if (mTaskSync.Aborted())
+								return;
+
+							pTileSampler->StartPixel(x, y);
+							CameraSample camSample;
+							pTileSampler->GenerateSamples(x, y, &camSample, random);
+							camSample.imageX += x;
+							camSample.imageY += y;
+
+							RayDifferential ray;
+							Color L = Color::BLACK;
+							if (pCamera->GenRayDifferential(camSample, &ray))
+							{
+								L = pIntegrator->template LiT<SamplerImpl>(ray, pScene, pTileSampler, random, memory);
+							}
+
+							pFilm->AddSample(camSample.imageX, camSample.imageY, L);
+							memory.FreeAll();
+						}
+					}
+				});
+
+				pSampler->AdvanceSampleIndex();
+
+				pFilm->IncreSampleCount();
+				pFilm->ScaleToPixel();
+
+				if (mTaskSync.Aborted())
+					break;
+
+				//mFrameTime = mTimer.GetElapsedTime();
+			}
+		}
+	}
+}
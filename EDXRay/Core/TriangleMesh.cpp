@@ -36,6 +36,12 @@ namespace EDX
 			mTextured = mpObjMesh->IsTextured();
 		}
 
+		void TriangleMesh::SetScale(const float scale)
+		{
+			for (auto i = 0; i < mVertexCount; i++)
+				mpPositionBuffer[i] = mpObjMesh->GetVertexAt(i).position * scale;
+		}
+
 		void TriangleMesh::PostIntersect(const Ray& ray, DifferentialGeom* pDiffGeom) const
 		{
 			Assert(pDiffGeom);
@@ -38,6 +38,8 @@ namespace EDX
 			}
 
 			void LoadMesh(const ObjMesh* pObjMesh);
+			// Positions are recomputed from the loaded mesh, so repeated scaling does not accumulate error
+			void SetScale(const float scale);
 
 			void PostIntersect(const Ray& ray, DifferentialGeom* pDiffGeom) const;
 
@@ -9,6 +9,8 @@ namespace EDX
 		class Camera;
 		class Scene;
 		class Film;
+		struct FilmState;
+		class RenderCheckpoint;
 		class Integrator;
 		class TiledIntegrator;
 		class Light;
@@ -21,6 +23,8 @@ namespace EDX
 		class RayDifferential;
 		struct CameraSample;
 		struct Sample;
+		struct DirectLightingSample;
+		struct BounceSample;
 		class Sampler;
 		class RayDifferential;
 		class Scatter;
@@ -49,6 +53,8 @@ namespace EDX
 		{
 			class Distribution1D;
 			class Distribution2D;
+			class AliasDistribution1D;
+			class AliasDistribution2D;
 		}
 	}
 
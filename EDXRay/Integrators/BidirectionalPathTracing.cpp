@@ -133,17 +133,16 @@ namespace EDX
 		{
 			PathState ret;
 
-			float lightIdSample = pSampler->Get1D();
+			LightEmissionSample emissionSample;
+			GetSampleVector(pSampler, &emissionSample);
+
 			float lightPickPdf;
-			auto pSampledLight = pScene->ChooseLightSource(lightIdSample, &lightPickPdf);
+			auto pSampledLight = pScene->ChooseLightSource(emissionSample.LightIndex, &lightPickPdf);
 
 			Ray lightRay;
 			Vector3 emitDir;
 			float emitPdf, directPdf;
-			Sample lightSample1 = pSampler->GetSample();
-			Sample lightSample2 = pSampler->GetSample();
-
-			ret.Throughput = pSampledLight->Sample(lightSample1, lightSample2, &lightRay, &emitDir, &emitPdf, &directPdf);
+			ret.Throughput = pSampledLight->Sample(emissionSample.Position, emissionSample.Direction, &lightRay, &emitDir, &emitPdf, &directPdf);
 			if (emitPdf == 0.0f)
 				return ret;
 
@@ -278,7 +277,8 @@ namespace EDX
 				screenCoord.y *= -1.0f;
 
 				float U, V;
-				Sampling::ConcentricSampleDisk(pSampler->Get1D(), pSampler->Get1D(), &U, &V);
+				const Vector2 lensSample = pSampler->Get2D();
+				Sampling::ConcentricSampleDisk(lensSample.x, lensSample.y, &U, &V);
 
 				if (Math::Length(Vector2(screenCoord.x + U, screenCoord.y + V)) > pCamera->mVignetteFactor)
 					return Color::BLACK;
@@ -371,9 +371,11 @@ namespace EDX
 			RandomGen& random)
 		{
 			// Sample light source and get radiance
-			float lightIdSample = pSampler->Get1D();
+			LightConnectionSample lightSample;
+			GetSampleVector(pSampler, &lightSample);
+
 			float lightPickPdf;
-			const Light* pLight = pScene->ChooseLightSource(lightIdSample, &lightPickPdf);
+			const Light* pLight = pScene->ChooseLightSource(lightSample.LightIndex, &lightPickPdf);
 
 			const Vector3& pos = diffGeom.mPosition;
 			Vector3 vIn;
@@ -381,8 +383,7 @@ namespace EDX
 			float lightPdfW;
 			float cosAtLight;
 			float emitPdfW;
-			Sample lightSample = pSampler->GetSample();
-			Color radiance = pLight->Illuminate(diffGeom, lightSample, &vIn, &visibility, &lightPdfW, &cosAtLight, &emitPdfW);
+			Color radiance = pLight->Illuminate(diffGeom, lightSample.Light, &vIn, &visibility, &lightPdfW, &cosAtLight, &emitPdfW);
 			if (radiance.IsBlack() || lightPdfW == 0.0f)
 			{
 				return Color::BLACK;
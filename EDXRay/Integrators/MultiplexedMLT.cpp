@@ -18,12 +18,46 @@ namespace EDX
 {
 	namespace RayTracer
 	{
+		namespace
+		{
+			// Inverse CDF of the standard normal distribution sampled at bin centers, replaces the
+			// ErfInv evaluation of every small step mutation with a lookup and a lerp
+			struct NormalInverseCDFTable
+			{
+				static const int Size = 4096;
+				float Values[Size];
+
+				NormalInverseCDFTable()
+				{
+					const float Sqrt2 = 1.41421356237309504880f;
+					for (auto i = 0; i < Size; i++)
+					{
+						const float u = (i + 0.5f) / float(Size);
+						Values[i] = Sqrt2 * Math::ErfInv(2 * u - 1);
+					}
+				}
+
+				float Sample(const float u) const
+				{
+					// Symmetric around u = 0.5, so the perturbation kernel stays symmetric
+					const float pos = Math::Clamp(u * Size - 0.5f, 0.0f, float(Size - 1));
+					const int index = Math::Min(int(pos), Size - 2);
+					const float t = pos - index;
+
+					return Values[index] + t * (Values[index + 1] - Values[index]);
+				}
+			};
+
+			const NormalInverseCDFTable gNormalInverseCDF;
+		}
+
 		float MetropolisSampler::Get1D()
 		{
 			const int index = GetNextIndex();
-			Mutate(index);
+			EnsureSampleCount(index + 1);
+			MutateSample(index);
 
-			return mSamples[index].value;
+			return mValues[index];
 		}
 
 		Vector2 MetropolisSampler::Get2D()
@@ -41,6 +75,22 @@ namespace EDX
 			return ret;
 		}
 
+		void MetropolisSampler::GetSampleVector(const int* pGroupSizes, const int numGroups, float* pSamples)
+		{
+			// The primary sample storage grows at most once for the whole vector
+			const int numDimensions = NumDimensions(pGroupSizes, numGroups);
+			const int lastIndex = mStreamIndex + StreamCount * (mSampleIndex + numDimensions - 1);
+			EnsureSampleCount(lastIndex + 1);
+
+			for (auto i = 0; i < numDimensions; i++)
+			{
+				const int index = GetNextIndex();
+				MutateSample(index);
+
+				pSamples[i] = mValues[index];
+			}
+		}
+
 		void MetropolisSampler::GenerateSamples(
 			const int pixelX,
 			const int pixelY,
@@ -56,40 +106,62 @@ namespace EDX
 		{
 			mLargeStep = mRandom.Float() < mLargeStepProb;
 			mCurrentIteration++;
+			mNumBackups = 0;
+		}
+
+		void MetropolisSampler::EnsureSampleCount(const int count)
+		{
+			if (count > mValues.Size())
+			{
+				const int oldCount = mValues.Size();
+				mValues.Resize(count);
+				mModifiedIterations.Resize(count);
+				for (auto i = oldCount; i < count; i++)
+				{
+					mValues[i] = 0.0f;
+					mModifiedIterations[i] = 0u;
+				}
+
+				// Every sample is touched at most once per iteration
+				if (count > mBackups.Size())
+					mBackups.Resize(count);
+			}
 		}
 
-		void MetropolisSampler::Mutate(const int index)
+		void MetropolisSampler::MutateSample(const int index)
 		{
-			if (index >= mSamples.Size())
-				mSamples.Resize(index + 1);
+			float& value = mValues[index];
+			uint64& modifiedIteration = mModifiedIterations[index];
 
-			PrimarySample& sample = mSamples[index];
-			if (sample.modifiedIteration < mPrevLargeStepIteration)
+			if (modifiedIteration < mPrevLargeStepIteration)
 			{
-				sample.value = mRandom.Float();
-				sample.modifiedIteration = mPrevLargeStepIteration;
+				value = mRandom.Float();
+				modifiedIteration = mPrevLargeStepIteration;
 			}
 
-			sample.Backup();
+			SampleBackup& backup = mBackups[mNumBackups++];
+			backup.index = index;
+			backup.value = value;
+			backup.modifiedIteration = modifiedIteration;
+
 			if (mLargeStep) // Perform large step mutation
 			{
-				sample.value = mRandom.Float();
+				value = mRandom.Float();
 			}
 			else // Small step mutation
 			{
-				int numSmallSteps = mCurrentIteration - sample.modifiedIteration;
+				int numSmallSteps = mCurrentIteration - modifiedIteration;
 
 				// Sample the standard normal distribution
-				const float Sqrt2 = 1.41421356237309504880f;
-				float normalSample = Sqrt2 * Math::ErfInv(2 * mRandom.Float() - 1);
+				float normalSample = gNormalInverseCDF.Sample(mRandom.Float());
 
 				// Compute the effective standard deviation and apply perturbation to
 				float effSigma = mSigma * Math::Sqrt(float(numSmallSteps));
-				sample.value += normalSample * effSigma;
-				sample.value -= Math::FloorToInt(sample.value);
+				value += normalSample * effSigma;
+				value -= Math::FloorToInt(value);
 			}
 
-			sample.modifiedIteration = mCurrentIteration;
+			modifiedIteration = mCurrentIteration;
 		}
 
 		void MetropolisSampler::Accept()
@@ -100,11 +172,14 @@ namespace EDX
 
 		void MetropolisSampler::Reject()
 		{
-			for (auto& it : mSamples)
+			// Restore in reverse order of mutation
+			for (auto i = mNumBackups - 1; i >= 0; i--)
 			{
-				if (it.modifiedIteration == mCurrentIteration)
-					it.Restore();
+				const SampleBackup& backup = mBackups[i];
+				mValues[backup.index] = backup.value;
+				mModifiedIterations[backup.index] = backup.modifiedIteration;
 			}
+			mNumBackups = 0;
 			mCurrentIteration--;
 		}
 
@@ -150,13 +225,18 @@ namespace EDX
 			if (mTaskSync.Aborted())
 				return;
 
-			Sampling::Distribution1D bootstrapDist(bootstrapWeights.Data(), bootstrapWeights.Size());
+			Sampling::AliasDistribution1D bootstrapDist(bootstrapWeights.Data(), bootstrapWeights.Size());
 			float b = bootstrapDist.GetIntegral() * (mMaxDepth + 1);
 
 			// Mutations per chain roughly equals to samples per pixel
 			float mutationsPerPixel = mJobDesc.SamplesPerPixel;
 			uint64 numTotalMutations = mutationsPerPixel * mpFilm->GetPixelCount();
-			uint64 totalSamples = 0;
+
+			// Mutations already splatted into the film (e.g. restored from a checkpoint) are skipped,
+			// chains restarted from there, or run by other workers, use fresh random streams
+			const int startPass = mpFilm->GetSampleCount();
+			uint64 totalSamples = uint64(startPass) * mpFilm->GetPixelCount();
+			numTotalMutations -= Math::Min(totalSamples, numTotalMutations);
 
 			//for (int i = 0; i < mNumChains; i++)
 			parallel_for(0, mNumChains, [&](int i)
@@ -168,7 +248,8 @@ namespace EDX
 					Math::Min((i + 1) * numTotalMutations / mNumChains, numTotalMutations) -
 					i * numTotalMutations / mNumChains;
 
-				RandomGen random(i);
+				const int chainSeed = i + (mJobDesc.PassOffset + startPass) * mNumChains;
+				RandomGen random(chainSeed);
 				MemoryPool memory;
 
 				int bootstrapIndex = bootstrapDist.SampleDiscrete(random.Float(), nullptr);
@@ -182,6 +263,11 @@ namespace EDX
 				Vector2 currentRaster;
 				Color currentLum = EvalSample(pScene, &sampler, depth, &currentRaster, random, memory);
 
+				// The bootstrap seed only reproduces the initial state, mutations continue from the chain's own stream
+				// so that workers and resumed runs starting from the same bootstrap sample do not repeat each other.
+				// Offset past the seeds of the bootstrap samplers
+				sampler.Reseed(numBootstrapSamples + chainSeed);
+
 				// Run the Markov chain for numChainMutations steps
 				for (uint64 j = 0; j < numChainMutations; j++)
 				{
@@ -223,7 +309,9 @@ namespace EDX
 
 						if (totalSamples % mpFilm->GetPixelCount() == 0)
 						{
-							mpFilm->IncreSampleCount();
+							// Other chains keep splatting without the lock, so no periodic checkpoint is taken here.
+							// MLT films are only saved by an explicit flush once the chains have stopped
+							mpFilm->IncreSampleCount(false);
 
 							float currentMutationsPerPixel = (totalSamples / float(mpFilm->GetPixelCount()));
 							mpFilm->ScaleToPixel(currentMutationsPerPixel / b);
@@ -12,30 +12,22 @@ namespace EDX
 		class MetropolisSampler : public Sampler
 		{
 		private:
-			struct PrimarySample
+			// State of a primary sample before its mutation in the current iteration
+			struct SampleBackup
 			{
-			public:
-				float value = 0.0f;
-				uint64 modifiedIteration = 0u;
-
-				float backupValue = 0.0f;
-				uint64 backupModifiedIteration = 0u;
-
-				void Backup()
-				{
-					backupValue = value;
-					backupModifiedIteration = modifiedIteration;
-				}
-
-				void Restore()
-				{
-					value = backupValue;
-					modifiedIteration = backupModifiedIteration;
-				}
+				int index;
+				float value;
+				uint64 modifiedIteration;
 			};
 
 		private:
-			Array<PrimarySample> mSamples;
+			// Primary samples in SoA layout, indexed by GetNextIndex()
+			Array<float> mValues;
+			Array<uint64> mModifiedIterations;
+
+			// Samples touched in the current iteration, Reject only restores these
+			Array<SampleBackup> mBackups;
+			int mNumBackups = 0;
 
 			const float mSigma;
 			const float mLargeStepProb;
@@ -62,6 +54,7 @@ namespace EDX
 			float Get1D() override;
 			Vector2 Get2D() override;
 			Sample GetSample() override;
+			void GetSampleVector(const int* pGroupSizes, const int numGroups, float* pSamples) override;
 			void GenerateSamples(
 				const int pixelX,
 				const int pixelY,
@@ -72,7 +65,12 @@ namespace EDX
 			void StartIteration();
 			void Accept();
 			void Reject();
-			void Mutate(const int index);
+
+			// Restarts the mutation stream, the primary samples drawn so far are kept
+			void Reseed(const int seed)
+			{
+				mRandom = RandomGen(seed);
+			}
 
 			void StartStream(const int index)
 			{
@@ -82,6 +80,9 @@ namespace EDX
 			}
 
 		private:
+			void EnsureSampleCount(const int count);
+			void MutateSample(const int index);
+
 			int GetNextIndex()
 			{
 				return mStreamIndex + StreamCount * mSampleIndex++;
@@ -0,0 +1,602 @@
+#include "PathGuiding.h"
+#include "../Core/Camera.h"
+#include "../Core/Film.h"
+#include "../Core/Scene.h"
+#include "../Core/Light.h"
+#include "../Core/DifferentialGeom.h"
+#include "../Core/BSDF.h"
+#include "../Core/BSSRDF.h"
+#include "../Core/Medium.h"
+#include "../Core/Sampling.h"
+#include "../Core/Ray.h"
+#include "../Core/TaskSynchronizer.h"
+#include "../Core/AtomicFloat.h"
+#include "../Core/Config.h"
+#include "Graphics/Color.h"
+
+#include <ppl.h>
+using namespace concurrency;
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		void GuidingQuadTree::Deposit(const Vector3& dir, const float value)
+		{
+			Vector2 p = DirectionToSquare(dir);
+
+			int node = 0;
+			do
+			{
+				const int quadrant = Quadrant(&p);
+				AtomicAdd(&mNodes[node].Sum[quadrant], value);
+				node = mNodes[node].Children[quadrant];
+			} while (node != 0);
+		}
+
+		float GuidingQuadTree::Pdf(const Vector3& dir) const
+		{
+			if (Total() <= 0.0f)
+				return Sampling::UniformSpherePDF();
+
+			Vector2 p = DirectionToSquare(dir);
+
+			float pdf = 1.0f;
+			int node = 0;
+			do
+			{
+				const Node& current = mNodes[node];
+				const float nodeTotal = current.Sum[0] + current.Sum[1] + current.Sum[2] + current.Sum[3];
+				if (nodeTotal <= 0.0f)
+					break;
+
+				const int quadrant = Quadrant(&p);
+				pdf *= 4.0f * current.Sum[quadrant] / nodeTotal;
+				node = current.Children[quadrant];
+			} while (node != 0);
+
+			return pdf * Sampling::UniformSpherePDF();
+		}
+
+		Vector3 GuidingQuadTree::Sample(const Vector2& sample, float* pPdf) const
+		{
+			if (Total() <= 0.0f)
+			{
+				*pPdf = Sampling::UniformSpherePDF();
+				return Sampling::UniformSampleSphere(sample.x, sample.y);
+			}
+
+			Vector2 u = sample;
+			Vector2 origin = Vector2(0.0f, 0.0f);
+			float size = 1.0f;
+			float pdf = 1.0f;
+			int node = 0;
+			do
+			{
+				const Node& current = mNodes[node];
+				const float nodeTotal = current.Sum[0] + current.Sum[1] + current.Sum[2] + current.Sum[3];
+				if (nodeTotal <= 0.0f)
+					break;
+
+				// The x half is picked from the marginal, the y half from the conditional of that column
+				int x, y;
+				const float probLeft = (current.Sum[0] + current.Sum[2]) / nodeTotal;
+				if (u.x < probLeft)
+				{
+					x = 0;
+					u.x = u.x / probLeft;
+				}
+				else
+				{
+					x = 1;
+					u.x = (u.x - probLeft) / (1.0f - probLeft);
+				}
+
+				const float probBottom = current.Sum[x] / (current.Sum[x] + current.Sum[x + 2]);
+				if (u.y < probBottom)
+				{
+					y = 0;
+					u.y = u.y / probBottom;
+				}
+				else
+				{
+					y = 1;
+					u.y = (u.y - probBottom) / (1.0f - probBottom);
+				}
+
+				u.x = Math::Min(u.x, 0.99999994f);
+				u.y = Math::Min(u.y, 0.99999994f);
+
+				const int quadrant = x + 2 * y;
+				pdf *= 4.0f * current.Sum[quadrant] / nodeTotal;
+
+				size *= 0.5f;
+				origin.x += x * size;
+				origin.y += y * size;
+				node = current.Children[quadrant];
+			} while (node != 0);
+
+			*pPdf = pdf * Sampling::UniformSpherePDF();
+			return SquareToDirection(Vector2(origin.x + u.x * size, origin.y + u.y * size));
+		}
+
+		void GuidingQuadTree::Rebuild(const GuidingQuadTree& energy, const float threshold, const int maxDepth)
+		{
+			struct BuildItem
+			{
+				int NodeIndex;
+				int EnergyNode;	// Matching node of the energy tree, -1 below its resolution
+				float Energy;
+				int Depth;
+			};
+
+			mNodes.Clear();
+			mNodes.Add(Node());
+
+			const float total = energy.Total();
+			if (total <= 0.0f)
+				return;
+
+			// Breadth first, the queue is only appended to while it is traversed
+			Array<BuildItem> queue;
+			BuildItem rootItem = { 0, 0, total, 1 };
+			queue.Add(rootItem);
+			for (auto i = 0; i < int(queue.Size()); i++)
+			{
+				const BuildItem item = queue[i];
+				for (auto quadrant = 0; quadrant < 4; quadrant++)
+				{
+					// Quadrants finer than the energy tree inherit an even share of its leaf
+					float childEnergy = 0.25f * item.Energy;
+					int energyChild = -1;
+					if (item.EnergyNode >= 0)
+					{
+						const Node& energyNode = energy.mNodes[item.EnergyNode];
+						childEnergy = energyNode.Sum[quadrant];
+						energyChild = energyNode.Children[quadrant] != 0 ? energyNode.Children[quadrant] : -1;
+					}
+
+					if (item.Depth < maxDepth && childEnergy > threshold * total)
+					{
+						const int child = mNodes.Size();
+						mNodes.Add(Node());
+						mNodes[item.NodeIndex].Children[quadrant] = child;
+
+						BuildItem childItem = { child, energyChild, childEnergy, item.Depth + 1 };
+						queue.Add(childItem);
+					}
+				}
+			}
+		}
+
+		int GuidingQuadTree::Quadrant(Vector2* pPoint)
+		{
+			const int x = pPoint->x < 0.5f ? 0 : 1;
+			const int y = pPoint->y < 0.5f ? 0 : 1;
+			pPoint->x = Math::Min(2.0f * pPoint->x - x, 0.99999994f);
+			pPoint->y = Math::Min(2.0f * pPoint->y - y, 0.99999994f);
+
+			return x + 2 * y;
+		}
+
+		Vector2 GuidingQuadTree::DirectionToSquare(const Vector3& dir)
+		{
+			const float cosTheta = Math::Clamp(dir.z, -1.0f, 1.0f);
+			float phi = Math::Atan2(dir.y, dir.x);
+			phi = phi < 0.0f ? phi + float(Math::EDX_TWO_PI) : phi;
+
+			return Vector2(Math::Clamp(0.5f * (cosTheta + 1.0f), 0.0f, 0.99999994f),
+				Math::Clamp(phi / float(Math::EDX_TWO_PI), 0.0f, 0.99999994f));
+		}
+
+		Vector3 GuidingQuadTree::SquareToDirection(const Vector2& p)
+		{
+			const float cosTheta = 2.0f * p.x - 1.0f;
+			const float sinTheta = Math::Sqrt(Math::Max(0.0f, 1.0f - cosTheta * cosTheta));
+			const float phi = float(Math::EDX_TWO_PI) * p.y;
+
+			return Vector3(sinTheta * Math::Cos(phi), sinTheta * Math::Sin(phi), cosTheta);
+		}
+
+		void GuidingSDTree::Init(const BoundingBox& bounds)
+		{
+			// Cubic bounds keep the regions at the same depth equally shaped
+			const Vector3 center = (bounds.mMin + bounds.mMax) * 0.5f;
+			const Vector3 diagonal = bounds.mMax - bounds.mMin;
+			const float halfExtent = 0.5f * Math::Max(diagonal.x, Math::Max(diagonal.y, diagonal.z)) + 1e-4f;
+			mBounds.mMin = center - Vector3(halfExtent, halfExtent, halfExtent);
+			mBounds.mMax = center + Vector3(halfExtent, halfExtent, halfExtent);
+
+			mNodes.Clear();
+			mLeaves.Clear();
+
+			Node root;
+			root.Axis = 0;
+			root.Children[0] = root.Children[1] = 0;
+			root.Leaf = 0;
+			mNodes.Add(root);
+			mLeaves.Add(MakeUnique<GuidingDistribution>());
+		}
+
+		GuidingDistribution* GuidingSDTree::Lookup(const Vector3& pos) const
+		{
+			float p[3];
+			for (auto i = 0; i < 3; i++)
+				p[i] = Math::Clamp((pos[i] - mBounds.mMin[i]) / (mBounds.mMax[i] - mBounds.mMin[i]), 0.0f, 1.0f);
+
+			int node = 0;
+			while (mNodes[node].Leaf < 0)
+			{
+				const int axis = mNodes[node].Axis;
+				if (p[axis] < 0.5f)
+				{
+					p[axis] = 2.0f * p[axis];
+					node = mNodes[node].Children[0];
+				}
+				else
+				{
+					p[axis] = 2.0f * p[axis] - 1.0f;
+					node = mNodes[node].Children[1];
+				}
+			}
+
+			return mLeaves[mNodes[node].Leaf].Get();
+		}
+
+		void GuidingSDTree::Refine(const int spatialThreshold, const float directionalThreshold, const int maxDepth)
+		{
+			// Nodes appended by a split are visited by the same loop, so a region keeps splitting while each half is
+			// still expected to receive enough samples
+			for (auto i = 0; i < int(mNodes.Size()); i++)
+			{
+				if (mNodes[i].Leaf < 0)
+					continue;
+
+				GuidingDistribution* pDistribution = mLeaves[mNodes[i].Leaf].Get();
+				if (pDistribution->NumSamples <= spatialThreshold)
+					continue;
+
+				// Both halves start from the distribution learned for the whole region
+				pDistribution->NumSamples /= 2;
+				mLeaves.Add(MakeUnique<GuidingDistribution>());
+				GuidingDistribution* pSibling = mLeaves.Top().Get();
+				pSibling->Sampling = pDistribution->Sampling;
+				pSibling->Building = pDistribution->Building;
+				pSibling->NumSamples = pDistribution->NumSamples;
+
+				Node children[2];
+				for (auto c = 0; c < 2; c++)
+				{
+					children[c].Axis = (mNodes[i].Axis + 1) % 3;
+					children[c].Children[0] = children[c].Children[1] = 0;
+				}
+				children[0].Leaf = mNodes[i].Leaf;
+				children[1].Leaf = mLeaves.Size() - 1;
+
+				const int firstChild = mNodes.Size();
+				mNodes.Add(children[0]);
+				mNodes.Add(children[1]);
+
+				mNodes[i].Children[0] = firstChild;
+				mNodes[i].Children[1] = firstChild + 1;
+				mNodes[i].Leaf = -1;
+			}
+
+			// The radiance learned during the iteration becomes the sampling distribution, and the building tree is
+			// subdivided where that radiance is concentrated
+			parallel_for(0, int(mLeaves.Size()), [&](int i)
+			{
+				GuidingDistribution* pDistribution = mLeaves[i].Get();
+				pDistribution->Sampling = pDistribution->Building;
+				pDistribution->Building.Rebuild(pDistribution->Sampling, directionalThreshold, maxDepth);
+				pDistribution->NumSamples = 0;
+			});
+		}
+
+		void PathGuidingIntegrator::Render(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const
+		{
+			GuidingSDTree sdTree;
+			sdTree.Init(pScene->WorldBounds());
+
+			// The learned distributions are not part of the film state, so a restored film starts over
+			if (pFilm->GetSampleCount() > 0)
+				pFilm->Clear();
+
+			const int totalPasses = int(mJobDesc.SamplesPerPixel);
+			const int trainingPasses = int(mTrainingFraction * totalPasses);
+
+			int pass = 0;
+			int iterationPasses = 1;
+			bool training = true;
+			while (training)
+			{
+				// Iterations double in length while they fit in the training budget, then the full sample budget is
+				// rendered with the final distribution so the film ends at SamplesPerPixel
+				training = pass + iterationPasses <= trainingPasses;
+				const int numPasses = training ? iterationPasses : totalPasses;
+
+				for (auto i = 0; i < numPasses; i++, pass++)
+				{
+					RenderPass(pScene, pCamera, pSampler, pFilm, pass, sdTree, training);
+					if (mTaskSync.Aborted())
+						return;
+
+					pSampler->AdvanceSampleIndex();
+
+					pFilm->IncreSampleCount();
+					pFilm->ScaleToPixel();
+				}
+
+				if (training)
+				{
+					sdTree.Refine(int(mSpatialThreshold * Math::Sqrt(float(iterationPasses))), mDirectionalThreshold, mMaxDirectionalDepth);
+					iterationPasses *= 2;
+
+					// Earlier iterations sampled from worse distributions, only the image of the last one is kept
+					pFilm->Clear();
+				}
+			}
+		}
+
+		void PathGuidingIntegrator::RenderPass(const Scene* pScene,
+			const Camera* pCamera,
+			Sampler* pSampler,
+			Film* pFilm,
+			const int pass,
+			const GuidingSDTree& sdTree,
+			const bool training) const
+		{
+			const int numTiles = mTaskSync.GetNumTiles();
+
+			parallel_for(0, numTiles, [&](int i)
+			{
+				const RenderTile& tile = mTaskSync.GetTile(i);
+
+				UniquePtr<Sampler> pTileSampler(pSampler->Clone((mJobDesc.PassOffset + pass) * numTiles + i));
+				RandomGen random;
+				MemoryPool memory;
+
+				for (auto y = tile.minY; y < tile.maxY; y++)
+				{
+					for (auto x = tile.minX; x < tile.maxX; x++)
+					{
+						if (mTaskSync.Aborted())
+							return;
+
+						pTileSampler->StartPixel(x, y);
+						CameraSample camSample;
+						pTileSampler->GenerateSamples(x, y, &camSample, random);
+						camSample.imageX += x;
+						camSample.imageY += y;
+
+						RayDifferential ray;
+						Color L = Color::BLACK;
+						if (pCamera->GenRayDifferential(camSample, &ray))
+						{
+							L = Li(ray, pScene, pTileSampler.Get(), random, memory, sdTree, training);
+						}
+
+						pFilm->AddSample(camSample.imageX, camSample.imageY, L);
+						memory.FreeAll();
+					}
+				}
+			});
+		}
+
+		Color PathGuidingIntegrator::Li(const RayDifferential& ray,
+			const Scene* pScene,
+			Sampler* pSampler,
+			RandomGen& random,
+			MemoryPool& memory,
+			const GuidingSDTree& sdTree,
+			const bool training) const
+		{
+			Color L = Color::BLACK;
+			Color pathThroughput = Color::WHITE;
+
+			GuidingVertex vertices[MAX_GUIDING_VERTICES];
+			int numVertices = 0;
+
+			// Radiance reaching the camera is also incident at every recorded vertex, along the direction sampled there
+			auto AddRadiance = [&](const Color& contrib)
+			{
+				L += contrib;
+				for (auto i = 0; i < numVertices; i++)
+				{
+					for (auto c = 0; c < 3; c++)
+					{
+						if (vertices[i].Throughput[c] > 0.0f)
+							vertices[i].Radiance[c] += contrib[c] / vertices[i].Throughput[c];
+					}
+				}
+			};
+
+			bool specBounce = true;
+			RayDifferential pathRay = ray;
+			for (auto bounce = 0; ; bounce++)
+			{
+				DifferentialGeom diffGeom;
+				bool intersected = pScene->Intersect(pathRay, &diffGeom);
+
+				MediumScatter mediumScatter;
+				if (pathRay.mpMedium)
+					pathThroughput *= pathRay.mpMedium->Sample(pathRay, pSampler, &mediumScatter);
+
+				if (pathThroughput.IsBlack())
+					break;
+
+				// Sampled surface
+				if (!mediumScatter.IsValid())
+				{
+					pScene->PostIntersect(pathRay, &diffGeom);
+
+					if (specBounce)
+					{
+						if (intersected)
+						{
+							AddRadiance(pathThroughput * diffGeom.Emit(-pathRay.mDir));
+						}
+						else
+						{
+							if (pScene->GetEnvironmentLight())
+								AddRadiance(pathThroughput * pScene->GetEnvironmentLight()->Emit(-pathRay.mDir));
+						}
+					}
+
+					if (!intersected || bounce >= mMaxDepth)
+						break;
+
+					// All dimensions of this bounce are fetched at once
+					BounceSample bounceSample;
+					GetSampleVector(pSampler, &bounceSample);
+
+					// Explicitly sample light sources
+					const BSDF* pBSDF = diffGeom.mpBSDF;
+					if (!pBSDF->IsSpecular())
+					{
+						auto lightIdx = Math::Min(bounceSample.Direct.LightIndex * pScene->GetLights().Size(), pScene->GetLights().Size() - 1);
+						AddRadiance(pathThroughput *
+							Integrator::EstimateDirectLighting(diffGeom, -pathRay.mDir, pScene->GetLights()[lightIdx].Get(), pScene, bounceSample.Direct, pSampler) * pScene->GetLights().Size());
+					}
+
+					const Vector3& pos = diffGeom.mPosition;
+					const Vector3& normal = diffGeom.mNormal;
+					Vector3 vOut = -pathRay.mDir;
+					Vector3 vIn;
+					float pdf;
+					ScatterType bsdfFlags;
+					Color f;
+
+					// Specular lobes have no density to mix with, such BSDFs are only sampled by themselves
+					GuidingDistribution* pDistribution = nullptr;
+					if (!(pBSDF->GetScatterType() & BSDF_SPECULAR))
+						pDistribution = sdTree.Lookup(pos);
+
+					const float bsdfFraction = pDistribution && pDistribution->Sampling.Total() > 0.0f ? mBSDFSamplingFraction : 1.0f;
+					if (bsdfFraction == 1.0f)
+					{
+						f = pBSDF->SampleScattered(vOut, bounceSample.Scatter, diffGeom, &vIn, &pdf, BSDF_ALL, &bsdfFlags);
+					}
+					else // One sample MIS between the BSDF and the learned distribution
+					{
+						float bsdfPdf, guidedPdf;
+						if (random.Float() < bsdfFraction)
+						{
+							f = pBSDF->SampleScattered(vOut, bounceSample.Scatter, diffGeom, &vIn, &bsdfPdf, BSDF_ALL, &bsdfFlags);
+							guidedPdf = pDistribution->Sampling.Pdf(vIn);
+						}
+						else
+						{
+							vIn = pDistribution->Sampling.Sample(Vector2(bounceSample.Scatter.u, bounceSample.Scatter.v), &guidedPdf);
+							f = pBSDF->Eval(vOut, vIn, diffGeom);
+							bsdfPdf = pBSDF->Pdf(vOut, vIn, diffGeom);
+							bsdfFlags = Math::Dot(vOut, diffGeom.mGeomNormal) * Math::Dot(vIn, diffGeom.mGeomNormal) > 0.0f ?
+								BSDF_REFLECTION : BSDF_TRANSMISSION;
+						}
+
+						pdf = bsdfFraction * bsdfPdf + (1.0f - bsdfFraction) * guidedPdf;
+					}
+
+					if (f.IsBlack() || pdf == 0.0f)
+						break;
+					pathThroughput *= f * Math::AbsDot(vIn, normal) / pdf;
+
+					bool sampleSubsurface = diffGeom.mpBSSRDF && Math::Dot(vOut, normal) > 0.0f && (bsdfFlags & BSDF_TRANSMISSION);
+					if (!sampleSubsurface)
+					{
+						// Radiance arriving along vIn trains the region of this vertex
+						if (training && pDistribution && numVertices < MAX_GUIDING_VERTICES)
+						{
+							GuidingVertex& vertex = vertices[numVertices++];
+							vertex.pDistribution = pDistribution;
+							vertex.Direction = vIn;
+							vertex.Throughput = pathThroughput;
+							vertex.Radiance = Color::BLACK;
+							vertex.Pdf = pdf;
+						}
+
+						specBounce = (bsdfFlags & BSDF_SPECULAR) != 0;
+						pathRay = Ray(pos, vIn, diffGeom.mMediumInterface.GetMedium(vIn, normal));
+					}
+					else // Account for attenuated subsurface scattering, if applicable
+					{
+						// Importance sample the BSSRDF, then the exit vertex as one more bounce
+						Sample bssrdfSample = pSampler->GetSample();
+						BounceSample exitSample;
+						GetSampleVector(pSampler, &exitSample);
+
+						DifferentialGeom subsurfDiffGeom;
+						float subsurfPdf;
+						Color S = diffGeom.mpBSSRDF->SampleSubsurfaceScattered(
+							vOut, bssrdfSample, diffGeom, pScene, &subsurfDiffGeom, &subsurfPdf, memory);
+
+						if (S.IsBlack() || subsurfPdf == 0)
+							break;
+
+						pathThroughput *= S / subsurfPdf;
+
+						// Account for the attenuated direct subsurface scattering
+						// component
+						auto lightIdx = Math::Min(exitSample.Direct.LightIndex * pScene->GetLights().Size(), pScene->GetLights().Size() - 1);
+						AddRadiance(pathThroughput *
+							Integrator::EstimateDirectLighting(subsurfDiffGeom, subsurfDiffGeom.mNormal, pScene->GetLights()[lightIdx].Get(), pScene, exitSample.Direct, pSampler));
+
+						// Account for the indirect subsurface scattering component
+						pBSDF = subsurfDiffGeom.mpBSDF;
+						f = pBSDF->SampleScattered(subsurfDiffGeom.mNormal, exitSample.Scatter, subsurfDiffGeom, &vIn, &pdf, BSDF_ALL, &bsdfFlags);
+						if (f.IsBlack() || pdf == 0.0f)
+							break;
+
+						specBounce = (bsdfFlags & BSDF_SPECULAR) != 0;
+						pathThroughput *= f * Math::AbsDot(vIn, subsurfDiffGeom.mNormal) / pdf;
+						pathRay = Ray(subsurfDiffGeom.mPosition, vIn, subsurfDiffGeom.mMediumInterface.GetMedium(vIn, subsurfDiffGeom.mNormal));
+					}
+				}
+				else // Sampled medium
+				{
+					BounceSample bounceSample;
+					GetSampleVector(pSampler, &bounceSample);
+
+					auto lightIdx = Math::Min(bounceSample.Direct.LightIndex * pScene->GetLights().Size(), pScene->GetLights().Size() - 1);
+					AddRadiance(pathThroughput *
+						Integrator::EstimateDirectLighting(mediumScatter, -pathRay.mDir, pScene->GetLights()[lightIdx].Get(), pScene, bounceSample.Direct, pSampler) * pScene->GetLights().Size());
+
+					if (bounce >= mMaxDepth)
+						break;
+
+					const PhaseFunctionHG* pPhaseFunc = mediumScatter.mpPhaseFunc;
+
+					Vector3 vOut = -pathRay.mDir;
+					Vector3 vIn;
+					pPhaseFunc->Sample(vOut, &vIn, Vector2(bounceSample.Scatter.u, bounceSample.Scatter.v));
+
+					specBounce = false;
+					pathRay = Ray(mediumScatter.mPosition, vIn, pathRay.mpMedium);
+				}
+
+				// Russian Roulette
+				if (bounce > 3)
+				{
+					float RR = Math::Min(1.0f, pathThroughput.Luminance());
+					if (random.Float() > RR)
+						break;
+
+					pathThroughput /= RR;
+				}
+			}
+
+			// Each vertex contributes one estimate of the incident radiance integrated over the quadrants containing its direction
+			for (auto i = 0; i < numVertices; i++)
+			{
+				const GuidingVertex& vertex = vertices[i];
+				const float radiance = vertex.Radiance.Luminance();
+				if (radiance > 0.0f && radiance < float(Math::EDX_INFINITY))
+					vertex.pDistribution->Building.Deposit(vertex.Direction, radiance / vertex.Pdf);
+
+				InterlockedIncrement(&vertex.pDistribution->NumSamples);
+			}
+
+			return L;
+		}
+	}
+}
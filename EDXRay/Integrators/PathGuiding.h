@@ -0,0 +1,154 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "../Core/Integrator.h"
+#include "../Core/Sampler.h"
+#include "Math/BoundingBox.h"
+#include "Graphics/Color.h"
+
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		// Directional distribution stored as a quadtree over the cylindrical coordinates (cos theta, phi) of world space
+		// directions. The mapping preserves area, so the pdf of a direction is the pdf of its point in the square over 4 pi
+		class GuidingQuadTree
+		{
+		private:
+			// Quadrant q covers x half (q & 1) and y half (q >> 1), a child index of 0 marks a leaf quadrant
+			struct Node
+			{
+				float Sum[4];
+				int Children[4];
+
+				Node()
+				{
+					for (auto i = 0; i < 4; i++)
+					{
+						Sum[i] = 0.0f;
+						Children[i] = 0;
+					}
+				}
+			};
+
+			Array<Node> mNodes;
+
+		public:
+			GuidingQuadTree()
+			{
+				mNodes.Resize(1);
+			}
+
+			float Total() const
+			{
+				const Node& root = mNodes[0];
+				return root.Sum[0] + root.Sum[1] + root.Sum[2] + root.Sum[3];
+			}
+
+			// Adds value to every node containing dir, safe to call concurrently
+			void Deposit(const Vector3& dir, const float value);
+			float Pdf(const Vector3& dir) const;
+			Vector3 Sample(const Vector2& sample, float* pPdf) const;
+
+			// Rebuilds the structure from the energy recorded in another tree, quadrants holding more than threshold of
+			// the total energy are subdivided. All sums are reset
+			void Rebuild(const GuidingQuadTree& energy, const float threshold, const int maxDepth);
+
+		private:
+			// Returns the quadrant containing p and maps p into it
+			static int Quadrant(Vector2* pPoint);
+			static Vector2 DirectionToSquare(const Vector3& dir);
+			static Vector3 SquareToDirection(const Vector2& p);
+		};
+
+		// Guiding state of one spatial region, the sampling tree is frozen during an iteration while the building tree
+		// gathers the incident radiance that is used for the next one
+		struct GuidingDistribution
+		{
+			GuidingQuadTree Sampling;
+			GuidingQuadTree Building;
+			volatile long NumSamples;
+
+			GuidingDistribution()
+				: NumSamples(0)
+			{
+			}
+		};
+
+		// Spatial binary tree over the scene bounds cycling through the axes, each leaf owns a directional distribution
+		class GuidingSDTree
+		{
+		private:
+			struct Node
+			{
+				int Axis;
+				int Children[2];
+				int Leaf;	// Index into mLeaves, -1 for inner nodes
+			};
+
+			BoundingBox mBounds;
+			Array<Node> mNodes;
+			Array<UniquePtr<GuidingDistribution>> mLeaves;
+
+		public:
+			void Init(const BoundingBox& bounds);
+
+			// The structure is fixed between calls to Refine, so lookups need no synchronization
+			GuidingDistribution* Lookup(const Vector3& pos) const;
+
+			// Splits regions that received more than spatialThreshold samples, then swaps in the distributions learned
+			// during the finished iteration. Must not run concurrently with rendering
+			void Refine(const int spatialThreshold, const float directionalThreshold, const int maxDepth);
+		};
+
+		// Practical path guiding. Training iterations with doubling sample counts learn the incident radiance in a
+		// spatio-directional tree, directions are then drawn from the BSDF or the learned distribution with one sample MIS
+		class PathGuidingIntegrator : public Integrator
+		{
+		private:
+			// Path vertex whose incident radiance along the sampled direction is recorded for training
+			struct GuidingVertex
+			{
+				GuidingDistribution* pDistribution;
+				Vector3 Direction;
+				Color Throughput;
+				Color Radiance;
+				float Pdf;
+			};
+
+			static const int MAX_GUIDING_VERTICES = 32;
+
+			uint mMaxDepth;
+			float mBSDFSamplingFraction;
+			float mTrainingFraction;	// Training passes rendered before the sample budget, relative to it
+			int mSpatialThreshold;		// Scaled by the square root of the samples per pixel of an iteration
+			float mDirectionalThreshold;
+			int mMaxDirectionalDepth;
+
+		public:
+			PathGuidingIntegrator(int depth, const RenderJobDesc& jobDesc, const TaskSynchronizer& taskSync)
+				: Integrator(jobDesc, taskSync)
+				, mMaxDepth(depth)
+				, mBSDFSamplingFraction(0.5f)
+				, mTrainingFraction(0.25f)
+				, mSpatialThreshold(12000)
+				, mDirectionalThreshold(0.01f)
+				, mMaxDirectionalDepth(20)
+			{
+			}
+			~PathGuidingIntegrator()
+			{
+			}
+
+		public:
+			void Render(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const override;
+
+		private:
+			void RenderPass(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm, const int pass,
+				const GuidingSDTree& sdTree, const bool training) const;
+			Color Li(const RayDifferential& ray, const Scene* pScene, Sampler* pSampler, RandomGen& random, MemoryPool& memory,
+				const GuidingSDTree& sdTree, const bool training) const;
+		};
+	}
+}
@@ -8,13 +8,55 @@
 #include "../Core/Sampler.h"
 #include "../Core/Sampling.h"
 #include "../Core/Ray.h"
+#include "../Core/TiledRender.h"
+#include "../Sampler/RandomSampler.h"
+#include "../Sampler/SobolSampler.h"
+#include "../Sampler/ZSobolSampler.h"
 #include "Graphics/Color.h"
 
 namespace EDX
 {
 	namespace RayTracer
 	{
+		void PathTracingIntegrator::Render(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const
+		{
+			mSubsurfaceMode = mJobDesc.SubsurfaceMode;
+			if (mSubsurfaceMode == ESubsurfaceMode::Hierarchical && !mSubsurfaceCache.IsCurrent(pScene))
+				mSubsurfaceCache.Build(pScene, mTaskSync);
+
+			if (mTaskSync.Aborted())
+				return;
+
+			TiledIntegrator::Render(pScene, pCamera, pSampler, pFilm);
+		}
+
 		Color PathTracingIntegrator::Li(const RayDifferential& ray, const Scene* pScene, Sampler* pSampler, RandomGen& random, MemoryPool& memory) const
+		{
+			return LiT(ray, pScene, pSampler, random, memory);
+		}
+
+		bool PathTracingIntegrator::RenderSpecialized(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const
+		{
+			// Sampler types match the ones created in Renderer::InitComponent
+			switch (mJobDesc.SamplerType)
+			{
+			case ESamplerType::Random:
+			case ESamplerType::Metropolis:
+				RenderTiles<PathTracingIntegrator, RandomSampler>(pScene, pCamera, pSampler, pFilm);
+				return true;
+			case ESamplerType::Sobol:
+				RenderTiles<PathTracingIntegrator, SobolSampler>(pScene, pCamera, pSampler, pFilm);
+				return true;
+			case ESamplerType::ZSobol:
+				RenderTiles<PathTracingIntegrator, ZSobolSampler>(pScene, pCamera, pSampler, pFilm);
+				return true;
+			}
+
+			return false;
+		}
+
+		template<typename SamplerImpl>
+		Color PathTracingIntegrator::LiT(const RayDifferential& ray, const Scene* pScene, SamplerImpl* pSampler, RandomGen& random, MemoryPool& memory) const
 		{
 			Color L = Color::BLACK;
 			Color pathThroughput = Color::WHITE;
@@ -27,8 +69,40 @@ namespace EDX
 				bool intersected = pScene->Intersect(pathRay, &diffGeom);
 
 				MediumScatter mediumScatter;
+				const Light* pSegmentLight = nullptr;
+				Vector3 segmentLightPoint;
+				bool equiangular = false;
 				if (pathRay.mpMedium)
+				{
+					// The light lit by single scattering along this segment is chosen up front, so that equiangular
+					// sampling toward a point on it and the medium's distance sampling are weighted against each other
+					DirectLightingSample segmentSample;
+					GetSampleVector(pSampler, &segmentSample);
+
+					auto lightIdx = Math::Min(segmentSample.LightIndex * pScene->GetLights().Size(), pScene->GetLights().Size() - 1);
+					pSegmentLight = pScene->GetLights()[lightIdx].Get();
+					if (pSegmentLight->IsFinite())
+					{
+						Ray lightRay;
+						Vector3 lightNormal;
+						float lightPdf;
+						pSegmentLight->Sample(segmentSample.Light, segmentSample.Scatter, &lightRay, &lightNormal, &lightPdf);
+						segmentLightPoint = lightRay.mOrg;
+						equiangular = true;
+					}
+
+					if (equiangular)
+					{
+						DirectLightingSample equiangularSample;
+						GetSampleVector(pSampler, &equiangularSample);
+						const float distanceSample = pSampler->Get1D();
+
+						L += pathThroughput *
+							Integrator::EstimateEquiangularScattering(pathRay, segmentLightPoint, pSegmentLight, pScene, distanceSample, equiangularSample, pSampler) * pScene->GetLights().Size();
+					}
+
 					pathThroughput *= pathRay.mpMedium->Sample(pathRay, pSampler, &mediumScatter);
+				}
 
 				if (pathThroughput.IsBlack())
 					break;
@@ -54,14 +128,17 @@ namespace EDX
 					if (!intersected || bounce >= mMaxDepth)
 						break;
 
+					// All dimensions of this bounce are fetched at once
+					BounceSample bounceSample;
+					GetSampleVector(pSampler, &bounceSample);
+
 					// Explicitly sample light sources
 					const BSDF* pBSDF = diffGeom.mpBSDF;
 					if (!pBSDF->IsSpecular())
 					{
-						float lightIdxSample = pSampler->Get1D();
-						auto lightIdx = Math::Min(lightIdxSample * pScene->GetLights().Size(), pScene->GetLights().Size() - 1);
+						auto lightIdx = Math::Min(bounceSample.Direct.LightIndex * pScene->GetLights().Size(), pScene->GetLights().Size() - 1);
 						L += pathThroughput *
-							Integrator::EstimateDirectLighting(diffGeom, -pathRay.mDir, pScene->GetLights()[lightIdx].Get(), pScene, pSampler) * pScene->GetLights().Size();
+							Integrator::EstimateDirectLighting(diffGeom, -pathRay.mDir, pScene->GetLights()[lightIdx].Get(), pScene, bounceSample.Direct, pSampler) * pScene->GetLights().Size();
 					}
 
 					const Vector3& pos = diffGeom.mPosition;
@@ -70,8 +147,7 @@ namespace EDX
 					Vector3 vIn;
 					float pdf;
 					ScatterType bsdfFlags;
-					Sample scatterSample = pSampler->GetSample();
-					Color f = pBSDF->SampleScattered(vOut, scatterSample, diffGeom, &vIn, &pdf, BSDF_ALL, &bsdfFlags);
+					Color f = pBSDF->SampleScattered(vOut, bounceSample.Scatter, diffGeom, &vIn, &pdf, BSDF_ALL, &bsdfFlags);
 					if (f.IsBlack() || pdf == 0.0f)
 						break;
 					pathThroughput *= f * Math::AbsDot(vIn, normal) / pdf;
@@ -82,10 +158,19 @@ namespace EDX
 						specBounce = (bsdfFlags & BSDF_SPECULAR) != 0;
 						pathRay = Ray(pos, vIn, diffGeom.mMediumInterface.GetMedium(vIn, normal));
 					}
+					else if (mSubsurfaceMode == ESubsurfaceMode::Hierarchical)
+					{
+						// The cached irradiance accounts for all light diffusing out of the surface, which ends the path
+						L += pathThroughput * mSubsurfaceCache.Eval(diffGeom);
+						break;
+					}
 					else // Account for attenuated subsurface scattering, if applicable
 					{
-						// Importance sample the BSSRDF
+						// Importance sample the BSSRDF, then the exit vertex as one more bounce
 						Sample bssrdfSample = pSampler->GetSample();
+						BounceSample exitSample;
+						GetSampleVector(pSampler, &exitSample);
+
 						DifferentialGeom subsurfDiffGeom;
 						float subsurfPdf;
 						Color S = diffGeom.mpBSSRDF->SampleSubsurfaceScattered(
@@ -98,14 +183,13 @@ namespace EDX
 
 						// Account for the attenuated direct subsurface scattering
 						// component
-						float lightIdxSample = pSampler->Get1D();
-						auto lightIdx = Math::Min(lightIdxSample * pScene->GetLights().Size(), pScene->GetLights().Size() - 1);
+						auto lightIdx = Math::Min(exitSample.Direct.LightIndex * pScene->GetLights().Size(), pScene->GetLights().Size() - 1);
 						L += pathThroughput *
-							Integrator::EstimateDirectLighting(subsurfDiffGeom, subsurfDiffGeom.mNormal, pScene->GetLights()[lightIdx].Get(), pScene, pSampler);
+							Integrator::EstimateDirectLighting(subsurfDiffGeom, subsurfDiffGeom.mNormal, pScene->GetLights()[lightIdx].Get(), pScene, exitSample.Direct, pSampler);
 
 						// Account for the indirect subsurface scattering component
 						pBSDF = subsurfDiffGeom.mpBSDF;
-						f = pBSDF->SampleScattered(subsurfDiffGeom.mNormal, pSampler->GetSample(), subsurfDiffGeom, &vIn, &pdf, BSDF_ALL, &bsdfFlags);
+						f = pBSDF->SampleScattered(subsurfDiffGeom.mNormal, exitSample.Scatter, subsurfDiffGeom, &vIn, &pdf, BSDF_ALL, &bsdfFlags);
 						if (f.IsBlack() || pdf == 0.0f)
 							break;
 
@@ -116,10 +200,13 @@ namespace EDX
 				}
 				else // Sampled medium
 				{
-					float lightIdxSample = pSampler->Get1D();
-					auto lightIdx = Math::Min(lightIdxSample * pScene->GetLights().Size(), pScene->GetLights().Size() - 1);
+					BounceSample bounceSample;
+					GetSampleVector(pSampler, &bounceSample);
+
+					const float misWeight = equiangular ?
+						Integrator::DistanceSamplingWeight(pathRay, segmentLightPoint, Math::Distance(pathRay.mOrg, mediumScatter.mPosition)) : 1.0f;
 					L += pathThroughput *
-						Integrator::EstimateDirectLighting(mediumScatter, -pathRay.mDir, pScene->GetLights()[lightIdx].Get(), pScene, pSampler) * pScene->GetLights().Size();
+						Integrator::EstimateDirectLighting(mediumScatter, -pathRay.mDir, pSegmentLight, pScene, bounceSample.Direct, pSampler) * pScene->GetLights().Size() * misWeight;
 
 					if (bounce >= mMaxDepth)
 						break;
@@ -128,7 +215,7 @@ namespace EDX
 
 					Vector3 vOut = -pathRay.mDir;
 					Vector3 vIn;
-					pPhaseFunc->Sample(vOut, &vIn, pSampler->Get2D());
+					pPhaseFunc->Sample(vOut, &vIn, Vector2(bounceSample.Scatter.u, bounceSample.Scatter.v));
 
 					specBounce = false;
 					pathRay = Ray(mediumScatter.mPosition, vIn, pathRay.mpMedium);
@@ -3,6 +3,8 @@
 #include "EDXPrerequisites.h"
 #include "../Core/Integrator.h"
 #include "../Core/Sampler.h"
+#include "../Core/Config.h"
+#include "SubsurfaceIrradiance.h"
 
 
 namespace EDX
@@ -13,11 +15,15 @@ namespace EDX
 		{
 		private:
 			uint mMaxDepth;
+			mutable SubsurfaceIrradianceCache mSubsurfaceCache;
+			// Snapshot of the job's mode taken when rendering starts, the job description can be edited while rendering
+			mutable ESubsurfaceMode mSubsurfaceMode;
 
 		public:
 			PathTracingIntegrator(int depth, const RenderJobDesc& jobDesc, const TaskSynchronizer& taskSync)
 				: TiledIntegrator(jobDesc, taskSync)
 				, mMaxDepth(depth)
+				, mSubsurfaceMode(ESubsurfaceMode::Stochastic)
 			{
 			}
 			~PathTracingIntegrator()
@@ -25,7 +31,14 @@ namespace EDX
 			}
 
 		public:
+			void Render(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const override;
 			Color Li(const RayDifferential& ray, const Scene* pScene, Sampler* pSampler, RandomGen& random, MemoryPool& memory) const;
+
+			template<typename SamplerImpl>
+			Color LiT(const RayDifferential& ray, const Scene* pScene, SamplerImpl* pSampler, RandomGen& random, MemoryPool& memory) const;
+
+		protected:
+			bool RenderSpecialized(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const override;
 		};
 	}
 }
\ No newline at end of file
@@ -14,8 +14,6 @@ namespace EDX
 {
 	namespace RayTracer
 	{
-		using RLRecordPtr = RLRecord*;
-
 		Color RLPathTracingIntegrator::Li(const RayDifferential& ray, const Scene* pScene, Sampler* pSampler, RandomGen& random, MemoryPool& memory) const
 		{
 			Color L = Color::BLACK;
@@ -40,14 +38,7 @@ namespace EDX
 				pScene->PostIntersect(pathRay, &diffGeom);
 
 				ShadingKey hashKey = SpatialHashing(diffGeom, pScene);
-				RLRecord** pQuery;
-				pQuery = mQTable.Find(hashKey);
-				RLRecord* pRecord = pQuery != nullptr ? *pQuery : nullptr;
-				if (!pRecord)
-				{
-					pRecord = new RLRecord();
-					mQTable.Insert(hashKey, pRecord);
-				}
+				RLRecord* pRecord = mQTable.FindOrInsert(hashKey);
 
 				if (specBounce)
 				{
@@ -80,13 +71,16 @@ namespace EDX
 				if (!intersected || bounce >= mMaxDepth)
 					break;
 
+				// All dimensions of this bounce are fetched at once
+				BounceSample bounceSample;
+				GetSampleVector(pSampler, &bounceSample);
+
 				// Explicitly sample light sources
 				const BSDF* pBSDF = diffGeom.mpBSDF;
 				if (!pBSDF->IsSpecular())
 				{
-					float lightIdxSample = pSampler->Get1D();
-					auto lightIdx = Math::Min(lightIdxSample * pScene->GetLights().Size(), pScene->GetLights().Size() - 1);
-					Color shadingContrib = Integrator::EstimateDirectLighting(diffGeom, -pathRay.mDir, pScene->GetLights()[lightIdx].Get(), pScene, pSampler) * pScene->GetLights().Size();
+					auto lightIdx = Math::Min(bounceSample.Direct.LightIndex * pScene->GetLights().Size(), pScene->GetLights().Size() - 1);
+					Color shadingContrib = Integrator::EstimateDirectLighting(diffGeom, -pathRay.mDir, pScene->GetLights()[lightIdx].Get(), pScene, bounceSample.Direct, pSampler) * pScene->GetLights().Size();
 					L += pathThroughput * shadingContrib;
 
 					if (pPrevRecord)
@@ -107,8 +101,7 @@ namespace EDX
 				Vector3 vIn;
 				float pdf;
 				ScatterType bsdfFlags;
-				Sample scatterSample = pSampler->GetSample();
-				vIn = pRecord->SampleScattered(scatterSample, diffGeom, &pdf, &prevCellIndex);
+				vIn = pRecord->SampleScattered(bounceSample.Scatter, diffGeom, &pdf, &prevCellIndex);
 
 				Color f = pBSDF->Eval(vOut, vIn, diffGeom);
 				if (f.IsBlack() || pdf == 0.0f)
@@ -164,7 +157,7 @@ namespace EDX
 		{
 			ShadingKey ret;
 
-			const BoundingBox sceneBounds = pScene->WorldBounds();
+			const BoundingBox& sceneBounds = pScene->WorldBounds();
 			//const float totalSceneArea = sceneBounds.Area() * 3.0f; // Simple heuristic
 
 			const int axis = sceneBounds.MaximumExtent();
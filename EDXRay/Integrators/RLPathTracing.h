@@ -5,6 +5,7 @@
 #include "../Core/Sampler.h"
 #include "../Core/Sampling.h"
 #include "../Core/SpatialHashMap.h"
+#include "../Core/AtomicFloat.h"
 
 namespace EDX
 {
@@ -12,18 +13,18 @@ namespace EDX
 	{
 		using ShadingKey = uint64;
 
+		// Directional Q-values of one spatial cell. The cells are the leaves of an implicit sum tree, so an update only
+		// touches the path to the root and sampling descends the tree, both without locks
 		struct RLRecord
 		{
 			static const int NUM_X = 16;
 			static const int NUM_Y = 8;
 			static const int NUM_XY = NUM_X * NUM_Y;
 
-			float mDirectionalDensity[NUM_XY];
-			float mMaxQ;
-			Sampling::Distribution1D mPdf;
+			// Node 1 is the root, the children of node i are 2i and 2i + 1, leaves start at NUM_XY
+			volatile float mSumTree[2 * NUM_XY];
+			volatile float mMaxQ;
 
-			mutable CriticalSection mLock;
-			
 			RLRecord()
 			{
 				// Initialize directinal density as consine weighted diffuse
@@ -32,21 +33,19 @@ namespace EDX
 					for (int x = 0; x < NUM_X; x++)
 					{
 						const float initDensity = y / float(NUM_Y);
-						mDirectionalDensity[x + y * NUM_X] = initDensity;
+						mSumTree[NUM_XY + x + y * NUM_X] = initDensity;
 					}
 				}
 
-				mPdf.SetFunction(mDirectionalDensity, NUM_XY);
+				for (int i = NUM_XY - 1; i > 0; i--)
+					mSumTree[i] = mSumTree[2 * i] + mSumTree[2 * i + 1];
+
 				mMaxQ = 0.0f;
 			}
 
 			void UpdateValueFunc(const float value)
 			{
-				mLock.Lock();
-				{
-					mMaxQ = Math::Max(mMaxQ, value);
-				}
-				mLock.Unlock();
+				AtomicMax(&mMaxQ, value);
 			}
 
 			const float GetValueFunc() const
@@ -58,24 +57,61 @@ namespace EDX
 			{
 				const float alpha = 0.85f;
 
-				mLock.Lock();
+				// The leaf is blended with a CAS loop, the ancestors then receive the exact change that was committed
+				volatile float* pLeaf = &mSumTree[NUM_XY + cellIdx];
+				float oldQ, newQ;
+				do
 				{
-					mDirectionalDensity[cellIdx] = (1.0f - alpha) * mDirectionalDensity[cellIdx] + alpha * QVal;
-					mMaxQ = Math::Max(mMaxQ, mDirectionalDensity[cellIdx]);
-					mPdf.SetFunction(mDirectionalDensity, NUM_XY);
-				}
-				mLock.Unlock();
+					oldQ = *pLeaf;
+					newQ = (1.0f - alpha) * oldQ + alpha * QVal;
+				} while (!CompareExchange(pLeaf, oldQ, newQ));
+
+				AtomicMax(&mMaxQ, newQ);
+
+				const float delta = newQ - oldQ;
+				if (delta == 0.0f)
+					return;
+
+				for (uint node = (NUM_XY + cellIdx) >> 1; node > 0; node >>= 1)
+					AtomicAdd(&mSumTree[node], delta);
 			}
 
 			Vector3 SampleScattered(const Sample& sample, const DifferentialGeom& diffGeom, float* pPdf, uint* cellIdx) const
 			{
 				Vector3 localWi;
 
-				float cellPdf;
+				// Each level reads both children and branches on their local ratio, the product of the ratios is the
+				// exact probability of the chosen leaf even while other threads keep updating the tree
+				float uCell = sample.u;
+				float cellPdf = 1.0f;
+				uint node = 1;
+				while (node < NUM_XY)
+				{
+					const float left = Math::Max(mSumTree[2 * node], 0.0f);
+					const float right = Math::Max(mSumTree[2 * node + 1], 0.0f);
+					const float sum = left + right;
+					if (sum <= 0.0f)
+					{
+						*pPdf = 0.0f;
+						*cellIdx = 0;
+						return Vector3::UNIT_Z;
+					}
 
-				mLock.Lock();
-				*cellIdx = mPdf.SampleDiscrete(sample.u, &cellPdf);
-				mLock.Unlock();
+					const float probLeft = left / sum;
+					if (uCell < probLeft)
+					{
+						uCell = uCell / probLeft;
+						cellPdf *= probLeft;
+						node = 2 * node;
+					}
+					else
+					{
+						uCell = Math::Min((uCell - probLeft) / (1.0f - probLeft), 0.99999994f);
+						cellPdf *= 1.0f - probLeft;
+						node = 2 * node + 1;
+					}
+				}
+				*cellIdx = node - NUM_XY;
 
 				const int thetaIdx = *cellIdx / NUM_X;
 				const int phiIdx = *cellIdx % NUM_X;
@@ -99,7 +135,7 @@ namespace EDX
 		{
 		private:
 			uint mMaxDepth;
-			mutable SpatialHashMap<ShadingKey, RLRecord*> mQTable;
+			mutable SpatialHashMap<ShadingKey, RLRecord> mQTable;
 
 		public:
 			RLPathTracingIntegrator(int depth, const int qTableSize, const RenderJobDesc& jobDesc, const TaskSynchronizer& taskSync)
@@ -0,0 +1,375 @@
+#include "StochasticPPM.h"
+#include "BidirectionalPathTracing.h"
+#include "../Core/Camera.h"
+#include "../Core/Film.h"
+#include "../Core/Scene.h"
+#include "../Core/Light.h"
+#include "../Core/BSDF.h"
+#include "../Core/Sampling.h"
+#include "../Core/Ray.h"
+#include "../Core/TaskSynchronizer.h"
+#include "../Core/AtomicFloat.h"
+#include "../Core/Config.h"
+#include "../Sampler/RandomSampler.h"
+#include "Graphics/Color.h"
+
+#include <ppl.h>
+using namespace concurrency;
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		void StochasticPPMIntegrator::Render(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const
+		{
+			const int numPixels = pFilm->GetPixelCount();
+			const int numPhotons = mPhotonsPerPass > 0 ? mPhotonsPerPass : numPixels;
+
+			Vector3 center;
+			float sceneRadius;
+			pScene->BoundingSphere(&center, &sceneRadius);
+
+			Array<SPPMPixel> pixels;
+			pixels.Resize(numPixels);
+			for (auto& pixel : pixels)
+			{
+				pixel.Radius = mInitialRadius * sceneRadius;
+				pixel.N = 0.0f;
+				pixel.Tau = Color::BLACK;
+				pixel.Indirect = Color::BLACK;
+				pixel.VP.pBSDF = nullptr;
+				pixel.Phi[0] = pixel.Phi[1] = pixel.Phi[2] = 0.0f;
+				pixel.M = 0;
+			}
+
+			// The per pixel photon statistics are not part of the film state, so a restored film starts over
+			if (pFilm->GetSampleCount() > 0)
+				pFilm->Clear();
+
+			PhotonGrid grid;
+			for (auto pass = 0; pass < int(mJobDesc.SamplesPerPixel); pass++)
+			{
+				TraceVisiblePoints(pScene, pCamera, pSampler, pFilm, pass, pixels);
+				if (mTaskSync.Aborted())
+					break;
+
+				BuildGrid(pixels, &grid);
+				TracePhotons(pScene, pass, numPhotons, grid, pixels);
+				if (mTaskSync.Aborted())
+					break;
+
+				UpdatePixels(pFilm, (pass + 1) * numPhotons, pixels);
+
+				pSampler->AdvanceSampleIndex();
+
+				// The photon estimate is splatted as the change since the previous pass, hence the unit splat scale
+				pFilm->IncreSampleCount();
+				pFilm->ScaleToPixel(1.0f);
+			}
+		}
+
+		void StochasticPPMIntegrator::TraceVisiblePoints(const Scene* pScene,
+			const Camera* pCamera,
+			Sampler* pSampler,
+			Film* pFilm,
+			const int pass,
+			Array<SPPMPixel>& pixels) const
+		{
+			const int width = pFilm->GetWidth();
+			const int numTiles = mTaskSync.GetNumTiles();
+			const auto& lights = pScene->GetLights();
+
+			parallel_for(0, numTiles, [&](int i)
+			{
+				const RenderTile& tile = mTaskSync.GetTile(i);
+
+				UniquePtr<Sampler> pTileSampler(pSampler->Clone((mJobDesc.PassOffset + pass) * numTiles + i));
+				RandomGen random;
+
+				for (auto y = tile.minY; y < tile.maxY; y++)
+				{
+					for (auto x = tile.minX; x < tile.maxX; x++)
+					{
+						if (mTaskSync.Aborted())
+							return;
+
+						SPPMPixel& pixel = pixels[y * width + x];
+						pixel.VP.pBSDF = nullptr;
+
+						pTileSampler->StartPixel(x, y);
+						CameraSample camSample;
+						pTileSampler->GenerateSamples(x, y, &camSample, random);
+						camSample.imageX += x;
+						camSample.imageY += y;
+
+						// Emitted and direct light seen through specular chains is accumulated in the film like a path tracer,
+						// the path ends at the first non specular vertex which becomes the visible point
+						Color L = Color::BLACK;
+						RayDifferential ray;
+						if (pCamera->GenRayDifferential(camSample, &ray))
+						{
+							Color throughput = Color::WHITE;
+							Ray pathRay = ray;
+							for (auto depth = 0; depth < int(mMaxDepth); depth++)
+							{
+								DifferentialGeom diffGeom;
+								if (!pScene->Intersect(pathRay, &diffGeom))
+								{
+									if (pScene->GetEnvironmentLight())
+										L += throughput * pScene->GetEnvironmentLight()->Emit(-pathRay.mDir);
+
+									break;
+								}
+
+								pScene->PostIntersect(pathRay, &diffGeom);
+								L += throughput * diffGeom.Emit(-pathRay.mDir);
+
+								const BSDF* pBSDF = diffGeom.mpBSDF;
+								const Vector3 vOut = -pathRay.mDir;
+								if (!pBSDF->IsSpecular())
+								{
+									DirectLightingSample directSample;
+									GetSampleVector(pTileSampler.Get(), &directSample);
+
+									auto lightIdx = Math::Min(directSample.LightIndex * lights.Size(), lights.Size() - 1);
+									L += throughput *
+										Integrator::EstimateDirectLighting(diffGeom, vOut, lights[lightIdx].Get(), pScene, directSample, pTileSampler.Get()) * lights.Size();
+
+									VisiblePoint& vp = pixel.VP;
+									vp.Position = diffGeom.mPosition;
+									vp.OutDir = vOut;
+									vp.GeomNormal = diffGeom.mGeomNormal;
+									vp.ShadingFrame = diffGeom.mShadingFrame;
+									vp.Texcoord = diffGeom.mTexcoord;
+									vp.pBSDF = pBSDF;
+									vp.Throughput = throughput;
+
+									break;
+								}
+
+								Vector3 vIn;
+								float pdf;
+								Color f = pBSDF->SampleScattered(vOut, pTileSampler->GetSample(), diffGeom, &vIn, &pdf);
+								if (f.IsBlack() || pdf == 0.0f)
+									break;
+
+								throughput *= f * Math::AbsDot(vIn, diffGeom.mNormal) / pdf;
+								pathRay = Ray(diffGeom.mPosition, vIn, diffGeom.mMediumInterface.GetMedium(vIn, diffGeom.mNormal));
+							}
+						}
+
+						pFilm->AddSample(camSample.imageX, camSample.imageY, L);
+					}
+				}
+			});
+		}
+
+		void StochasticPPMIntegrator::BuildGrid(const Array<SPPMPixel>& pixels, PhotonGrid* pGrid) const
+		{
+			const int numPixels = pixels.Size();
+
+			// Cells are as large as the largest diameter, so every visible point covers at most 2 x 2 x 2 cells
+			pGrid->Bounds = BoundingBox();
+			float maxRadius = 0.0f;
+			for (auto i = 0; i < numPixels; i++)
+			{
+				const SPPMPixel& pixel = pixels[i];
+				if (!pixel.VP.pBSDF || pixel.VP.Throughput.IsBlack())
+					continue;
+
+				pGrid->Bounds = Math::Union(pGrid->Bounds, pixel.VP.Position);
+				maxRadius = Math::Max(maxRadius, pixel.Radius);
+			}
+			const Vector3 margin = Vector3(maxRadius, maxRadius, maxRadius);
+			pGrid->Bounds.mMin = pGrid->Bounds.mMin - margin;
+			pGrid->Bounds.mMax = pGrid->Bounds.mMax + margin;
+			pGrid->CellSize = Math::Max(2.0f * maxRadius, 1e-6f);
+
+			const uint hashSize = Math::RoundUpPowOfTwo(numPixels);
+			pGrid->Heads.Resize(hashSize);
+			pGrid->NodePixels.Resize(8 * numPixels);
+			pGrid->NodeNext.Resize(8 * numPixels);
+			pGrid->NumNodes = 0;
+
+			parallel_for(0, int(hashSize), [&](int i)
+			{
+				pGrid->Heads[i] = -1;
+			});
+
+			// Lock free insertion, each node is prepended to its cell chain with an atomic exchange
+			parallel_for(0, numPixels, [&](int i)
+			{
+				const SPPMPixel& pixel = pixels[i];
+				if (!pixel.VP.pBSDF || pixel.VP.Throughput.IsBlack())
+					return;
+
+				const Vector3 extent = Vector3(pixel.Radius, pixel.Radius, pixel.Radius);
+				int cellMin[3], cellMax[3];
+				GridCell(*pGrid, pixel.VP.Position - extent, cellMin);
+				GridCell(*pGrid, pixel.VP.Position + extent, cellMax);
+
+				// Rounding can push the far corner into a third cell when the radius equals the largest one,
+				// clamp so the node arrays sized for 2 x 2 x 2 cells per pixel are never overrun
+				for (auto k = 0; k < 3; k++)
+					cellMax[k] = Math::Min(cellMax[k], cellMin[k] + 1);
+
+				for (auto z = cellMin[2]; z <= cellMax[2]; z++)
+				{
+					for (auto y = cellMin[1]; y <= cellMax[1]; y++)
+					{
+						for (auto x = cellMin[0]; x <= cellMax[0]; x++)
+						{
+							const int cell[3] = { x, y, z };
+							const uint hash = HashCell(cell, hashSize);
+
+							const long node = InterlockedIncrement(&pGrid->NumNodes) - 1;
+							pGrid->NodePixels[node] = i;
+							pGrid->NodeNext[node] = InterlockedExchange(&pGrid->Heads[hash], node);
+						}
+					}
+				}
+			});
+		}
+
+		void StochasticPPMIntegrator::TracePhotons(const Scene* pScene,
+			const int pass,
+			const int numPhotons,
+			const PhotonGrid& grid,
+			Array<SPPMPixel>& pixels) const
+		{
+			static const int PHOTON_BATCH_SIZE = 4096;
+
+			const uint hashSize = grid.Heads.Size();
+			const int numBatches = (numPhotons + PHOTON_BATCH_SIZE - 1) / PHOTON_BATCH_SIZE;
+
+			parallel_for(0, numBatches, [&](int batch)
+			{
+				RandomSampler sampler((mJobDesc.PassOffset + pass) * numBatches + batch);
+				RandomGen random;
+
+				const int batchEnd = Math::Min(numPhotons, (batch + 1) * PHOTON_BATCH_SIZE);
+				for (auto photon = batch * PHOTON_BATCH_SIZE; photon < batchEnd; photon++)
+				{
+					if (mTaskSync.Aborted())
+						return;
+
+					BidirPathTracingIntegrator::PathState lightState = BidirPathTracingIntegrator::SampleLightSource(pScene, &sampler, random);
+					if (lightState.Throughput.IsBlack())
+						continue;
+
+					Color beta = lightState.Throughput;
+					Ray photonRay = Ray(lightState.Origin, lightState.Direction);
+					for (auto depth = 0; depth < int(mMaxDepth); depth++)
+					{
+						DifferentialGeom diffGeom;
+						if (!pScene->Intersect(photonRay, &diffGeom))
+							break;
+
+						pScene->PostIntersect(photonRay, &diffGeom);
+
+						const BSDF* pBSDF = diffGeom.mpBSDF;
+						const Vector3 vIn = -photonRay.mDir;
+
+						// Direct lighting is estimated at the visible points, photons only contribute from their second vertex
+						int cell[3];
+						if (depth > 0 && !pBSDF->IsSpecular() && GridCell(grid, diffGeom.mPosition, cell))
+						{
+							const uint hash = HashCell(cell, hashSize);
+							for (int node = grid.Heads[hash]; node != -1; node = grid.NodeNext[node])
+							{
+								SPPMPixel& pixel = pixels[grid.NodePixels[node]];
+								const float radius = pixel.Radius;
+								if (Math::LengthSquared(pixel.VP.Position - diffGeom.mPosition) > radius * radius)
+									continue;
+
+								DifferentialGeom vpGeom;
+								vpGeom.mPosition = pixel.VP.Position;
+								vpGeom.mNormal = pixel.VP.ShadingFrame.Normal();
+								vpGeom.mGeomNormal = pixel.VP.GeomNormal;
+								vpGeom.mShadingFrame = pixel.VP.ShadingFrame;
+								vpGeom.mTexcoord = pixel.VP.Texcoord;
+								vpGeom.mpBSDF = pixel.VP.pBSDF;
+								vpGeom.mpBSSRDF = nullptr;
+								vpGeom.mpAreaLight = nullptr;
+
+								const Color phi = beta * pixel.VP.pBSDF->Eval(pixel.VP.OutDir, vIn, vpGeom);
+								if (phi.IsBlack())
+									continue;
+
+								for (auto c = 0; c < 3; c++)
+									AtomicAdd(&pixel.Phi[c], phi[c]);
+								InterlockedIncrement(&pixel.M);
+							}
+						}
+
+						Vector3 vOut;
+						float pdf;
+						Color f = pBSDF->SampleScattered(vIn, sampler.GetSample(), diffGeom, &vOut, &pdf);
+						if (f.IsBlack() || pdf == 0.0f)
+							break;
+
+						// Russian roulette on the throughput change keeps photon powers roughly constant
+						const Color betaNew = beta * f * Math::AbsDot(vOut, diffGeom.mNormal) / pdf;
+						const float continueProb = Math::Min(1.0f, betaNew.Luminance() / beta.Luminance());
+						if (random.Float() >= continueProb)
+							break;
+
+						beta = betaNew / continueProb;
+						photonRay = Ray(diffGeom.mPosition, vOut, diffGeom.mMediumInterface.GetMedium(vOut, diffGeom.mNormal));
+					}
+				}
+			});
+		}
+
+		void StochasticPPMIntegrator::UpdatePixels(Film* pFilm, const int numPhotonsTotal, Array<SPPMPixel>& pixels) const
+		{
+			const int width = pFilm->GetWidth();
+			const int height = pFilm->GetHeight();
+
+			parallel_for(0, height, [&](int y)
+			{
+				for (auto x = 0; x < width; x++)
+				{
+					SPPMPixel& pixel = pixels[y * width + x];
+
+					// Progressive radius reduction, a fraction alpha of the new photons is kept
+					const float M = float(pixel.M);
+					if (M > 0.0f)
+					{
+						const float newN = pixel.N + mAlpha * M;
+						const float newRadius = pixel.Radius * Math::Sqrt(newN / (pixel.N + M));
+						const Color phi = Color(pixel.Phi[0], pixel.Phi[1], pixel.Phi[2]);
+
+						pixel.Tau = (pixel.Tau + pixel.VP.Throughput * phi) * (newRadius * newRadius) / (pixel.Radius * pixel.Radius);
+						pixel.N = newN;
+						pixel.Radius = newRadius;
+					}
+
+					pixel.M = 0;
+					pixel.Phi[0] = pixel.Phi[1] = pixel.Phi[2] = 0.0f;
+
+					const Color indirect = pixel.Tau / (float(numPhotonsTotal) * float(Math::EDX_PI) * pixel.Radius * pixel.Radius);
+					pFilm->Splat(x + 0.5f, y + 0.5f, indirect - pixel.Indirect);
+					pixel.Indirect = indirect;
+				}
+			});
+		}
+
+		bool StochasticPPMIntegrator::GridCell(const PhotonGrid& grid, const Vector3& pos, int* pCell)
+		{
+			bool inBounds = true;
+			for (auto i = 0; i < 3; i++)
+			{
+				pCell[i] = Math::FloorToInt((pos[i] - grid.Bounds.mMin[i]) / grid.CellSize);
+				inBounds &= pos[i] >= grid.Bounds.mMin[i] && pos[i] <= grid.Bounds.mMax[i];
+			}
+
+			return inBounds;
+		}
+
+		uint StochasticPPMIntegrator::HashCell(const int* pCell, const uint hashSize)
+		{
+			return ((pCell[0] * 73856093) ^ (pCell[1] * 19349663) ^ (pCell[2] * 83492791)) & (hashSize - 1);
+		}
+	}
+}
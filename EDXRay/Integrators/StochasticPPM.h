@@ -0,0 +1,90 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "../Core/Integrator.h"
+#include "../Core/DifferentialGeom.h"
+#include "../Core/Sampler.h"
+#include "Math/BoundingBox.h"
+#include "Graphics/Color.h"
+
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		// Stochastic progressive photon mapping, each pass traces one camera path per pixel to its first non specular
+		// vertex, then shoots photons and gathers them at these visible points with radii shrinking over the passes
+		class StochasticPPMIntegrator : public Integrator
+		{
+		private:
+			// Surface state needed to evaluate the BSDF of a visible point for incoming photons
+			struct VisiblePoint
+			{
+				Vector3 Position;
+				Vector3 OutDir;
+				Vector3 GeomNormal;
+				Frame ShadingFrame;
+				Vector2 Texcoord;
+				const BSDF* pBSDF;
+				Color Throughput;
+			};
+
+			struct SPPMPixel
+			{
+				float Radius;
+				float N;			// Photon count after radius reduction
+				Color Tau;			// Accumulated flux, reduced along with the radius
+				Color Indirect;		// Photon estimate already splatted to the film
+				VisiblePoint VP;
+
+				// Photons gathered during the current pass, written concurrently
+				volatile float Phi[3];
+				volatile long M;
+			};
+
+			// Visible point hash grid, rebuilt every pass. Heads index the first node of a cell chain
+			struct PhotonGrid
+			{
+				BoundingBox Bounds;
+				float CellSize;
+				Array<long> Heads;
+				Array<int> NodePixels;
+				Array<int> NodeNext;
+				volatile long NumNodes;
+			};
+
+		private:
+			uint mMaxDepth;
+			int mPhotonsPerPass;
+			float mInitialRadius;	// Relative to the bounding radius of the scene
+			float mAlpha;
+
+		public:
+			StochasticPPMIntegrator(int depth, const RenderJobDesc& jobDesc, const TaskSynchronizer& taskSync, const int photonsPerPass = 0)
+				: Integrator(jobDesc, taskSync)
+				, mMaxDepth(depth)
+				, mPhotonsPerPass(photonsPerPass)
+				, mInitialRadius(0.005f)
+				, mAlpha(2.0f / 3.0f)
+			{
+			}
+			~StochasticPPMIntegrator()
+			{
+			}
+
+		public:
+			void Render(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm) const override;
+
+		private:
+			void TraceVisiblePoints(const Scene* pScene, const Camera* pCamera, Sampler* pSampler, Film* pFilm,
+				const int pass, Array<SPPMPixel>& pixels) const;
+			void BuildGrid(const Array<SPPMPixel>& pixels, PhotonGrid* pGrid) const;
+			void TracePhotons(const Scene* pScene, const int pass, const int numPhotons, const PhotonGrid& grid,
+				Array<SPPMPixel>& pixels) const;
+			void UpdatePixels(Film* pFilm, const int numPhotonsTotal, Array<SPPMPixel>& pixels) const;
+
+			static bool GridCell(const PhotonGrid& grid, const Vector3& pos, int* pCell);
+			static uint HashCell(const int* pCell, const uint hashSize);
+		};
+	}
+}
@@ -0,0 +1,351 @@
+#include "SubsurfaceIrradiance.h"
+#include "../Core/Scene.h"
+#include "../Core/Primitive.h"
+#include "../Core/TriangleMesh.h"
+#include "../Core/Light.h"
+#include "../Core/DifferentialGeom.h"
+#include "../Core/BSSRDF.h"
+#include "../Core/Integrator.h"
+#include "../Core/Sampling.h"
+#include "../Core/Ray.h"
+#include "../Core/TaskSynchronizer.h"
+#include "../Sampler/RandomSampler.h"
+
+#include <ppl.h>
+using namespace concurrency;
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		void IrradianceOctree::Build(const Array<IrradiancePoint>& points)
+		{
+			mNodes.Clear();
+			mPoints = points;
+			if (mPoints.Size() == 0)
+				return;
+
+			BoundingBox bounds;
+			for (const auto& point : mPoints)
+				bounds = Math::Union(bounds, point.Position);
+
+			BuildNode(0, mPoints.Size(), bounds, 0);
+		}
+
+		int IrradianceOctree::BuildNode(const int begin, const int end, const BoundingBox& bounds, const int depth)
+		{
+			const int nodeIdx = mNodes.Size();
+			mNodes.Add(Node());
+			mNodes[nodeIdx].Bounds = bounds;
+
+			Vector3 weightedCentroid = Vector3::ZERO;
+			Vector3 areaCentroid = Vector3::ZERO;
+			float totalWeight = 0.0f;
+
+			if (end - begin <= MAX_LEAF_POINTS || depth == MAX_DEPTH)
+			{
+				Node& node = mNodes[nodeIdx];
+				node.PointStart = begin;
+				node.PointCount = end - begin;
+
+				for (auto i = begin; i < end; i++)
+				{
+					const IrradiancePoint& point = mPoints[i];
+					const Color irradiance = point.Irradiance * point.Area;
+					const float weight = irradiance.Luminance();
+
+					node.Area += point.Area;
+					node.Irradiance += irradiance;
+					weightedCentroid += point.Position * weight;
+					areaCentroid += point.Position * point.Area;
+					totalWeight += weight;
+				}
+			}
+			else
+			{
+				// Counting sort of the range into the octants around the center of the bounds
+				const Vector3 center = bounds.Centroid();
+				auto Octant = [&](const Vector3& pos) -> int
+				{
+					return (pos.x > center.x ? 1 : 0) | (pos.y > center.y ? 2 : 0) | (pos.z > center.z ? 4 : 0);
+				};
+
+				int offsets[9] = { 0 };
+				for (auto i = begin; i < end; i++)
+					offsets[Octant(mPoints[i].Position) + 1]++;
+				for (auto o = 0; o < 8; o++)
+					offsets[o + 1] += offsets[o];
+
+				Array<IrradiancePoint> sorted;
+				sorted.Resize(end - begin);
+				int cursors[8];
+				for (auto o = 0; o < 8; o++)
+					cursors[o] = offsets[o];
+				for (auto i = begin; i < end; i++)
+					sorted[cursors[Octant(mPoints[i].Position)]++] = mPoints[i];
+				for (auto i = begin; i < end; i++)
+					mPoints[i] = sorted[i - begin];
+
+				for (auto o = 0; o < 8; o++)
+				{
+					if (offsets[o] == offsets[o + 1])
+						continue;
+
+					BoundingBox childBounds;
+					childBounds.mMin = Vector3(o & 1 ? center.x : bounds.mMin.x, o & 2 ? center.y : bounds.mMin.y, o & 4 ? center.z : bounds.mMin.z);
+					childBounds.mMax = Vector3(o & 1 ? bounds.mMax.x : center.x, o & 2 ? bounds.mMax.y : center.y, o & 4 ? bounds.mMax.z : center.z);
+
+					// Children are appended to mNodes, so references into it are taken only afterwards
+					const int childIdx = BuildNode(begin + offsets[o], begin + offsets[o + 1], childBounds, depth + 1);
+					const Node& child = mNodes[childIdx];
+					Node& node = mNodes[nodeIdx];
+					node.Children[o] = childIdx;
+
+					const float weight = child.Irradiance.Luminance();
+					node.Area += child.Area;
+					node.Irradiance += child.Irradiance;
+					weightedCentroid += child.Centroid * weight;
+					areaCentroid += child.Centroid * child.Area;
+					totalWeight += weight;
+				}
+			}
+
+			Node& node = mNodes[nodeIdx];
+			node.Centroid = totalWeight > 0.0f ? weightedCentroid / totalWeight : areaCentroid / node.Area;
+
+			return nodeIdx;
+		}
+
+		Color IrradianceOctree::Eval(const Vector3& pos, const Vector3& D, const BSSRDF* pBSSRDF, const float maxSolidAngle) const
+		{
+			Color result = Color::BLACK;
+			if (mNodes.Size() == 0)
+				return result;
+
+			int TodoStack[8 * (MAX_DEPTH + 1)];
+			int stackTop = 0;
+			TodoStack[stackTop++] = 0;
+
+			while (stackTop > 0)
+			{
+				const Node& node = mNodes[TodoStack[--stackTop]];
+
+				const bool inside = pos.x >= node.Bounds.mMin.x && pos.y >= node.Bounds.mMin.y && pos.z >= node.Bounds.mMin.z &&
+					pos.x <= node.Bounds.mMax.x && pos.y <= node.Bounds.mMax.y && pos.z <= node.Bounds.mMax.z;
+
+				const float distSqr = Math::DistanceSquared(pos, node.Centroid);
+				if (!inside && node.Area < maxSolidAngle * distSqr)
+				{
+					result += Color(pBSSRDF->NormalizeDiffusion(Math::Sqrt(distSqr), D)) * node.Irradiance;
+					continue;
+				}
+
+				if (node.PointCount > 0)
+				{
+					for (auto i = node.PointStart; i < node.PointStart + node.PointCount; i++)
+					{
+						// The profile diverges at zero distance. Evaluating a point no farther than half the radius of
+						// its disk matches the integral of the profile over the disk to first order
+						const IrradiancePoint& point = mPoints[i];
+						const float halfRadius = 0.5f * Math::Sqrt(point.Area * float(Math::EDX_INV_PI));
+						const float dist = Math::Max(Math::Distance(pos, point.Position), halfRadius);
+
+						result += Color(pBSSRDF->NormalizeDiffusion(dist, D)) * point.Irradiance * point.Area;
+					}
+				}
+				else
+				{
+					for (auto o = 0; o < 8; o++)
+					{
+						if (node.Children[o])
+							TodoStack[stackTop++] = node.Children[o];
+					}
+				}
+			}
+
+			return result * float(Math::EDX_INV_PI);
+		}
+
+		void SubsurfaceIrradianceCache::Build(const Scene* pScene, const TaskSynchronizer& taskSync)
+		{
+			mBuilt = false;
+			mOctrees.Clear();
+			mSpacings.Clear();
+			GatherBSSRDFs(pScene, &mBSSRDFs);
+
+			for (auto i = 0; i < mBSSRDFs.Size(); i++)
+			{
+				mSpacings.Add(PointSpacing(mBSSRDFs[i]));
+				mOctrees.Add(MakeUnique<IrradianceOctree>());
+				BuildOctree(pScene, mBSSRDFs[i], i, taskSync);
+
+				if (taskSync.Aborted())
+					return;
+			}
+
+			mBuilt = true;
+			mSceneVersion = pScene->GetVersion();
+		}
+
+		bool SubsurfaceIrradianceCache::IsCurrent(const Scene* pScene) const
+		{
+			if (!mBuilt || mSceneVersion != pScene->GetVersion())
+				return false;
+
+			// The material editor swaps BSSRDFs without going through the scene
+			Array<const BSSRDF*> bssrdfs;
+			GatherBSSRDFs(pScene, &bssrdfs);
+			if (bssrdfs.Size() != mBSSRDFs.Size())
+				return false;
+
+			// The material editor also changes the mean free path in place, which sets the point spacing
+			for (auto i = 0; i < bssrdfs.Size(); i++)
+			{
+				if (bssrdfs[i] != mBSSRDFs[i] || PointSpacing(bssrdfs[i]) != mSpacings[i])
+					return false;
+			}
+
+			return true;
+		}
+
+		float SubsurfaceIrradianceCache::PointSpacing(const BSSRDF* pBSSRDF)
+		{
+			// Points are spaced by half the shortest mean free path
+			const Vector3 meanFreePath = pBSSRDF->GetMeanFreePath() * pBSSRDF->GetScale();
+			return 0.5f * Math::Min(meanFreePath.x, Math::Min(meanFreePath.y, meanFreePath.z));
+		}
+
+		void SubsurfaceIrradianceCache::GatherBSSRDFs(const Scene* pScene, Array<const BSSRDF*>* pBSSRDFs)
+		{
+			pBSSRDFs->Clear();
+			for (const auto& pPrim : pScene->GetPrimitives())
+			{
+				const BSSRDF* pLast = nullptr;
+				for (auto triId = 0; triId < pPrim->GetMesh()->GetTriangleCount(); triId++)
+				{
+					const BSSRDF* pBSSRDF = pPrim->GetBSSRDF(triId);
+					if (!pBSSRDF || pBSSRDF == pLast)
+						continue;
+
+					pLast = pBSSRDF;
+
+					bool found = false;
+					for (auto pExisting : *pBSSRDFs)
+						found |= pExisting == pBSSRDF;
+
+					if (!found)
+						pBSSRDFs->Add(pBSSRDF);
+				}
+			}
+		}
+
+		void SubsurfaceIrradianceCache::BuildOctree(const Scene* pScene, const BSSRDF* pBSSRDF, const int seed, const TaskSynchronizer& taskSync)
+		{
+			const auto& primitives = pScene->GetPrimitives();
+
+			auto TriangleArea = [&](const TriangleMesh* pMesh, const uint triId) -> float
+			{
+				const Vector3& p0 = pMesh->GetPositionAt(3 * triId);
+				const Vector3& p1 = pMesh->GetPositionAt(3 * triId + 1);
+				const Vector3& p2 = pMesh->GetPositionAt(3 * triId + 2);
+
+				return 0.5f * Math::Length(Math::Cross(p1 - p0, p2 - p0));
+			};
+
+			float totalArea = 0.0f;
+			for (const auto& pPrim : primitives)
+			{
+				for (auto triId = 0; triId < pPrim->GetMesh()->GetTriangleCount(); triId++)
+				{
+					if (pPrim->GetBSSRDF(triId) == pBSSRDF)
+						totalArea += TriangleArea(pPrim->GetMesh(), triId);
+				}
+			}
+
+			const float spacing = PointSpacing(pBSSRDF);
+			if (totalArea == 0.0f || spacing <= 0.0f)
+				return;
+
+			const float pointArea = Math::Max(spacing * spacing, totalArea / float(MAX_POINTS));
+
+			// Every point stands for the same area, with the count per triangle rounded stochastically
+			RandomSampler sampler(seed);
+			Array<Intersection> sites;
+			for (auto primId = 0; primId < primitives.Size(); primId++)
+			{
+				const auto& pPrim = primitives[primId];
+				for (auto triId = 0; triId < pPrim->GetMesh()->GetTriangleCount(); triId++)
+				{
+					if (pPrim->GetBSSRDF(triId) != pBSSRDF)
+						continue;
+
+					const float expectedCount = TriangleArea(pPrim->GetMesh(), triId) / pointArea;
+					const int count = Math::FloorToInt(expectedCount + sampler.Get1D());
+					for (auto i = 0; i < count; i++)
+					{
+						const float u1 = sampler.Get1D();
+						const float u2 = sampler.Get1D();
+
+						Intersection site;
+						site.mPrimId = primId;
+						site.mTriId = triId;
+						Sampling::UniformSampleTriangle(u1, u2, &site.mU, &site.mV);
+						sites.Add(site);
+					}
+				}
+			}
+
+			// Irradiance through the surface, weighted by the same Fresnel transmittance as the exit points of
+			// sampled subsurface paths
+			Array<IrradiancePoint> points;
+			points.Resize(sites.Size());
+
+			const int BatchSize = 256;
+			const int numBatches = (int(sites.Size()) + BatchSize - 1) / BatchSize;
+			parallel_for(0, numBatches, [&](int batch)
+			{
+				if (taskSync.Aborted())
+					return;
+
+				RandomSampler batchSampler((seed + 1) * numBatches + batch);
+
+				const int batchEnd = Math::Min((batch + 1) * BatchSize, int(sites.Size()));
+				for (auto i = batch * BatchSize; i < batchEnd; i++)
+				{
+					DifferentialGeom diffGeom;
+					static_cast<Intersection&>(diffGeom) = sites[i];
+					pScene->PostIntersect(Ray(), &diffGeom);
+					diffGeom.mpBSDF = pBSSRDF->GetAdapter();
+
+					Color irradiance = Color::BLACK;
+					for (const auto& pLight : pScene->GetLights())
+					{
+						for (auto s = 0; s < mSamplesPerPoint; s++)
+							irradiance += Integrator::EstimateDirectLighting(diffGeom, diffGeom.mNormal, pLight.Get(), pScene, &batchSampler);
+					}
+
+					points[i].Position = diffGeom.mPosition;
+					points[i].Area = pointArea;
+					points[i].Irradiance = irradiance / float(mSamplesPerPoint);
+				}
+			});
+
+			if (taskSync.Aborted())
+				return;
+
+			mOctrees.Top()->Build(points);
+		}
+
+		Color SubsurfaceIrradianceCache::Eval(const DifferentialGeom& diffGeom) const
+		{
+			const BSSRDF* pBSSRDF = diffGeom.mpBSSRDF;
+			for (auto i = 0; i < mBSSRDFs.Size(); i++)
+			{
+				if (mBSSRDFs[i] == pBSSRDF)
+					return mOctrees[i]->Eval(diffGeom.mPosition, pBSSRDF->DiffusionLength(diffGeom), pBSSRDF, mMaxSolidAngle);
+			}
+
+			return Color::BLACK;
+		}
+	}
+}
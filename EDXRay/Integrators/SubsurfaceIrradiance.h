@@ -0,0 +1,105 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "../ForwardDecl.h"
+#include "Math/BoundingBox.h"
+#include "Graphics/Color.h"
+
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		// Irradiance at a point standing for a patch of a translucent surface
+		struct IrradiancePoint
+		{
+			Vector3 Position;
+			float Area;
+			Color Irradiance;
+		};
+
+		// Octree over the irradiance points of one BSSRDF. Inner nodes aggregate their points at the irradiance weighted
+		// centroid, which replaces the points once the node subtends a small enough solid angle
+		class IrradianceOctree
+		{
+		private:
+			struct Node
+			{
+				BoundingBox Bounds;
+				Vector3 Centroid;
+				float Area;
+				Color Irradiance;	// Area weighted sum
+				int Children[8];	// Octant o covers the upper half along axis a if bit a of o is set, 0 marks no child
+				int PointStart;
+				int PointCount;		// Nonzero for leaves only
+
+				Node()
+					: Area(0.0f)
+					, PointStart(0)
+					, PointCount(0)
+				{
+					for (auto i = 0; i < 8; i++)
+						Children[i] = 0;
+				}
+			};
+
+			static const int MAX_LEAF_POINTS = 8;
+			static const int MAX_DEPTH = 24;
+
+			Array<Node> mNodes;
+			Array<IrradiancePoint> mPoints;
+
+		public:
+			void Build(const Array<IrradiancePoint>& points);
+
+			// Integrates the diffusion profile with the given shape parameter against the cached irradiance
+			Color Eval(const Vector3& pos, const Vector3& D, const BSSRDF* pBSSRDF, const float maxSolidAngle) const;
+
+		private:
+			int BuildNode(const int begin, const int end, const BoundingBox& bounds, const int depth);
+		};
+
+		// Hierarchical subsurface scattering. Before rendering, points are spread over every surface with a BSSRDF and
+		// their irradiance from direct lighting is computed, radiance diffusing out of a translucent surface is then
+		// found by evaluating the profile against the cache instead of sampling entry points. Light reaching the
+		// surfaces indirectly is ignored, which trades a little bias for much faster convergence
+		class SubsurfaceIrradianceCache
+		{
+		private:
+			static const int MAX_POINTS = 1 << 20;	// Per BSSRDF, the point spacing grows beyond it
+
+			Array<const BSSRDF*> mBSSRDFs;
+			Array<float> mSpacings;		// Point spacing each octree was built with, follows the mean free path
+			Array<UniquePtr<IrradianceOctree>> mOctrees;
+
+			int mSamplesPerPoint;
+			float mMaxSolidAngle;
+
+			bool mBuilt;
+			uint mSceneVersion;
+
+		public:
+			SubsurfaceIrradianceCache()
+				: mSamplesPerPoint(16)
+				, mMaxSolidAngle(0.05f)
+				, mBuilt(false)
+				, mSceneVersion(0)
+			{
+			}
+
+			// Stops early if the task synchronizer aborts, leaving the cache unbuilt
+			void Build(const Scene* pScene, const TaskSynchronizer& taskSync);
+			// False if the scene changed or its BSSRDFs were replaced or edited since the last build
+			bool IsCurrent(const Scene* pScene) const;
+
+			// Radiance leaving the surface at diffGeom through its BSSRDF, before refraction at diffGeom.
+			// Black for BSSRDFs added after the cache was built
+			Color Eval(const DifferentialGeom& diffGeom) const;
+
+		private:
+			static void GatherBSSRDFs(const Scene* pScene, Array<const BSSRDF*>* pBSSRDFs);
+			static float PointSpacing(const BSSRDF* pBSSRDF);
+			void BuildOctree(const Scene* pScene, const BSSRDF* pBSSRDF, const int seed, const TaskSynchronizer& taskSync);
+		};
+	}
+}
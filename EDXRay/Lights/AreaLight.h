@@ -24,26 +24,47 @@ namespace EDX
 			float				mArea, mInvArea;
 			UniquePtr<BVH2>	mLightBVH;
 
+			// Triangles are picked proportional to their area, so the area pdf is mInvArea everywhere on the light
+			Sampling::AliasTable	mTriangleTable;
+
+			// Sample triangles by solid angle from the shading point when they subtend a moderate solid angle
+			bool				mSampleSolidAngle;
+
+			static constexpr float MinSolidAngle = 3e-4f;
+			static constexpr float MaxSolidAngle = 6.22f;
+
 		public:
 			AreaLight(
 				Primitive* pPrim,
 				const Color& intens,
-				const uint sampCount = 1)
+				const uint sampCount = 1,
+				const bool sampleSolidAngle = true)
 				: Light(sampCount)
 				, mpPrim(pPrim)
 				, mIntensity(intens)
+				, mArea(0.0f)
+				, mSampleSolidAngle(sampleSolidAngle)
+			{
+				mpPrim->SetAreaLight(this);
+				UpdateGeometry();
+			}
+
+			// Rebuilds the sampling tables and the BVH after the primitive's mesh changed
+			void UpdateGeometry()
 			{
 				mTriangleCount = mpPrim->GetMesh()->GetTriangleCount();
 
+				Array<float> areas;
+				areas.Resize(mTriangleCount);
+				mArea = 0.0f;
 				for (auto i = 0; i < mTriangleCount; i++)
 				{
-					float area = TriangleArea(i);
-					mArea += area;
+					areas[i] = TriangleArea(i);
+					mArea += areas[i];
 				}
 
 				mInvArea = 1.0f / mArea;
-
-				mpPrim->SetAreaLight(this);
+				mTriangleTable.SetWeights(areas.Data(), mTriangleCount);
 
 				Array<Primitive*> primitives;
 				primitives.Add(mpPrim);
@@ -60,11 +81,22 @@ namespace EDX
 				float* pEmitPdfW = nullptr) const override
 			{
 				const Vector3& pos = scatter.mPosition;
-				uint triId = lightSample.w * mTriangleCount;
-				triId = Math::Clamp(triId, 0, mTriangleCount - 1);
+				float triPmf;
+				const uint triId = mTriangleTable.Sample(lightSample.w, &triPmf);
 
-				float b0, b1;
-				Sampling::UniformSampleTriangle(lightSample.u, lightSample.v, &b0, &b1);
+				// Bidirectional callers rely on area measure pdfs, so only unidirectional estimation samples the solid angle
+				float b0, b1, solidAnglePdf = 0.0f;
+				const bool sampleSolidAngle = !pCosAtLight && !pEmitPdfW && UseSolidAngleSampling(triId, pos);
+				if (sampleSolidAngle)
+				{
+					Vector3 p0, p1, p2;
+					GetTriangle(triId, p0, p1, p2);
+					Sampling::SampleSphericalTriangle(p0, p1, p2, pos, lightSample.u, lightSample.v, &b0, &b1, &solidAnglePdf);
+					if (solidAnglePdf == 0.0f)
+						return Color::BLACK;
+				}
+				else
+					Sampling::UniformSampleTriangle(lightSample.u, lightSample.v, &b0, &b1);
 
 				Vector3 lightPoint, lightNormal;
 				SampleTriangle(triId, b0, b1, lightPoint, lightNormal);
@@ -75,8 +107,11 @@ namespace EDX
 				pVisTest->SetMedium(scatter.mMediumInterface.GetMedium(*pDir, scatter.mNormal));
 
 				const float dist = Math::Length(lightVec);
-				*pPdf = (dist * dist) /
-					Math::AbsDot(lightNormal, -*pDir) * mInvArea;
+				if (sampleSolidAngle)
+					*pPdf = triPmf * solidAnglePdf;
+				else
+					*pPdf = (dist * dist) /
+						Math::AbsDot(lightNormal, -*pDir) * mInvArea;
 
 				const float cosNormalDir = Math::Dot(lightNormal, -*pDir);
 				if (cosNormalDir < 1e-6f)
@@ -101,8 +136,7 @@ namespace EDX
 				float* pPdf,
 				float* pDirectPdf = nullptr) const override
 			{
-				uint triId = lightSample1.w * mTriangleCount;
-				triId = Math::Clamp(triId, 0, mTriangleCount - 1);
+				const uint triId = mTriangleTable.Sample(lightSample1.w);
 
 				float b0, b1;
 				Sampling::UniformSampleTriangle(lightSample1.u, lightSample1.v, &b0, &b1);
@@ -152,6 +186,14 @@ namespace EDX
 				Ray ray = Ray(pos, dir);
 				if (mLightBVH->Intersect(ray, &isect))
 				{
+					if (UseSolidAngleSampling(isect.mTriId, pos))
+					{
+						Vector3 p0, p1, p2;
+						GetTriangle(isect.mTriId, p0, p1, p2);
+
+						return mTriangleTable.Pmf(isect.mTriId) / SolidAngle(p0, p1, p2, pos);
+					}
+
 					mpPrim->PostIntersect(ray, &isect);
 
 					const float dist = isect.mDist;
@@ -184,6 +226,36 @@ namespace EDX
 			}
 
 		private:
+			inline void GetTriangle(const uint triId, Vector3& p0, Vector3& p1, Vector3& p2) const
+			{
+				auto pMesh = mpPrim->GetMesh();
+				p0 = pMesh->GetPositionAt(3 * triId + 0);
+				p1 = pMesh->GetPositionAt(3 * triId + 1);
+				p2 = pMesh->GetPositionAt(3 * triId + 2);
+			}
+
+			inline float SolidAngle(const Vector3& p0, const Vector3& p1, const Vector3& p2, const Vector3& pos) const
+			{
+				return Sampling::SphericalTriangleArea(
+					Math::Normalize(p0 - pos),
+					Math::Normalize(p1 - pos),
+					Math::Normalize(p2 - pos));
+			}
+
+			// Tiny triangles are sampled by area, where the spherical mapping loses precision, and so are triangles
+			// covering almost the whole sphere. Only depends on the triangle and the position, so Pdf agrees with Illuminate
+			inline bool UseSolidAngleSampling(const uint triId, const Vector3& pos) const
+			{
+				if (!mSampleSolidAngle)
+					return false;
+
+				Vector3 p0, p1, p2;
+				GetTriangle(triId, p0, p1, p2);
+
+				const float solidAngle = SolidAngle(p0, p1, p2, pos);
+				return solidAngle >= MinSolidAngle && solidAngle <= MaxSolidAngle;
+			}
+
 			inline void SampleTriangle(const uint triId,
 				const float b0,
 				const float b1,
@@ -55,7 +55,7 @@ namespace EDX
 
 				Vector3 center;
 				float radius;
-				mpScene->WorldBounds().BoundingSphere(&center, &radius);
+				mpScene->BoundingSphere(&center, &radius);
 				pVisTest->SetSegment(pos, pos + 2.0f * radius * *pDir);
 				pVisTest->SetMedium(scatter.mMediumInterface.GetMedium(*pDir, scatter.mNormal));
 
@@ -82,7 +82,7 @@ namespace EDX
 
 				Vector3 center;
 				float radius;
-				mpScene->WorldBounds().BoundingSphere(&center, &radius);
+				mpScene->BoundingSphere(&center, &radius);
 
 				Vector3 origin = center + radius * (f1 * mDirFrame.mX + f2 * mDirFrame.mY);
 				Vector3 direction = -Sampling::UniformSampleCone(lightSample2.u, lightSample2.v,
@@ -113,7 +113,7 @@ namespace EDX
 					{
 						Vector3 center;
 						float radius;
-						mpScene->WorldBounds().BoundingSphere(&center, &radius);
+						mpScene->BoundingSphere(&center, &radius);
 
 						*pPdf = Sampling::ConcentricDiscPdf() / (radius * radius) * dirPdf;
 					}
@@ -8,7 +8,9 @@
 #include "Graphics/Color.h"
 #include "Graphics/Texture.h"
 
-#include "SkyLight/ArHosekSkyModel.h"
+#include "SkyLight/SkyMap.h"
+
+#include <ppl.h>
 
 namespace EDX
 {
@@ -16,10 +18,40 @@ namespace EDX
 	{
 		class EnvironmentLight : public Light
 		{
+		private:
+			// Texel center angles of one pyramid level, with a bound on the angular radius of its texels
+			struct LevelAngles
+			{
+				Array<float> CosTheta, SinTheta;
+				Array<float> CosPhi, SinPhi;
+				float CosRadius, SinRadius;
+				bool Unbounded;
+			};
+
+			// Receiver normal in map coordinates
+			struct HemisphereNormal
+			{
+				float CosTheta, SinTheta;
+				float CosPhi, SinPhi;
+			};
+
+			static const int MaxBaseHeight = 1024;
+
 		private:
 			UniquePtr<Texture2D<Color>>			mpMap;
-			UniquePtr<Sampling::Distribution2D>	mpDistribution;
-			Array2f									mLuminance;
+			// Luminance pyramid sampled by hierarchical warping, level 0 has mBaseWidth x mBaseHeight texels
+			// and the top level 2 x 1
+			Array<Array<float>>						mLevels;
+			Array<LevelAngles>						mLevelAngles;
+			int										mBaseWidth, mBaseHeight;
+			int										mNumLevels;
+			mutable bool							mHemisphereSampling;
+			// Analytic sun disc of the sky model, kept out of the map and sampled by solid angle
+			bool									mHasSun;
+			float									mSunZenith;
+			float									mSunCosMax;
+			Color									mSunRadiance;
+			float									mSunPower, mSkyPower;
 			const Scene*							mpScene;
 			bool									mIsTexture;
 			mutable float							mScale;
@@ -34,6 +66,8 @@ namespace EDX
 				mpScene = scene;
 				mIsTexture = false;
 				mScale = 1.0f;
+				mHemisphereSampling = true;
+				mHasSun = false;
 				mpMap = MakeUnique<ConstantTexture2D<Color>>(intens);
 			}
 
@@ -48,9 +82,11 @@ namespace EDX
 				mIsTexture = true;
 				mScale = scale;
 				mRotation = Math::ToRadians(rotate);
+				mHemisphereSampling = true;
+				mHasSun = false;
 				mpMap = MakeUnique<ImageTexture<Color, Color>>(path, 1.0f);
 
-				CalcLuminanceDistribution();
+				BuildSamplingPyramid();
 			}
 
 			EnvironmentLight(const Color& turbidity,
@@ -66,49 +102,37 @@ namespace EDX
 				mpScene = scene;
 				mIsTexture = true;
 				mScale = 1.0f;
+				mHemisphereSampling = true;
 
-				float sunElevationRad = Math::ToRadians(sunElevation);
 				mRotation = Math::ToRadians(rotate);
 
-				static const int NUM_CHANNELS = 3;
-				ArHosekSkyModelState* skyModelState[NUM_CHANNELS];
-				for (auto i = 0; i < NUM_CHANNELS; i++)
-					skyModelState[i] = arhosek_rgb_skymodelstate_alloc_init(turbidity[i], groundAlbedo[i], sunElevationRad);
+				SkyMapDesc desc;
+				desc.Turbidity = turbidity;
+				desc.GroundAlbedo = groundAlbedo;
+				desc.SunElevation = sunElevation;
+				desc.ResX = resX;
+				desc.ResY = resY;
 
-				const float sunZenith = float(Math::EDX_PI_2) - sunElevationRad;
-				DimensionalArray<2, Color> skyRadiance;
-				skyRadiance.Init(Vector2i(resX, resY));
-				for (auto y = 0; y < resY * 0.5f; y++)
-				{
-					float v = (y + 0.5f) / float(resY);
-					for (auto x = 0; x < resX; x++)
-					{
-						float u = (x + 0.5f) / float(resX);
-						float phi = u * float(Math::EDX_TWO_PI);
-						float theta = v * float(Math::EDX_PI);
-
-						float cosGamma = Math::Cos(theta) * Math::Cos(sunZenith)
-							+ Math::Sin(theta) * Math::Sin(sunZenith)
-							* Math::Cos(phi - float(Math::EDX_PI));
-						float gamma = acosf(cosGamma);
+				SkyMap skyMap;
+				SkyMapCache::Instance()->Get(desc, &skyMap);
 
-						for (auto i = 0; i < NUM_CHANNELS; i++)
-						{
-							float r = arhosek_tristim_skymodel_radiance(skyModelState[i], theta, gamma, i);
-							Assert(Math::NumericValid(r));
-							skyRadiance[Vector2i(x, y)][i] = r * 0.025f;
-							if (gamma < 0.02)
-								skyRadiance[Vector2i(x, y)][i] = 3000.0f;
-						}
-					}
-				}
+				mHasSun = skyMap.HasSun;
+				mSunZenith = float(Math::EDX_PI_2) - Math::ToRadians(sunElevation);
+				mSunRadiance = skyMap.SunRadiance;
+				mSunCosMax = Math::Cos(skyMap.SunRadius);
 
-				for (auto i = 0; i < NUM_CHANNELS; i++)
-					arhosekskymodelstate_free(skyModelState[i]);
+				mpMap = MakeUnique<ImageTexture<Color, Color>>(skyMap.Radiance.Data(), resX, resY);
 
-				mpMap = MakeUnique<ImageTexture<Color, Color>>(skyRadiance.Data(), resX, resY);
+				BuildSamplingPyramid();
 
-				CalcLuminanceDistribution();
+				if (mHasSun)
+				{
+					// Choose between the sun and the sky proportional to the power they emit
+					const int top = mNumLevels - 1;
+					mSkyPower = 2.0f * float(Math::EDX_PI) * float(Math::EDX_PI) *
+						(mLevels[top][0] + mLevels[top][1]) / float(mBaseWidth * mBaseHeight);
+					mSunPower = mSunRadiance.Luminance() * 2.0f * float(Math::EDX_PI) * (1.0f - mSunCosMax);
+				}
 			}
 
 			Color Illuminate(const Scatter& scatter,
@@ -118,32 +142,89 @@ namespace EDX
 				float* pPdf,
 				float* pCosAtLight = nullptr,
 				float* pEmitPdfW = nullptr) const override
+			{
+				return IlluminateMap(scatter, lightSample, nullptr, pDir, pVisTest, pPdf, pCosAtLight, pEmitPdfW);
+			}
+
+			Color IlluminateHemisphere(const Scatter& scatter,
+				const Vector3& hemisphereNormal,
+				const RayTracer::Sample& lightSample,
+				Vector3* pDir,
+				VisibilityTester* pVisTest,
+				float* pPdf) const override
+			{
+				if (!mIsTexture || !mHemisphereSampling)
+					return Illuminate(scatter, lightSample, pDir, pVisTest, pPdf);
+
+				return IlluminateMap(scatter, lightSample, &hemisphereNormal, pDir, pVisTest, pPdf);
+			}
+
+			Color IlluminateMap(const Scatter& scatter,
+				const RayTracer::Sample& lightSample,
+				const Vector3* pHemisphereNormal,
+				Vector3* pDir,
+				VisibilityTester* pVisTest,
+				float* pPdf,
+				float* pCosAtLight = nullptr,
+				float* pEmitPdfW = nullptr) const
 			{
 				const Vector3& pos = scatter.mPosition;
-				float u, v;
+				Color radiance;
 				if (mIsTexture)
 				{
-					mpDistribution->SampleContinuous(lightSample.u, lightSample.v, &u, &v, pPdf);
-					if (*pPdf == 0.0f)
-						return Color::BLACK;
-
-					float phi = u * float(Math::EDX_TWO_PI);
-					phi = ApplyRotation(phi, -1.0f);
-					float theta = v * float(Math::EDX_PI);
-					float sinTheta = Math::Sin(theta);
-					*pPdf = sinTheta != 0.0f ? *pPdf / (2.0f * float(Math::EDX_PI) * float(Math::EDX_PI) * sinTheta) : 0.0f;
-
-					*pDir = Math::SphericalDirection(sinTheta,
-						Math::Cos(theta),
-						phi);
+					HemisphereNormal normal;
+					const HemisphereNormal* pNormal = nullptr;
+					if (pHemisphereNormal)
+					{
+						normal = ToMapNormal(*pHemisphereNormal);
+						pNormal = &normal;
+					}
+
+					float u = lightSample.u;
+					const float sunProb = SunSampleProbability(pHemisphereNormal);
+					if (u < sunProb)
+					{
+						u /= sunProb;
+						*pDir = SampleSun(u, lightSample.v);
+
+						float skyPdf = SkyPdf(*pDir, pNormal);
+						*pPdf = sunProb * Sampling::UniformConePDF(mSunCosMax) + (1.0f - sunProb) * skyPdf;
+						radiance = Radiance(*pDir);
+					}
+					else
+					{
+						u = (u - sunProb) / (1.0f - sunProb);
+
+						float mapU, mapV;
+						float mapPdf = SampleMap(u, lightSample.v, pNormal, &mapU, &mapV);
+						if (mapPdf == 0.0f)
+						{
+							*pPdf = 0.0f;
+							return Color::BLACK;
+						}
+
+						float phi = mapU * float(Math::EDX_TWO_PI);
+						phi = ApplyRotation(phi, -1.0f);
+						float theta = mapV * float(Math::EDX_PI);
+						float sinTheta = Math::Sin(theta);
+						float skyPdf = sinTheta != 0.0f ? mapPdf / (2.0f * float(Math::EDX_PI) * float(Math::EDX_PI) * sinTheta) : 0.0f;
+
+						*pDir = Math::SphericalDirection(sinTheta,
+							Math::Cos(theta),
+							phi);
+
+						*pPdf = (1.0f - sunProb) * skyPdf + sunProb * SunPdf(*pDir);
+
+						Vector2 diff[2] = { Vector2::ZERO, Vector2::ZERO };
+						radiance = mpMap->Sample(Vector2(mapU, mapV), diff, TextureFilter::Linear) * mScale + SunRadiance(*pDir);
+					}
 				}
 				else
 				{
-					u = lightSample.u;
-					v = lightSample.v;
 					Vector3 dir = Sampling::UniformSampleSphere(lightSample.u, lightSample.v);
 					*pDir = Vector3(dir.x, dir.z, -dir.y);
 					*pPdf = Sampling::UniformSpherePDF();
+					radiance = Radiance(*pDir);
 				}
 
 				if (pCosAtLight)
@@ -151,7 +232,7 @@ namespace EDX
 
 				Vector3 center;
 				float radius;
-				mpScene->WorldBounds().BoundingSphere(&center, &radius);
+				mpScene->BoundingSphere(&center, &radius);
 
 				if (pEmitPdfW)
 				{
@@ -161,8 +242,7 @@ namespace EDX
 				pVisTest->SetRay(pos, *pDir, 2.0f * radius);
 				pVisTest->SetMedium(scatter.mMediumInterface.GetMedium(*pDir, scatter.mNormal));
 
-				Vector2 diff[2] = { Vector2::ZERO, Vector2::ZERO };
-				return mpMap->Sample(Vector2(u, v), diff, TextureFilter::Linear) * mScale;
+				return radiance;
 			}
 
 			Color Sample(const RayTracer::Sample& lightSample1,
@@ -172,42 +252,50 @@ namespace EDX
 				float* pPdf,
 				float* pDirectPdf = nullptr) const override
 			{
-				float u, v, mapPdf, sinTheta;
+				float pdfW;
 
 				if (mIsTexture)
 				{
-					mpDistribution->SampleContinuous(lightSample1.u, lightSample1.v, &u, &v, &mapPdf);
-					if (mapPdf == 0.0f)
+					float u = lightSample1.u;
+					const float sunProb = SunSampleProbability(nullptr);
+					if (u < sunProb)
 					{
-						*pPdf = 0.0f;
-						if (pDirectPdf)
-							*pDirectPdf = 0.0f;
+						u /= sunProb;
+						*pNormal = -SampleSun(u, lightSample1.v);
+					}
+					else
+					{
+						u = (u - sunProb) / (1.0f - sunProb);
+
+						float mapU, mapV;
+						if (SampleMap(u, lightSample1.v, nullptr, &mapU, &mapV) == 0.0f)
+						{
+							*pPdf = 0.0f;
+							if (pDirectPdf)
+								*pDirectPdf = 0.0f;
 
-						return Color::BLACK;
+							return Color::BLACK;
+						}
+
+						float phi = mapU * float(Math::EDX_TWO_PI);
+						phi = ApplyRotation(phi, -1.0f);
+						float theta = mapV * float(Math::EDX_PI);
+						*pNormal = -Math::SphericalDirection(Math::Sin(theta),
+							Math::Cos(theta),
+							phi);
 					}
 
-					float phi = u * float(Math::EDX_TWO_PI);
-					phi = ApplyRotation(phi, -1.0f);
-					float theta = v * float(Math::EDX_PI);
-					sinTheta = Math::Sin(theta);
-					*pNormal = -Math::SphericalDirection(sinTheta,
-						Math::Cos(theta),
-						phi);
+					pdfW = DirectPdf(-*pNormal, nullptr);
 				}
 				else
 				{
-					u = lightSample1.u;
-					v = lightSample1.v;
 					*pNormal = -Sampling::UniformSampleSphere(lightSample1.u, lightSample1.v);
-					mapPdf = Sampling::UniformSpherePDF();
-
-					float theta = v * float(Math::EDX_PI);
-					sinTheta = Math::Sin(theta);
+					pdfW = Sampling::UniformSpherePDF();
 				}
 
 				Vector3 center;
 				float radius;
-				mpScene->WorldBounds().BoundingSphere(&center, &radius);
+				mpScene->BoundingSphere(&center, &radius);
 
 				Vector3 v1, v2;
 				Math::CoordinateSystem(-*pNormal, &v1, &v2);
@@ -217,7 +305,6 @@ namespace EDX
 				Vector3 origin = center + radius * (f1 * v1 + f2 * v2);
 				*pRay = Ray(origin + radius * -*pNormal, *pNormal);
 
-				float pdfW = sinTheta != 0.0f ? mapPdf / (float(Math::EDX_TWO_PI) * float(Math::EDX_PI) * sinTheta) : 0.0f;
 				float pdfA = Sampling::ConcentricDiscPdf() / (radius * radius);
 				*pPdf = pdfW * pdfA;
 				if (pDirectPdf)
@@ -225,8 +312,7 @@ namespace EDX
 
 				//Assert(*pPdf > 0.0f);
 				
-				Vector2 diff[2] = { Vector2::ZERO, Vector2::ZERO };
-				return mpMap->Sample(Vector2(u, v), diff, TextureFilter::Linear) * mScale;
+				return Radiance(-*pNormal);
 			}
 
 			Color Emit(const Vector3& dir,
@@ -235,67 +321,36 @@ namespace EDX
 				float* pDirectPdf = nullptr) const override
 			{
 				Vector3 negDir = Math::Normalize(-dir);
-				float phi = Math::SphericalPhi(negDir);
-				phi = ApplyRotation(phi);
-				float s = phi * float(Math::EDX_INV_2PI);
-				float theta = Math::SphericalTheta(negDir);
-				float t = theta * float(Math::EDX_INV_PI);
-
-				float directPdf = 0.0f;
 				if (pDirectPdf || pPdf)
 				{
-					if (mIsTexture)
-					{
-						float mapPdf = mpDistribution->Pdf(s, t);
-						float sinTheta = Math::Sin(theta);
-						float pdfW = sinTheta != 0.0f ? mapPdf / (float(Math::EDX_TWO_PI) * float(Math::EDX_PI) * sinTheta) : 0.0f;
-						if (pDirectPdf)
-							*pDirectPdf = pdfW;
+					float pdfW = DirectPdf(negDir, nullptr);
+					if (pDirectPdf)
+						*pDirectPdf = pdfW;
 
-						if (pPdf)
-						{
-							Vector3 center;
-							float radius;
-							mpScene->WorldBounds().BoundingSphere(&center, &radius);
-							float pdfA = Sampling::ConcentricDiscPdf() / (radius * radius);
-							*pPdf = pdfW * pdfA;
-						}
-					}
-					else
+					if (pPdf)
 					{
-						float pdfW = Sampling::UniformSpherePDF();
-						if (pDirectPdf)
-							*pDirectPdf = pdfW;
-
-						if (pPdf)
-						{
-							Vector3 center;
-							float radius;
-							mpScene->WorldBounds().BoundingSphere(&center, &radius);
-							float pdfA = Sampling::ConcentricDiscPdf() / (radius * radius);
-							*pPdf = pdfW * pdfA;
-						}
+						Vector3 center;
+						float radius;
+						mpScene->BoundingSphere(&center, &radius);
+						float pdfA = Sampling::ConcentricDiscPdf() / (radius * radius);
+						*pPdf = pdfW * pdfA;
 					}
 				}
 
-				Vector2 diff[2] = { Vector2::ZERO, Vector2::ZERO };
-				return mpMap->Sample(Vector2(s, t), diff, TextureFilter::Linear) * mScale;
+				return Radiance(negDir);
 			}
 
 			float Pdf(const Vector3& pos, const Vector3& dir) const override
 			{
-				if (mIsTexture)
-				{
-					Vector3 normalizedDir = Math::Normalize(dir);
-					float theta = Math::SphericalTheta(normalizedDir);
-					float phi = Math::SphericalPhi(normalizedDir);
-					phi = ApplyRotation(phi);
-					float sinTheta = Math::Sin(theta);
-					return mpDistribution->Pdf(phi * float(Math::EDX_INV_2PI), theta * float(Math::EDX_INV_PI)) /
-						(2.0f * float(Math::EDX_PI) * float(Math::EDX_PI) * sinTheta);
-				}
-				else
-					return Sampling::UniformSpherePDF();
+				return DirectPdf(Math::Normalize(dir), nullptr);
+			}
+
+			float PdfHemisphere(const Vector3& pos, const Vector3& dir, const Vector3& hemisphereNormal) const override
+			{
+				if (!mIsTexture || !mHemisphereSampling)
+					return DirectPdf(Math::Normalize(dir), nullptr);
+
+				return DirectPdf(Math::Normalize(dir), &hemisphereNormal);
 			}
 
 			bool IsEnvironmentLight() const override
@@ -318,6 +373,10 @@ namespace EDX
 			{
 				return mIsTexture;
 			}
+			bool HasSun() const
+			{
+				return mHasSun;
+			}
 			float GetRotation() const
 			{
 				return mRotation;
@@ -334,26 +393,371 @@ namespace EDX
 			{
 				mScale = scl;
 			}
+			// Weight the map by the largest cosine to the receiver normal over each texel when sampling for reflecting receivers.
+			// Texels entirely below the horizon are skipped, directions inside texels straddling it can still be generated
+			bool GetHemisphereSampling() const
+			{
+				return mHemisphereSampling;
+			}
+			void SetHemisphereSampling(const bool enable) const
+			{
+				mHemisphereSampling = enable;
+			}
 
 		private:
-			void CalcLuminanceDistribution()
+			// Radiance arriving from the normalized direction dir
+			Color Radiance(const Vector3& dir) const
 			{
-				auto width = mpMap->Width();
-				auto height = mpMap->Height();
-				mLuminance.Init(Vector2i(width, height));
+				float phi = Math::SphericalPhi(dir);
+				phi = ApplyRotation(phi);
+				float s = phi * float(Math::EDX_INV_2PI);
+				float t = Math::SphericalTheta(dir) * float(Math::EDX_INV_PI);
+
+				Vector2 diff[2] = { Vector2::ZERO, Vector2::ZERO };
+				return mpMap->Sample(Vector2(s, t), diff, TextureFilter::Linear) * mScale + SunRadiance(dir);
+			}
+
+			// Solid angle pdf of the normalized direction dir under the mixture of sun and sky sampling
+			float DirectPdf(const Vector3& dir, const Vector3* pHemisphereNormal) const
+			{
+				if (!mIsTexture)
+					return Sampling::UniformSpherePDF();
+
+				HemisphereNormal normal;
+				const HemisphereNormal* pNormal = nullptr;
+				if (pHemisphereNormal)
+				{
+					normal = ToMapNormal(*pHemisphereNormal);
+					pNormal = &normal;
+				}
+
+				const float skyPdf = SkyPdf(dir, pNormal);
+				if (!mHasSun)
+					return skyPdf;
+
+				const float sunProb = SunSampleProbability(pHemisphereNormal);
+				return (1.0f - sunProb) * skyPdf + sunProb * SunPdf(dir);
+			}
+
+			float SkyPdf(const Vector3& dir, const HemisphereNormal* pNormal) const
+			{
+				float theta = Math::SphericalTheta(dir);
+				float phi = Math::SphericalPhi(dir);
+				phi = ApplyRotation(phi);
+				float sinTheta = Math::Sin(theta);
+				if (sinTheta == 0.0f)
+					return 0.0f;
+
+				return MapPdf(phi * float(Math::EDX_INV_2PI), theta * float(Math::EDX_INV_PI), pNormal) /
+					(2.0f * float(Math::EDX_PI) * float(Math::EDX_PI) * sinTheta);
+			}
+
+			// Direction towards the sun center, the sky model places the sun at phi = pi in map space
+			Vector3 SunDirection() const
+			{
+				return Math::SphericalDirection(Math::Sin(mSunZenith),
+					Math::Cos(mSunZenith),
+					ApplyRotation(float(Math::EDX_PI), -1.0f));
+			}
+
+			Vector3 SampleSun(const float u, const float v) const
+			{
+				const Frame sunFrame = Frame(SunDirection());
+				return Sampling::UniformSampleCone(u, v, mSunCosMax, sunFrame.mX, sunFrame.mY, sunFrame.mZ);
+			}
+
+			float SunPdf(const Vector3& dir) const
+			{
+				if (!mHasSun || !Sampling::DirectionInCone(dir, SunDirection(), mSunCosMax))
+					return 0.0f;
+
+				return Sampling::UniformConePDF(mSunCosMax);
+			}
+
+			Color SunRadiance(const Vector3& dir) const
+			{
+				if (!mHasSun || !Sampling::DirectionInCone(dir, SunDirection(), mSunCosMax))
+					return Color::BLACK;
+
+				return mSunRadiance * mScale;
+			}
+
+			float SunSampleProbability(const Vector3* pHemisphereNormal) const
+			{
+				if (!mHasSun)
+					return 0.0f;
+
+				// Never sample a sun disc entirely below the receiver
+				if (pHemisphereNormal)
+				{
+					const float sinMax = Math::Sqrt(Math::Max(0.0f, 1.0f - mSunCosMax * mSunCosMax));
+					if (Math::Dot(SunDirection(), *pHemisphereNormal) < -sinMax)
+						return 0.0f;
+				}
+
+				return mSunPower / (mSunPower + mSkyPower);
+			}
+
+			void BuildSamplingPyramid()
+			{
+				const int width = mpMap->Width();
+				const int height = mpMap->Height();
+
+				mBaseHeight = Math::Min(Math::RoundUpPowOfTwo(height), MaxBaseHeight);
+				mBaseWidth = 2 * mBaseHeight;
+				mNumLevels = Math::FloorLog2(mBaseHeight) + 1;
+
+				// Base texels average the sin weighted luminance of the map texels centered inside them, so small
+				// bright features are never lost. Base texels without any (map smaller than the base) use their center
+				Array<int> baseRowOf, baseColOf;
+				baseRowOf.Resize(height);
+				baseColOf.Resize(width);
 				for (auto y = 0; y < height; y++)
+					baseRowOf[y] = Math::Min(int((y + 0.5f) * mBaseHeight / float(height)), mBaseHeight - 1);
+				for (auto x = 0; x < width; x++)
+					baseColOf[x] = Math::Min(int((x + 0.5f) * mBaseWidth / float(width)), mBaseWidth - 1);
+
+				Array<int> firstMapRow;
+				firstMapRow.Resize(mBaseHeight + 1);
+				for (auto y = 0, mapY = 0; y <= mBaseHeight; y++)
 				{
-					float v = (y + 0.5f) / float(height);
-					float sinTheta = Math::Sin(float(Math::EDX_PI) * (y + 0.5f) / float(height));
-					for (auto x = 0; x < width; x++)
+					while (mapY < height && baseRowOf[mapY] < y)
+						mapY++;
+					firstMapRow[y] = mapY;
+				}
+
+				mLevels.Resize(mNumLevels);
+				mLevels[0].Resize(mBaseWidth * mBaseHeight);
+				concurrency::parallel_for(0, mBaseHeight, [&](int y)
+				{
+					float* pRow = mLevels[0].Data() + y * mBaseWidth;
+					Array<int> counts;
+					counts.Resize(mBaseWidth);
+					for (auto x = 0; x < mBaseWidth; x++)
 					{
-						float u = (x + 0.5f) / float(width);
-						Vector2 diff[2] = { Vector2::ZERO, Vector2::ZERO };
-						mLuminance[Vector2i(x, y)] = mpMap->Sample(Vector2(u, v), diff, TextureFilter::Linear).Luminance() * sinTheta;
+						pRow[x] = 0.0f;
+						counts[x] = 0;
+					}
+
+					Vector2 diff[2] = { Vector2::ZERO, Vector2::ZERO };
+					for (auto mapY = firstMapRow[y]; mapY < firstMapRow[y + 1]; mapY++)
+					{
+						const float v = (mapY + 0.5f) / float(height);
+						const float sinTheta = Math::Sin(float(Math::EDX_PI) * v);
+						for (auto mapX = 0; mapX < width; mapX++)
+						{
+							const float u = (mapX + 0.5f) / float(width);
+							pRow[baseColOf[mapX]] += mpMap->Sample(Vector2(u, v), diff, TextureFilter::Linear).Luminance() * sinTheta;
+							counts[baseColOf[mapX]]++;
+						}
+					}
+
+					const float v = (y + 0.5f) / float(mBaseHeight);
+					const float sinTheta = Math::Sin(float(Math::EDX_PI) * v);
+					for (auto x = 0; x < mBaseWidth; x++)
+					{
+						if (counts[x] > 0)
+							pRow[x] /= float(counts[x]);
+						else
+							pRow[x] = mpMap->Sample(Vector2((x + 0.5f) / float(mBaseWidth), v), diff, TextureFilter::Linear).Luminance() * sinTheta;
+					}
+				});
+
+				// Every coarser texel holds the sum of its 2 x 2 children
+				for (auto level = 1; level < mNumLevels; level++)
+				{
+					const int levelWidth = mBaseWidth >> level;
+					const int levelHeight = mBaseHeight >> level;
+					const Array<float>& children = mLevels[level - 1];
+					mLevels[level].Resize(levelWidth * levelHeight);
+					for (auto y = 0; y < levelHeight; y++)
+					{
+						for (auto x = 0; x < levelWidth; x++)
+						{
+							const int child = 2 * x + 2 * y * (2 * levelWidth);
+							mLevels[level][x + y * levelWidth] =
+								children[child] + children[child + 1] +
+								children[child + 2 * levelWidth] + children[child + 2 * levelWidth + 1];
+						}
+					}
+				}
+
+				mLevelAngles.Resize(mNumLevels);
+				for (auto level = 0; level < mNumLevels; level++)
+				{
+					const int levelWidth = mBaseWidth >> level;
+					const int levelHeight = mBaseHeight >> level;
+					LevelAngles& angles = mLevelAngles[level];
+
+					angles.CosTheta.Resize(levelHeight);
+					angles.SinTheta.Resize(levelHeight);
+					for (auto y = 0; y < levelHeight; y++)
+					{
+						const float theta = float(Math::EDX_PI) * (y + 0.5f) / float(levelHeight);
+						angles.CosTheta[y] = Math::Cos(theta);
+						angles.SinTheta[y] = Math::Sin(theta);
+					}
+
+					angles.CosPhi.Resize(levelWidth);
+					angles.SinPhi.Resize(levelWidth);
+					for (auto x = 0; x < levelWidth; x++)
+					{
+						const float phi = float(Math::EDX_TWO_PI) * (x + 0.5f) / float(levelWidth);
+						angles.CosPhi[x] = Math::Cos(phi);
+						angles.SinPhi[x] = Math::Sin(phi);
+					}
+
+					// Any point of a texel is within half its theta extent plus half its phi extent of the center
+					const float radius = 0.5f * float(Math::EDX_PI) / float(levelHeight) + float(Math::EDX_PI) / float(levelWidth);
+					angles.Unbounded = radius >= float(Math::EDX_PI_2);
+					angles.CosRadius = Math::Cos(radius);
+					angles.SinRadius = Math::Sin(radius);
+				}
+			}
+
+			HemisphereNormal ToMapNormal(const Vector3& normal) const
+			{
+				const float theta = Math::SphericalTheta(normal);
+				const float phi = ApplyRotation(Math::SphericalPhi(normal));
+
+				HemisphereNormal ret;
+				ret.CosTheta = Math::Cos(theta);
+				ret.SinTheta = Math::Sin(theta);
+				ret.CosPhi = Math::Cos(phi);
+				ret.SinPhi = Math::Sin(phi);
+
+				return ret;
+			}
+
+			inline float TexelWeight(const int level, const int x, const int y, const HemisphereNormal* pNormal) const
+			{
+				const float value = mLevels[level][x + y * (mBaseWidth >> level)];
+				if (!pNormal || value == 0.0f)
+					return value;
+
+				const LevelAngles& angles = mLevelAngles[level];
+				if (angles.Unbounded)
+					return value;
+
+				// Largest cosine to the normal over the texel, bounded with a cap around the texel center. Only texels
+				// entirely below the horizon get zero weight, the warp inside a straddling texel ignores the normal
+				const float cosCenter = pNormal->CosTheta * angles.CosTheta[y] +
+					pNormal->SinTheta * angles.SinTheta[y] * (pNormal->CosPhi * angles.CosPhi[x] + pNormal->SinPhi * angles.SinPhi[x]);
+				if (cosCenter >= angles.CosRadius)
+					return value;
+
+				const float sinCenter = Math::Sqrt(Math::Max(0.0f, 1.0f - cosCenter * cosCenter));
+				return value * Math::Max(0.0f, cosCenter * angles.CosRadius + sinCenter * angles.SinRadius);
+			}
+
+			// Warps (u, v) down the pyramid, picking the row of the 2 x 2 children with v and the column with u,
+			// returns the pdf with respect to the map coordinates
+			float SampleMap(float u, float v, const HemisphereNormal* pNormal, float* pU, float* pV) const
+			{
+				const int top = mNumLevels - 1;
+				const float left = TexelWeight(top, 0, 0, pNormal);
+				const float total = left + TexelWeight(top, 1, 0, pNormal);
+				if (total <= 0.0f)
+					return 0.0f;
+
+				int x = 0, y = 0;
+				float prob = left / total;
+				if (u < prob)
+				{
+					u /= prob;
+				}
+				else
+				{
+					u = (u - prob) / (1.0f - prob);
+					prob = 1.0f - prob;
+					x = 1;
+				}
+
+				for (auto level = top - 1; level >= 0; level--)
+				{
+					x *= 2;
+					y *= 2;
+
+					const float w00 = TexelWeight(level, x, y, pNormal);
+					const float w10 = TexelWeight(level, x + 1, y, pNormal);
+					const float w01 = TexelWeight(level, x, y + 1, pNormal);
+					const float w11 = TexelWeight(level, x + 1, y + 1, pNormal);
+
+					const float upper = w00 + w10;
+					const float childTotal = upper + w01 + w11;
+					if (childTotal <= 0.0f)
+						return 0.0f;
+
+					float rowLeft, rowRight;
+					const float probUpper = upper / childTotal;
+					if (v < probUpper)
+					{
+						v /= probUpper;
+						rowLeft = w00;
+						rowRight = w10;
 					}
+					else
+					{
+						v = (v - probUpper) / (1.0f - probUpper);
+						rowLeft = w01;
+						rowRight = w11;
+						y += 1;
+					}
+
+					float chosen;
+					const float probLeft = rowLeft / (rowLeft + rowRight);
+					if (u < probLeft)
+					{
+						u /= probLeft;
+						chosen = rowLeft;
+					}
+					else
+					{
+						u = (u - probLeft) / (1.0f - probLeft);
+						chosen = rowRight;
+						x += 1;
+					}
+
+					prob *= chosen / childTotal;
+					u = Math::Clamp(u, 0.0f, 0.99999994f);
+					v = Math::Clamp(v, 0.0f, 0.99999994f);
+				}
+
+				*pU = (x + u) / float(mBaseWidth);
+				*pV = (y + v) / float(mBaseHeight);
+
+				return prob * mBaseWidth * mBaseHeight;
+			}
+
+			float MapPdf(const float s, const float t, const HemisphereNormal* pNormal) const
+			{
+				const int baseX = Math::Clamp(int(s * mBaseWidth), 0, mBaseWidth - 1);
+				const int baseY = Math::Clamp(int(t * mBaseHeight), 0, mBaseHeight - 1);
+
+				const int top = mNumLevels - 1;
+				float prob = 1.0f;
+				for (auto level = top; level >= 0; level--)
+				{
+					const int x = baseX >> level;
+					const int y = baseY >> level;
+
+					// Siblings sharing the parent texel, the two top level texels share a virtual root
+					const int x0 = level == top ? 0 : x & ~1;
+					const int y0 = level == top ? 0 : y & ~1;
+					const int numRows = level == top ? 1 : 2;
+
+					float total = 0.0f;
+					for (auto j = 0; j < numRows; j++)
+						for (auto i = 0; i < 2; i++)
+							total += TexelWeight(level, x0 + i, y0 + j, pNormal);
+
+					if (total <= 0.0f)
+						return 0.0f;
+
+					prob *= TexelWeight(level, x, y, pNormal) / total;
 				}
 
-				mpDistribution = MakeUnique<Sampling::Distribution2D>(mLuminance.Data(), width, height);
+				return prob * mBaseWidth * mBaseHeight;
 			}
 
 			inline float ApplyRotation(const float phi, const float scl = 1.0f) const
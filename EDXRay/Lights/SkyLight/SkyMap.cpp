@@ -0,0 +1,275 @@
+#include "SkyMap.h"
+#include "ArHosekSkyModel.h"
+
+#include <cstdio>
+#include <ppl.h>
+using namespace concurrency;
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		static const float SKY_RADIANCE_SCALE = 0.025f;
+
+		void SkyMapCache::Get(const SkyMapDesc& desc, SkyMap* pMap)
+		{
+			Assert(pMap);
+
+			{
+				ScopeLock lock(&mCS);
+				for (auto i = 0; i < mNumEntries; i++)
+				{
+					if (mEntries[i].Desc == desc)
+					{
+						mLastUse[i] = ++mUseCount;
+						*pMap = mEntries[i];
+						return;
+					}
+				}
+			}
+
+			// Generate outside the lock, a concurrent miss on the same desc only costs a duplicated evaluation
+			if (!LoadFile(desc, pMap))
+			{
+				Generate(desc, pMap);
+				SaveFile(*pMap);
+			}
+
+			ScopeLock lock(&mCS);
+			int slot = 0;
+			if (mNumEntries < MAX_ENTRIES)
+			{
+				slot = mNumEntries++;
+			}
+			else
+			{
+				for (auto i = 1; i < MAX_ENTRIES; i++)
+				{
+					if (mLastUse[i] < mLastUse[slot])
+						slot = i;
+				}
+			}
+
+			mEntries[slot] = *pMap;
+			mLastUse[slot] = ++mUseCount;
+		}
+
+		void SkyMapCache::SetCacheDirectory(const char* path)
+		{
+			ScopeLock lock(&mCS);
+			CStringUtil::Strcpy(mCacheDirectory, MAX_PATH, path ? path : "");
+		}
+
+		void SkyMapCache::Clear()
+		{
+			ScopeLock lock(&mCS);
+			for (auto i = 0; i < mNumEntries; i++)
+				mEntries[i].Radiance.Clear();
+
+			mNumEntries = 0;
+		}
+
+		void SkyMapCache::Generate(const SkyMapDesc& desc, SkyMap* pMap)
+		{
+			static const int NUM_CHANNELS = 3;
+
+			const int resX = desc.ResX;
+			const int resY = desc.ResY;
+			const float sunElevationRad = Math::ToRadians(desc.SunElevation);
+			const float sunZenith = float(Math::EDX_PI_2) - sunElevationRad;
+
+			ArHosekSkyModelState* skyModelState[NUM_CHANNELS];
+			for (auto i = 0; i < NUM_CHANNELS; i++)
+				skyModelState[i] = arhosek_rgb_skymodelstate_alloc_init(desc.Turbidity[i], desc.GroundAlbedo[i], sunElevationRad);
+
+			// Model coefficients in single precision, indexed as in ArHosekSkyModel_GetRadianceInternal
+			float config[NUM_CHANNELS][9];
+			float channelScale[NUM_CHANNELS];
+			for (auto i = 0; i < NUM_CHANNELS; i++)
+			{
+				for (auto j = 0; j < 9; j++)
+					config[i][j] = float(skyModelState[i]->configs[i][j]);
+
+				channelScale[i] = float(skyModelState[i]->radiances[i]) * SKY_RADIANCE_SCALE;
+			}
+
+			// cos(phi - pi) only depends on the column
+			Array<float> cosPhi;
+			cosPhi.Resize(resX);
+			for (auto x = 0; x < resX; x++)
+			{
+				const float phi = (x + 0.5f) / float(resX) * float(Math::EDX_TWO_PI);
+				cosPhi[x] = Math::Cos(phi - float(Math::EDX_PI));
+			}
+
+			const float cosSunZenith = Math::Cos(sunZenith);
+			const float sinSunZenith = Math::Sin(sunZenith);
+
+			pMap->Desc = desc;
+			pMap->Radiance.Init(Color::BLACK, resX * resY);
+
+			// Only the upper hemisphere is evaluated, the ground stays black
+			const int skyRows = (resY + 1) / 2;
+			parallel_for(0, skyRows, [&](int y)
+			{
+				const float theta = (y + 0.5f) / float(resY) * float(Math::EDX_PI);
+				const float cosTheta = Math::Cos(theta);
+				const float sinTheta = Math::Sin(theta);
+				const float zenith = Math::Sqrt(cosTheta);
+
+				Array<float> gamma, cosGamma, radiance;
+				gamma.Resize(resX);
+				cosGamma.Resize(resX);
+				radiance.Resize(resX);
+
+				// Branch free loops over plain arrays so that they vectorize
+				float* pGamma = gamma.Data();
+				float* pCosGamma = cosGamma.Data();
+				for (auto x = 0; x < resX; x++)
+				{
+					const float c = Math::Clamp(cosTheta * cosSunZenith + sinTheta * sinSunZenith * cosPhi[x], -1.0f, 1.0f);
+					pCosGamma[x] = c;
+					pGamma[x] = acosf(c);
+				}
+
+				Color* pRow = pMap->Radiance.Data() + y * resX;
+				float* pRadiance = radiance.Data();
+				for (auto i = 0; i < NUM_CHANNELS; i++)
+				{
+					const float* A = config[i];
+					const float rowTerm = (1.0f + A[0] * expf(A[1] / (cosTheta + 0.01f))) * channelScale[i];
+					const float constTerm = A[2] + A[7] * zenith;
+					const float mieBase = 1.0f + A[8] * A[8];
+
+					for (auto x = 0; x < resX; x++)
+					{
+						const float c = pCosGamma[x];
+						const float expM = expf(A[4] * pGamma[x]);
+						const float rayM = c * c;
+						const float mieDenom = mieBase - 2.0f * A[8] * c;
+						const float mieM = (1.0f + rayM) / (mieDenom * sqrtf(mieDenom));
+
+						pRadiance[x] = rowTerm * (constTerm + A[3] * expM + A[5] * rayM + A[6] * mieM);
+					}
+
+					for (auto x = 0; x < resX; x++)
+						pRow[x][i] = pRadiance[x];
+				}
+			});
+
+			// Disc averaged direct solar radiance from the spectral model, converted to the units of the RGB model
+			// through the ratio of both models at the zenith
+			pMap->HasSun = sunElevationRad > 0.0f;
+			pMap->SunRadiance = Color::BLACK;
+			pMap->SunRadius = 0.0f;
+			if (pMap->HasSun)
+			{
+				static const double Wavelengths[NUM_CHANNELS] = { 610.0, 550.0, 465.0 };
+				static const int NUM_RINGS = 8;
+
+				for (auto i = 0; i < NUM_CHANNELS; i++)
+				{
+					ArHosekSkyModelState* pSpectralState = arhosekskymodelstate_alloc_init(sunElevationRad, desc.Turbidity[i], desc.GroundAlbedo[i]);
+					const double solarRadius = pSpectralState->solar_radius;
+
+					double direct = 0.0;
+					for (auto ring = 0; ring < NUM_RINGS; ring++)
+					{
+						const double gamma = solarRadius * sqrt((ring + 0.5) / double(NUM_RINGS));
+						direct += arhosekskymodel_solar_radiance(pSpectralState, sunZenith, gamma, Wavelengths[i]) -
+							arhosekskymodel_radiance(pSpectralState, sunZenith, gamma, Wavelengths[i]);
+					}
+					direct /= double(NUM_RINGS);
+
+					const double zenithSpectral = arhosekskymodel_radiance(pSpectralState, 0.0, sunZenith, Wavelengths[i]);
+					const double zenithRGB = arhosek_tristim_skymodel_radiance(skyModelState[i], 0.0, sunZenith, i) * SKY_RADIANCE_SCALE;
+					pMap->SunRadiance[i] = zenithSpectral > 0.0 ? float(Math::Max(0.0, direct) * zenithRGB / zenithSpectral) : 0.0f;
+					pMap->SunRadius = float(solarRadius);
+
+					arhosekskymodelstate_free(pSpectralState);
+				}
+			}
+
+			for (auto i = 0; i < NUM_CHANNELS; i++)
+				arhosekskymodelstate_free(skyModelState[i]);
+		}
+
+		void SkyMapCache::GetFilePath(const SkyMapDesc& desc, char* path) const
+		{
+			// FNV-1a over the parameters, the header keeps the full desc to reject collisions
+			const unsigned char* pBytes = reinterpret_cast<const unsigned char*>(&desc);
+			uint hash = 2166136261u;
+			for (auto i = 0; i < int(sizeof(SkyMapDesc)); i++)
+			{
+				hash ^= pBytes[i];
+				hash *= 16777619u;
+			}
+
+			sprintf_s(path, MAX_PATH, "%s/Sky_%08x.bin", mCacheDirectory, hash);
+		}
+
+		bool SkyMapCache::LoadFile(const SkyMapDesc& desc, SkyMap* pMap) const
+		{
+			if (mCacheDirectory[0] == '\0')
+				return false;
+
+			char path[MAX_PATH];
+			GetFilePath(desc, path);
+
+			FILE* pFile = nullptr;
+			if (fopen_s(&pFile, path, "rb") != 0 || !pFile)
+				return false;
+
+			FileHeader header;
+			bool succeeded = fread(&header, sizeof(FileHeader), 1, pFile) == 1 &&
+				header.Magic == FileHeader::MAGIC &&
+				header.Version == FileHeader::VERSION &&
+				header.Desc == desc;
+
+			if (succeeded)
+			{
+				const uint size = desc.ResX * desc.ResY;
+				pMap->Desc = desc;
+				pMap->HasSun = header.HasSun != 0;
+				pMap->SunRadiance = header.SunRadiance;
+				pMap->SunRadius = header.SunRadius;
+				pMap->Radiance.Resize(size);
+				succeeded = fread(pMap->Radiance.Data(), sizeof(Color), size, pFile) == size;
+			}
+
+			fclose(pFile);
+			return succeeded;
+		}
+
+		bool SkyMapCache::SaveFile(const SkyMap& map) const
+		{
+			if (mCacheDirectory[0] == '\0')
+				return false;
+
+			char path[MAX_PATH];
+			GetFilePath(map.Desc, path);
+
+			FILE* pFile = nullptr;
+			if (fopen_s(&pFile, path, "wb") != 0 || !pFile)
+				return false;
+
+			FileHeader header;
+			header.Magic = FileHeader::MAGIC;
+			header.Version = FileHeader::VERSION;
+			header.Desc = map.Desc;
+			header.HasSun = map.HasSun ? 1 : 0;
+			header.SunRadiance = map.SunRadiance;
+			header.SunRadius = map.SunRadius;
+
+			bool succeeded = fwrite(&header, sizeof(FileHeader), 1, pFile) == 1 &&
+				fwrite(map.Radiance.Data(), sizeof(Color), map.Radiance.Size(), pFile) == map.Radiance.Size();
+
+			fclose(pFile);
+
+			if (!succeeded)
+				remove(path);
+
+			return succeeded;
+		}
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Graphics/Color.h"
+
+#include "Windows/Threading.h"
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		struct SkyMapDesc
+		{
+			Color Turbidity;
+			Color GroundAlbedo;
+			float SunElevation; // In degrees
+			int ResX, ResY;
+
+			bool operator == (const SkyMapDesc& rhs) const
+			{
+				for (auto i = 0; i < 3; i++)
+				{
+					if (Turbidity[i] != rhs.Turbidity[i] || GroundAlbedo[i] != rhs.GroundAlbedo[i])
+						return false;
+				}
+
+				return SunElevation == rhs.SunElevation && ResX == rhs.ResX && ResY == rhs.ResY;
+			}
+		};
+
+		// Latitude-longitude radiance of the Hosek sky model with the sun at phi = pi, and the analytic sun disc
+		// that goes with it
+		struct SkyMap
+		{
+			SkyMapDesc Desc;
+			Array<Color> Radiance;
+			bool HasSun;
+			Color SunRadiance;
+			float SunRadius;
+		};
+
+		// Sky maps keyed by their parameters, so that revisiting a sky setting does not evaluate the model again.
+		// Generated maps are also written to the cache directory when one is set
+		class SkyMapCache
+		{
+		private:
+			struct FileHeader
+			{
+				static const uint MAGIC = 0x53584445; // "EDXS"
+				static const uint VERSION = 1;
+
+				uint Magic;
+				uint Version;
+				SkyMapDesc Desc;
+				int HasSun;
+				Color SunRadiance;
+				float SunRadius;
+			};
+
+			static const int MAX_ENTRIES = 8;
+
+			SkyMap mEntries[MAX_ENTRIES];
+			uint mLastUse[MAX_ENTRIES];
+			int mNumEntries;
+			uint mUseCount;
+			char mCacheDirectory[MAX_PATH];
+			CriticalSection mCS;
+
+		public:
+			SkyMapCache()
+				: mNumEntries(0)
+				, mUseCount(0)
+			{
+				mCacheDirectory[0] = '\0';
+			}
+
+			static SkyMapCache* Instance()
+			{
+				static SkyMapCache instance;
+				return &instance;
+			}
+
+			// Copies the map described by desc to pMap, generating it on a miss
+			void Get(const SkyMapDesc& desc, SkyMap* pMap);
+
+			// An empty path disables the disk cache
+			void SetCacheDirectory(const char* path);
+			void Clear();
+
+			static void Generate(const SkyMapDesc& desc, SkyMap* pMap);
+
+		private:
+			void GetFilePath(const SkyMapDesc& desc, char* path) const;
+			bool LoadFile(const SkyMapDesc& desc, SkyMap* pMap) const;
+			bool SaveFile(const SkyMap& map) const;
+		};
+	}
+}
@@ -0,0 +1,320 @@
+#include "Grid.h"
+#include "../Core/Sampler.h"
+#include "../Core/DifferentialGeom.h"
+#include "../Core/Ray.h"
+#include "Math/EDXMath.h"
+#include "SIMD/SSE.h"
+
+#include <cstdio>
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		GridMedium::GridMedium(const BoundingBox& bounds,
+			const int resX,
+			const int resY,
+			const int resZ,
+			const float* pDensity,
+			const Vector3& sigmaS,
+			const Vector3& sigmaA,
+			const float phaseG)
+			: Medium(phaseG)
+			, mSigmaS(sigmaS)
+			, mSigmaA(sigmaA)
+			, mBounds(bounds)
+		{
+			mSigmaT = mSigmaS + mSigmaA;
+			mMaxSigmaT = Math::Max(mSigmaT.x, Math::Max(mSigmaT.y, mSigmaT.z));
+
+			const Vector3 extent = mBounds.mMax - mBounds.mMin;
+			mInvExtent = Vector3(1.0f / extent.x, 1.0f / extent.y, 1.0f / extent.z);
+
+			mRes[0] = resX;
+			mRes[1] = resY;
+			mRes[2] = resZ;
+
+			const int numVoxels = resX * resY * resZ;
+			mDensity.Resize(numVoxels);
+			for (auto i = 0; i < numVoxels; i++)
+				mDensity[i] = pDensity[i];
+
+			BuildMajorants();
+		}
+
+		GridMedium* GridMedium::LoadFromFile(const char* path,
+			const BoundingBox& bounds,
+			const Vector3& sigmaS,
+			const Vector3& sigmaA,
+			const float phaseG)
+		{
+			FILE* pFile = nullptr;
+			if (fopen_s(&pFile, path, "rb") != 0 || !pFile)
+				return nullptr;
+
+			FileHeader header;
+			bool succeeded = fread(&header, sizeof(FileHeader), 1, pFile) == 1 &&
+				header.Magic == FileHeader::MAGIC &&
+				header.Version == FileHeader::VERSION &&
+				header.ResX > 0 && header.ResY > 0 && header.ResZ > 0;
+
+			Array<float> density;
+			if (succeeded)
+			{
+				const uint numVoxels = header.ResX * header.ResY * header.ResZ;
+				if (!header.Sparse)
+				{
+					density.Resize(numVoxels);
+					succeeded = fread(density.Data(), sizeof(float), numVoxels, pFile) == numVoxels;
+				}
+				else
+				{
+					density.Init(0.0f, numVoxels);
+
+					Array<SparseValue> values;
+					values.Resize(header.NumValues);
+					succeeded = fread(values.Data(), sizeof(SparseValue), header.NumValues, pFile) == header.NumValues;
+					for (auto i = 0; succeeded && i < int(header.NumValues); i++)
+					{
+						succeeded = values[i].Index < numVoxels;
+						if (succeeded)
+							density[values[i].Index] = values[i].Density;
+					}
+				}
+			}
+
+			fclose(pFile);
+
+			if (!succeeded)
+				return nullptr;
+
+			return new GridMedium(bounds, header.ResX, header.ResY, header.ResZ, density.Data(), sigmaS, sigmaA, phaseG);
+		}
+
+		void GridMedium::BuildMajorants()
+		{
+			for (auto a = 0; a < 3; a++)
+				mMajorantRes[a] = Math::Max(1, (mRes[a] + MAJORANT_CELL_SIZE - 1) / MAJORANT_CELL_SIZE);
+
+			mMajorants.Resize(mMajorantRes[0] * mMajorantRes[1] * mMajorantRes[2]);
+
+			for (auto z = 0; z < mMajorantRes[2]; z++)
+			{
+				for (auto y = 0; y < mMajorantRes[1]; y++)
+				{
+					for (auto x = 0; x < mMajorantRes[0]; x++)
+					{
+						// Lookups inside the cell interpolate between voxel centers, so the voxel range is widened by
+						// one on each side
+						const int cell[3] = { x, y, z };
+						int voxelMin[3], voxelMax[3];
+						for (auto a = 0; a < 3; a++)
+						{
+							voxelMin[a] = Math::Max(0, Math::FloorToInt(cell[a] * mRes[a] / float(mMajorantRes[a]) - 0.5f));
+							voxelMax[a] = Math::Min(mRes[a] - 1, Math::FloorToInt((cell[a] + 1) * mRes[a] / float(mMajorantRes[a]) - 0.5f) + 1);
+						}
+
+						float maxDensity = 0.0f;
+						for (auto vz = voxelMin[2]; vz <= voxelMax[2]; vz++)
+						{
+							for (auto vy = voxelMin[1]; vy <= voxelMax[1]; vy++)
+							{
+								for (auto vx = voxelMin[0]; vx <= voxelMax[0]; vx++)
+									maxDensity = Math::Max(maxDensity, Voxel(vx, vy, vz));
+							}
+						}
+
+						mMajorants[(z * mMajorantRes[1] + y) * mMajorantRes[0] + x] = maxDensity * mMaxSigmaT;
+					}
+				}
+			}
+		}
+
+		float GridMedium::Density(const Vector3& pos) const
+		{
+			// Densities are stored at voxel centers
+			const float gx = (pos.x - mBounds.mMin.x) * mInvExtent.x * mRes[0] - 0.5f;
+			const float gy = (pos.y - mBounds.mMin.y) * mInvExtent.y * mRes[1] - 0.5f;
+			const float gz = (pos.z - mBounds.mMin.z) * mInvExtent.z * mRes[2] - 0.5f;
+			const int x = Math::FloorToInt(gx);
+			const int y = Math::FloorToInt(gy);
+			const int z = Math::FloorToInt(gz);
+			const float fx = gx - x;
+			const float fy = gy - y;
+			const float fz = gz - z;
+
+			// The four columns of the cell are interpolated along z together, then weighted bilinearly in x and y
+			const FloatSSE lower = FloatSSE(Voxel(x, y, z), Voxel(x + 1, y, z), Voxel(x, y + 1, z), Voxel(x + 1, y + 1, z));
+			const FloatSSE upper = FloatSSE(Voxel(x, y, z + 1), Voxel(x + 1, y, z + 1), Voxel(x, y + 1, z + 1), Voxel(x + 1, y + 1, z + 1));
+			const FloatSSE columns = lower + (upper - lower) * FloatSSE(fz);
+			const FloatSSE weights = FloatSSE((1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy);
+
+			const FloatSSE weighted = columns * weights;
+			return weighted[0] + weighted[1] + weighted[2] + weighted[3];
+		}
+
+		template<typename Func>
+		void GridMedium::TraverseMajorants(const Ray& ray, Func func) const
+		{
+			// Clip the ray segment against the bounds
+			float tNear = 0.0f;
+			float tFar = ray.mMax;
+			for (auto a = 0; a < 3; a++)
+			{
+				const float invDir = 1.0f / ray.mDir[a];
+				float t0 = (mBounds.mMin[a] - ray.mOrg[a]) * invDir;
+				float t1 = (mBounds.mMax[a] - ray.mOrg[a]) * invDir;
+				if (t0 > t1)
+				{
+					const float temp = t0;
+					t0 = t1;
+					t1 = temp;
+				}
+
+				tNear = t0 > tNear ? t0 : tNear;
+				tFar = t1 < tFar ? t1 : tFar;
+				if (tNear > tFar)
+					return;
+			}
+
+			// 3D-DDA in units of majorant cells
+			int cell[3], step[3];
+			float nextT[3], deltaT[3];
+			for (auto a = 0; a < 3; a++)
+			{
+				const float scale = mInvExtent[a] * mMajorantRes[a];
+				const float entry = (ray.mOrg[a] + tNear * ray.mDir[a] - mBounds.mMin[a]) * scale;
+				const float dir = ray.mDir[a] * scale;
+
+				cell[a] = Math::Clamp(Math::FloorToInt(entry), 0, mMajorantRes[a] - 1);
+				if (dir == 0.0f)
+				{
+					step[a] = 0;
+					nextT[a] = float(Math::EDX_INFINITY);
+					deltaT[a] = float(Math::EDX_INFINITY);
+				}
+				else if (dir > 0.0f)
+				{
+					step[a] = 1;
+					nextT[a] = tNear + (cell[a] + 1 - entry) / dir;
+					deltaT[a] = 1.0f / dir;
+				}
+				else
+				{
+					step[a] = -1;
+					nextT[a] = tNear + (cell[a] - entry) / dir;
+					deltaT[a] = -1.0f / dir;
+				}
+			}
+
+			float t = tNear;
+			while (true)
+			{
+				const int axis = nextT[0] < nextT[1] ?
+					(nextT[0] < nextT[2] ? 0 : 2) :
+					(nextT[1] < nextT[2] ? 1 : 2);
+
+				const float cellExit = Math::Min(nextT[axis], tFar);
+				const float majorant = mMajorants[(cell[2] * mMajorantRes[1] + cell[1]) * mMajorantRes[0] + cell[0]];
+				if (!func(t, cellExit, majorant))
+					return;
+
+				if (nextT[axis] >= tFar)
+					return;
+
+				t = nextT[axis];
+				cell[axis] += step[axis];
+				if (cell[axis] < 0 || cell[axis] >= mMajorantRes[axis])
+					return;
+
+				nextT[axis] += deltaT[axis];
+			}
+		}
+
+		Color GridMedium::Transmittance(const Ray& ray, Sampler* pSampler) const
+		{
+			// Ratio tracking, every tentative collision scales the estimate by the null collision probability
+			Vector3 transmittance = Vector3(1.0f, 1.0f, 1.0f);
+			TraverseMajorants(ray, [&](const float t0, const float t1, const float majorant)
+			{
+				if (majorant <= 0.0f)
+					return true;
+
+				float t = t0;
+				while (true)
+				{
+					t -= Math::Log(1 - pSampler->Get1D()) / majorant;
+					if (t >= t1)
+						return true;
+
+					const float density = Density(ray.CalcPoint(t));
+					transmittance = transmittance * (Vector3(1.0f, 1.0f, 1.0f) - (density / majorant) * mSigmaT);
+
+					// Russian roulette keeps long rays through dense regions from tracking negligible estimates
+					const float maxTransmittance = Math::Max(transmittance.x, Math::Max(transmittance.y, transmittance.z));
+					if (maxTransmittance < 0.1f)
+					{
+						const float continueProb = 0.25f;
+						if (pSampler->Get1D() >= continueProb)
+						{
+							transmittance = Vector3::ZERO;
+							return false;
+						}
+
+						transmittance = transmittance / continueProb;
+					}
+				}
+			});
+
+			return Color(transmittance);
+		}
+
+		Color GridMedium::Sample(const Ray& ray, Sampler* pSampler, MediumScatter* pMS) const
+		{
+			// Delta tracking against the scalar majorant. With colored extinction the choice between real and null
+			// collisions follows the channel average of the throughput weighted coefficients, and the per channel
+			// ratios are carried in the returned weight. Absorption is accounted for in the weight as well
+			Vector3 weight = Vector3(1.0f, 1.0f, 1.0f);
+			TraverseMajorants(ray, [&](const float t0, const float t1, const float majorant)
+			{
+				if (majorant <= 0.0f)
+					return true;
+
+				float t = t0;
+				while (true)
+				{
+					t -= Math::Log(1 - pSampler->Get1D()) / majorant;
+					if (t >= t1)
+						return true;
+
+					const Vector3 pos = ray.CalcPoint(t);
+					const float density = Density(pos);
+					const Vector3 sigmaS = density * mSigmaS;
+					const Vector3 sigmaN = Vector3(majorant, majorant, majorant) - density * mSigmaT;
+
+					const Vector3 scatterTerm = sigmaS * weight;
+					const Vector3 nullTerm = sigmaN * weight;
+					const float scatterEnergy = scatterTerm.x + scatterTerm.y + scatterTerm.z;
+					const float nullEnergy = nullTerm.x + nullTerm.y + nullTerm.z;
+					if (scatterEnergy + nullEnergy <= 0.0f)
+					{
+						weight = Vector3::ZERO;
+						return false;
+					}
+
+					const float scatterProb = scatterEnergy / (scatterEnergy + nullEnergy);
+					if (pSampler->Get1D() < scatterProb)
+					{
+						weight = weight * sigmaS / (majorant * scatterProb);
+						*pMS = MediumScatter(pos, mpPhaseFunc.Get(), MediumInterface(ray.mpMedium));
+						return false;
+					}
+
+					weight = weight * sigmaN / (majorant * (1.0f - scatterProb));
+				}
+			});
+
+			return Color(weight);
+		}
+	}
+}
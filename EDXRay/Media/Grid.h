@@ -0,0 +1,84 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "../ForwardDecl.h"
+
+#include "../Core/Medium.h"
+#include "Math/BoundingBox.h"
+#include "Graphics/Color.h"
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		// Heterogeneous medium with densities on a voxel grid spanning a world space box, scaling the given
+		// scattering and absorption coefficients. Free paths are sampled with delta tracking and transmittance is
+		// estimated with ratio tracking, both against the bounds stored in a coarse majorant grid
+		class GridMedium : public Medium
+		{
+		private:
+			// Voxel file layout: the header, then ResX * ResY * ResZ floats with x varying fastest for dense files,
+			// or NumValues pairs of (linear voxel index, density) for sparse ones
+			struct FileHeader
+			{
+				static const uint MAGIC = 0x56584445; // "EDXV"
+				static const uint VERSION = 1;
+
+				uint Magic;
+				uint Version;
+				int ResX, ResY, ResZ;
+				int Sparse;
+				uint NumValues;
+			};
+
+			struct SparseValue
+			{
+				uint Index;
+				float Density;
+			};
+
+			// Number of voxels per majorant cell along each axis
+			static const int MAJORANT_CELL_SIZE = 8;
+
+			Vector3 mSigmaS, mSigmaA, mSigmaT;
+			float mMaxSigmaT;
+
+			BoundingBox mBounds;
+			Vector3 mInvExtent;
+			int mRes[3];
+			Array<float> mDensity;
+
+			// Largest extinction of any channel within each coarse cell, including the voxels it interpolates from
+			int mMajorantRes[3];
+			Array<float> mMajorants;
+
+		public:
+			GridMedium(const BoundingBox& bounds, const int resX, const int resY, const int resZ, const float* pDensity,
+				const Vector3& sigmaS, const Vector3& sigmaA, const float phaseG);
+
+			// Returns nullptr if the file is missing or malformed
+			static GridMedium* LoadFromFile(const char* path, const BoundingBox& bounds,
+				const Vector3& sigmaS, const Vector3& sigmaA, const float phaseG);
+
+			Color Transmittance(const Ray& ray, Sampler*pSampler) const override;
+			Color Sample(const Ray& ray, Sampler* pSampler, MediumScatter* pMS) const override;
+
+		private:
+			void BuildMajorants();
+			float Density(const Vector3& pos) const;
+
+			float Voxel(const int x, const int y, const int z) const
+			{
+				if (x < 0 || y < 0 || z < 0 || x >= mRes[0] || y >= mRes[1] || z >= mRes[2])
+					return 0.0f;
+
+				return mDensity[(z * mRes[1] + y) * mRes[0] + x];
+			}
+
+			// Calls func(t0, t1, majorant) for the majorant cells overlapped by the ray in front to back order, until
+			// func returns false
+			template<typename Func>
+			void TraverseMajorants(const Ray& ray, Func func) const;
+		};
+	}
+}
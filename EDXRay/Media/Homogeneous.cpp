@@ -38,5 +38,17 @@ namespace EDX
 
 			return sampledMedium ? Color(transmittance * mSigmaS / pdf) : Color(transmittance / pdf);
 		}
+
+		bool HomogeneousMedium::EvalScattering(const Ray& ray, const float dist, Color* pTransmittance, Color* pSigmaS, float* pPdf) const
+		{
+			Vector3 transmittance = Math::Exp((-1.0f * mSigmaT) * dist);
+			Vector3 density = mSigmaT * transmittance;
+
+			*pTransmittance = Color(transmittance);
+			*pSigmaS = Color(mSigmaS);
+			*pPdf = (density.x + density.y + density.z) / 3.0f;
+
+			return true;
+		}
 	}
 }
\ No newline at end of file
@@ -38,6 +38,7 @@ namespace EDX
 
 			Color Transmittance(const Ray& ray, Sampler*pSampler) const override;
 			Color Sample(const Ray& ray, Sampler* pSampler, MediumScatter* pMS) const override;
+			bool EvalScattering(const Ray& ray, const float dist, Color* pTransmittance, Color* pSigmaS, float* pPdf) const override;
 
 			Color GetDiffuseReflectance() const
 			{
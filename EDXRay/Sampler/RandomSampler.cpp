@@ -46,6 +46,13 @@ namespace EDX
 			return Sample(mRandom);
 		}
 
+		void RandomSampler::GetSampleVector(const int* pGroupSizes, const int numGroups, float* pSamples)
+		{
+			const int numDimensions = NumDimensions(pGroupSizes, numGroups);
+			for (auto i = 0; i < numDimensions; i++)
+				pSamples[i] = mRandom.Float();
+		}
+
 		UniquePtr<Sampler> RandomSampler::Clone(const int seed) const
 		{
 			return MakeUnique<RandomSampler>(seed);
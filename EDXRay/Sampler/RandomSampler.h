@@ -7,7 +7,7 @@ namespace EDX
 {
 	namespace RayTracer
 	{
-		class RandomSampler : public Sampler
+		class RandomSampler final : public Sampler
 		{
 		private:
 			RandomGen mRandom;
@@ -31,6 +31,7 @@ namespace EDX
 			float Get1D() override;
 			Vector2 Get2D() override;
 			Sample GetSample() override;
+			void GetSampleVector(const int* pGroupSizes, const int numGroups, float* pSamples) override;
 
 			UniquePtr<Sampler> Clone(const int seed) const override;
 		};
@@ -1,13 +1,50 @@
-
 #include "SobolSampler.h"
 #include "SobolMatrices.h"
 
 #include "Math/Vec2.h"
+#include "SIMD/SSE.h"
 
 namespace EDX
 {
 	namespace RayTracer
 	{
+		namespace
+		{
+			// Generator matrices stored with the column of one index bit contiguous across dimensions,
+			// so that a set bit updates four dimensions with a single xor
+			struct TransposedSobolMatrices
+			{
+				uint32 Columns[SobolMatrixSize][NumSobolDimensions];
+
+				TransposedSobolMatrices()
+				{
+					for (auto bit = 0; bit < SobolMatrixSize; bit++)
+					{
+						for (auto dim = 0; dim < NumSobolDimensions; dim++)
+							Columns[bit][dim] = SobolMatrices32[dim * SobolMatrixSize + SobolMatrixSize - 1 - bit];
+					}
+				}
+			};
+
+			const TransposedSobolMatrices& GetTransposedMatrices()
+			{
+				static TransposedSobolMatrices matrices;
+				return matrices;
+			}
+
+			inline __m128i XorColumns(__m128i values, uint64 index, const int offset)
+			{
+				const TransposedSobolMatrices& matrices = GetTransposedMatrices();
+				for (int bit = 0; index != 0 && bit < SobolMatrixSize; index >>= 1, bit++)
+				{
+					if (index & 1)
+						values = _mm_xor_si128(values, _mm_loadu_si128((const __m128i*)(matrices.Columns[bit] + offset)));
+				}
+
+				return values;
+			}
+		}
+
 		void SobolSampler::GenerateSamples(
 			const int pixelX,
 			const int pixelY,
@@ -16,34 +53,42 @@ namespace EDX
 		{
 			Assert(pSamples);
 
-			pSamples->imageX = SobolSample(mSobolIndex, mDimension++) * mResolution - pixelX;
-			pSamples->imageY = SobolSample(mSobolIndex, mDimension++) * mResolution - pixelY;
-			pSamples->lensU = SobolSample(mSobolIndex, mDimension++);
-			pSamples->lensV = SobolSample(mSobolIndex, mDimension++);
-			pSamples->time = SobolSample(mSobolIndex, mDimension++);
+			pSamples->imageX = SobolSample(mDimension++) * mResolution - pixelX;
+			pSamples->imageY = SobolSample(mDimension++) * mResolution - pixelY;
+			pSamples->lensU = SobolSample(mDimension++);
+			pSamples->lensV = SobolSample(mDimension++);
+			pSamples->time = SobolSample(mDimension++);
 		}
 
 		void SobolSampler::AdvanceSampleIndex()
 		{
 			mSampleIndex++;
+			UpdatePassValues();
+		}
+
+		void SobolSampler::SetSampleIndex(const uint64 index)
+		{
+			mSampleIndex = index;
+			UpdatePassValues();
 		}
 
 		void SobolSampler::StartPixel(const int pixelX, const int pixelY)
 		{
-			mSobolIndex = EnumerateSampleIndex(pixelX, pixelY);
+			mPixelIndex = mpPixelIndexX[pixelX] ^ mpPixelIndexY[pixelY];
 			mDimension = 0;
+			mCachedBlock = -1;
 		}
 
 		float SobolSampler::Get1D()
 		{
-			return SobolSample(mSobolIndex, mDimension++);
+			return SobolSample(mDimension++);
 		}
 
 		Vector2 SobolSampler::Get2D()
 		{
 			int dim = mDimension;
-			Vector2 ret = Vector2(SobolSample(mSobolIndex, dim),
-				SobolSample(mSobolIndex, dim + 1));
+			Vector2 ret = Vector2(SobolSample(dim),
+				SobolSample(dim + 1));
 			mDimension += 2;
 
 			return ret;
@@ -54,62 +99,114 @@ namespace EDX
 			int dim = mDimension;
 
 			Sample ret;
-			ret.u = SobolSample(mSobolIndex, dim);
-			ret.v = SobolSample(mSobolIndex, dim + 1);
-			ret.w = SobolSample(mSobolIndex, dim + 2);
+			ret.u = SobolSample(dim);
+			ret.v = SobolSample(dim + 1);
+			ret.w = SobolSample(dim + 2);
 
 			mDimension += 3;
 
 			return ret;
 		}
 
-		UniquePtr<Sampler> SobolSampler::Clone(const int seed) const
+		void SobolSampler::GetSampleVector(const int* pGroupSizes, const int numGroups, float* pSamples)
 		{
-			return MakeUnique<SobolSampler>(mResolution, mLogTwoResolution, mScramble, mSampleIndex);
+			// Groups are consecutive dimensions here, the whole vector comes from the cached 4-wide blocks
+			const int numDimensions = NumDimensions(pGroupSizes, numGroups);
+			for (auto i = 0; i < numDimensions; i++)
+				pSamples[i] = SobolSample(mDimension + i);
+
+			mDimension += numDimensions;
 		}
 
-		uint64 SobolSampler::EnumerateSampleIndex(const uint pixelX, const uint pixelY) const
+		UniquePtr<Sampler> SobolSampler::Clone(const int seed) const
 		{
-			if (mLogTwoResolution == 0)
-				return 0;
+			return MakeUnique<SobolSampler>(*this, seed);
+		}
 
-			const uint m2 = mLogTwoResolution << 1;
-			uint64 sampleIndex = mSampleIndex;
-			uint64 index = uint64(sampleIndex) << m2;
+		void SobolSampler::InitPixelTables()
+		{
+			mPixelIndexX.Resize(mResolution);
+			mPixelIndexY.Resize(mResolution);
 
-			uint64 delta = 0;
-			for (int c = 0; sampleIndex; sampleIndex >>= 1, c++)
+			for (auto i = 0; i < mResolution; i++)
 			{
-				if (sampleIndex & 1)  // Add flipped column m + c + 1.
-					delta ^= VdCSobolMatrices[mLogTwoResolution - 1][c];
+				uint64 indexX = 0, indexY = 0;
+				if (mLogTwoResolution > 0)
+				{
+					// Inverse of the flipped van der Corput matrix applied to the pixel coordinates (x << m) | y
+					uint64 bx = uint64(i) << mLogTwoResolution;
+					for (int c = 0; bx; bx >>= 1, c++)
+						if (bx & 1)
+							indexX ^= VdCSobolMatricesInv[mLogTwoResolution - 1][c];
+
+					uint64 by = uint64(i);
+					for (int c = 0; by; by >>= 1, c++)
+						if (by & 1)
+							indexY ^= VdCSobolMatricesInv[mLogTwoResolution - 1][c];
+				}
+
+				mPixelIndexX[i] = indexX;
+				mPixelIndexY[i] = indexY;
 			}
 
-			// Flipped b
-			uint64 b = (((uint64)pixelX << mLogTwoResolution) | pixelY) ^ delta;
+			mpPixelIndexX = mPixelIndexX.Data();
+			mpPixelIndexY = mPixelIndexY.Data();
+		}
+
+		void SobolSampler::UpdatePassValues()
+		{
+			uint64 index = 0;
+			if (mLogTwoResolution > 0)
+			{
+				const uint m2 = mLogTwoResolution << 1;
+				uint64 sampleIndex = mSampleIndex;
+				index = sampleIndex << m2;
+
+				uint64 delta = 0;
+				for (int c = 0; sampleIndex; sampleIndex >>= 1, c++)
+				{
+					if (sampleIndex & 1)  // Add flipped column m + c + 1.
+						delta ^= VdCSobolMatrices[mLogTwoResolution - 1][c];
+				}
 
-			for (int c = 0; b; b >>= 1, c++)
-				if (b & 1)  // Add column 2 * m - c.
-					index ^= VdCSobolMatricesInv[mLogTwoResolution - 1][c];
+				// The pixel part of the flipped b lives in the pixel tables
+				for (int c = 0; delta; delta >>= 1, c++)
+					if (delta & 1)  // Add column 2 * m - c.
+						index ^= VdCSobolMatricesInv[mLogTwoResolution - 1][c];
+			}
 
-			return index;
+			mPassValues.Resize(NumSobolDimensions);
+			const __m128i scramble = _mm_set1_epi32(int(uint32(mScramble)));
+			for (auto offset = 0; offset < NumSobolDimensions; offset += 4)
+			{
+				__m128i values = XorColumns(scramble, index, offset);
+				_mm_storeu_si128((__m128i*)(mPassValues.Data() + offset), values);
+			}
+
+			mpPassValues = mPassValues.Data();
+			mCachedBlock = -1;
 		}
 
-		float SobolSampler::SobolSample(const int64 index, const int dimension) const
+		float SobolSampler::SobolSample(const int dimension)
 		{
 			if (dimension < NumSobolDimensions)
 			{
-				uint32 v = mScramble;
-				int64 _index = index;
-				for (int i = dimension * SobolMatrixSize + SobolMatrixSize - 1; _index != 0; _index >>= 1, i--)
+				// Dimensions are evaluated four at a time, consecutive requests hit the cached block
+				const int block = dimension >> 2;
+				if (block != mCachedBlock)
 				{
-					if (_index & 1)
-						v ^= SobolMatrices32[i];
+					const int offset = block << 2;
+					__m128i values = _mm_loadu_si128((const __m128i*)(mpPassValues + offset));
+					values = XorColumns(values, mPixelIndex, offset);
+					_mm_storeu_si128((__m128i*)mCachedValues, values);
+
+					mCachedBlock = block;
 				}
 
-				return v * 2.3283064365386963e-10f; /* 1 / 2^32 */
+				return mCachedValues[dimension & 3] * 2.3283064365386963e-10f; /* 1 / 2^32 */
 			}
 			else
 				return mRandom.Float();
 		}
 	}
-}
\ No newline at end of file
+}
@@ -2,28 +2,44 @@
 
 #include "../Core/Sampler.h"
 #include "Core/Random.h"
+#include "Containers/Array.h"
 
 namespace EDX
 {
 	namespace RayTracer
 	{
-		class SobolSampler : public Sampler
+		class SobolSampler final : public Sampler
 		{
 		private:
 			int mResolution;
 			int mLogTwoResolution;
 			uint64 mSampleIndex;
-			uint64 mSobolIndex;
 			uint mDimension;
 			uint64 mScramble;
 			mutable RandomGen mRandom;
 
+			// The enumerated Sobol index is linear in its inputs, so it splits into a term that only depends
+			// on the pass (shared by every pixel) and a term that only depends on the pixel position
+			Array<uint64> mPixelIndexX;
+			Array<uint64> mPixelIndexY;
+			Array<uint32> mPassValues;
+
+			// Tables used for sampling, owned either by this sampler or by the sampler it was cloned from
+			const uint64* mpPixelIndexX;
+			const uint64* mpPixelIndexY;
+			const uint32* mpPassValues;
+
+			uint64 mPixelIndex;
+			int mCachedBlock;
+			uint32 mCachedValues[4];
+
 		public:
 			SobolSampler(const int resX, const int resY)
 				: mSampleIndex(0)
-				, mSobolIndex(0)
 				, mDimension(0)
 				, mScramble(0)
+				, mPixelIndex(0)
+				, mCachedBlock(-1)
 			{
 				mResolution =
 					Math::RoundUpPowOfTwo(
@@ -32,15 +48,23 @@ namespace EDX
 
 				mLogTwoResolution = Math::FloorLog2(mResolution);
 				Assert(1 << mLogTwoResolution == mResolution);
+
+				InitPixelTables();
+				UpdatePassValues();
 			}
 
-			SobolSampler(const int resolution, const int log2Res, const uint64 scramble, const uint64 sampleIndex = 0)
-				: mSampleIndex(sampleIndex)
-				, mSobolIndex(0)
+			SobolSampler(const SobolSampler& parent, const int seed)
+				: mResolution(parent.mResolution)
+				, mLogTwoResolution(parent.mLogTwoResolution)
+				, mSampleIndex(parent.mSampleIndex)
 				, mDimension(0)
-				, mResolution(resolution)
-				, mLogTwoResolution(log2Res)
-				, mScramble(scramble)
+				, mScramble(parent.mScramble)
+				, mRandom(seed)
+				, mpPixelIndexX(parent.mpPixelIndexX)
+				, mpPixelIndexY(parent.mpPixelIndexY)
+				, mpPassValues(parent.mpPassValues)
+				, mPixelIndex(0)
+				, mCachedBlock(-1)
 			{
 			}
 
@@ -50,17 +74,20 @@ namespace EDX
 				CameraSample* pSamples,
 				RandomGen& random) override;
 			void AdvanceSampleIndex() override;
+			void SetSampleIndex(const uint64 index) override;
 
 			void StartPixel(const int pixelX, const int pixelY) override;
 			float Get1D() override;
 			Vector2 Get2D() override;
 			Sample GetSample() override;
+			void GetSampleVector(const int* pGroupSizes, const int numGroups, float* pSamples) override;
 
 			UniquePtr<Sampler> Clone(const int seed) const override;
 
 		private:
-			uint64 EnumerateSampleIndex(const uint pixelX, const uint pixelY) const;
-			float SobolSample(const int64 index, const int dimension) const;
+			void InitPixelTables();
+			void UpdatePassValues();
+			float SobolSample(const int dimension);
 		};
 	}
-}
\ No newline at end of file
+}
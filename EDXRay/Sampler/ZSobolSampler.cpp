@@ -0,0 +1,219 @@
+#include "ZSobolSampler.h"
+#include "SobolMatrices.h"
+
+#include "Math/Vec2.h"
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		namespace
+		{
+			inline uint64 MixBits(uint64 v)
+			{
+				v ^= (v >> 31);
+				v *= 0x7fb5d329728ea185ull;
+				v ^= (v >> 27);
+				v *= 0x81dadef4bc2dd44dull;
+				v ^= (v >> 33);
+				return v;
+			}
+
+			inline uint32 ReverseBits32(uint32 v)
+			{
+				v = (v << 16) | (v >> 16);
+				v = ((v & 0x00ff00ff) << 8) | ((v & 0xff00ff00) >> 8);
+				v = ((v & 0x0f0f0f0f) << 4) | ((v & 0xf0f0f0f0) >> 4);
+				v = ((v & 0x33333333) << 2) | ((v & 0xcccccccc) >> 2);
+				v = ((v & 0x55555555) << 1) | ((v & 0xaaaaaaaa) >> 1);
+				return v;
+			}
+
+			inline uint64 SpreadBits(uint32 x)
+			{
+				uint64 v = x;
+				v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+				v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+				v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+				v = (v | (v << 2)) & 0x3333333333333333ull;
+				v = (v | (v << 1)) & 0x5555555555555555ull;
+				return v;
+			}
+
+			// Hash based nested uniform (Owen) scrambling, operates on the bit reversed value so that
+			// each bit only depends on the more significant ones
+			inline uint32 OwenScramble(uint32 v, const uint32 seed)
+			{
+				v = ReverseBits32(v);
+				v ^= v * 0x3d20adea;
+				v += seed;
+				v *= (seed >> 16) | 1;
+				v ^= v * 0x05526c56;
+				v ^= v * 0x53a22864;
+				return ReverseBits32(v);
+			}
+
+			inline float ScrambledSobolSample(uint64 index, const int dimension, const uint32 seed)
+			{
+				Assert(dimension < NumSobolDimensions);
+
+				uint32 v = 0;
+				for (int i = dimension * SobolMatrixSize + SobolMatrixSize - 1; index != 0; index >>= 1, i--)
+				{
+					if (index & 1)
+						v ^= SobolMatrices32[i];
+				}
+
+				v = OwenScramble(v, seed);
+				return Math::Min(v * 2.3283064365386963e-10f /* 1 / 2^32 */, 0.99999994f /* 1 - 2^-24 */);
+			}
+		}
+
+		ZSobolSampler::ZSobolSampler(const int resX, const int resY, const int samplesPerPixel, const uint32 seed)
+			: mSeed(seed)
+			, mSampleIndex(0)
+			, mMortonIndex(0)
+			, mRoundSeed(seed)
+			, mDimension(0)
+		{
+			const int resolution = Math::RoundUpPowOfTwo(Math::Max(resX, resY));
+			mLog2SamplesPerPixel = Math::FloorLog2(Math::RoundUpPowOfTwo(Math::Max(samplesPerPixel, 1)));
+			mNumBase4Digits = Math::FloorLog2(resolution) + (mLog2SamplesPerPixel + 1) / 2;
+		}
+
+		void ZSobolSampler::GenerateSamples(
+			const int pixelX,
+			const int pixelY,
+			CameraSample* pSamples,
+			RandomGen& random)
+		{
+			Assert(pSamples);
+
+			const Vector2 imageSample = Get2D();
+			const Vector2 lensSample = Get2D();
+
+			pSamples->imageX = imageSample.x;
+			pSamples->imageY = imageSample.y;
+			pSamples->lensU = lensSample.x;
+			pSamples->lensV = lensSample.y;
+			pSamples->time = Get1D();
+		}
+
+		void ZSobolSampler::AdvanceSampleIndex()
+		{
+			mSampleIndex++;
+		}
+
+		void ZSobolSampler::SetSampleIndex(const uint64 index)
+		{
+			mSampleIndex = index;
+		}
+
+		void ZSobolSampler::StartPixel(const int pixelX, const int pixelY)
+		{
+			// Samples past the planned count start a new, independently scrambled round
+			const uint64 samplesPerPixel = 1ull << mLog2SamplesPerPixel;
+			const uint64 round = mSampleIndex >> mLog2SamplesPerPixel;
+			const uint64 index = mSampleIndex & (samplesPerPixel - 1);
+
+			mRoundSeed = round == 0 ? mSeed : uint32(MixBits(round ^ (uint64(mSeed) << 32)));
+			mMortonIndex = (((SpreadBits(pixelY) << 1) | SpreadBits(pixelX)) << mLog2SamplesPerPixel) | index;
+			mDimension = 0;
+		}
+
+		float ZSobolSampler::Get1D()
+		{
+			const uint64 sampleIndex = PermutedSampleIndex();
+			mDimension++;
+
+			const uint32 hash = uint32(MixBits((uint64(mDimension) << 32) ^ mRoundSeed));
+			return ScrambledSobolSample(sampleIndex, 0, hash);
+		}
+
+		Vector2 ZSobolSampler::Get2D()
+		{
+			const uint64 sampleIndex = PermutedSampleIndex();
+			mDimension += 2;
+
+			const uint64 hash = MixBits((uint64(mDimension) << 32) ^ mRoundSeed);
+			return Vector2(ScrambledSobolSample(sampleIndex, 0, uint32(hash)),
+				ScrambledSobolSample(sampleIndex, 1, uint32(hash >> 32)));
+		}
+
+		Sample ZSobolSampler::GetSample()
+		{
+			const Vector2 uv = Get2D();
+
+			Sample ret;
+			ret.u = uv.x;
+			ret.v = uv.y;
+			ret.w = Get1D();
+
+			return ret;
+		}
+
+		void ZSobolSampler::GetSampleVector(const int* pGroupSizes, const int numGroups, float* pSamples)
+		{
+			// Groups keep their padded 1D/2D stratification, the calls are resolved statically
+			for (auto i = 0; i < numGroups; i++)
+			{
+				if (pGroupSizes[i] == 1)
+				{
+					*pSamples++ = ZSobolSampler::Get1D();
+				}
+				else
+				{
+					const Vector2 uv = ZSobolSampler::Get2D();
+					*pSamples++ = uv.x;
+					*pSamples++ = uv.y;
+
+					if (pGroupSizes[i] == 3)
+						*pSamples++ = ZSobolSampler::Get1D();
+				}
+			}
+		}
+
+		UniquePtr<Sampler> ZSobolSampler::Clone(const int seed) const
+		{
+			// The scrambling seed is kept so that all tiles sample from the same randomized sequence
+			return MakeUnique<ZSobolSampler>(*this);
+		}
+
+		uint64 ZSobolSampler::PermutedSampleIndex() const
+		{
+			static const int Permutations[24][4] =
+			{
+				{ 0, 1, 2, 3 }, { 0, 1, 3, 2 }, { 0, 2, 1, 3 }, { 0, 2, 3, 1 },
+				{ 0, 3, 2, 1 }, { 0, 3, 1, 2 }, { 1, 0, 2, 3 }, { 1, 0, 3, 2 },
+				{ 1, 2, 0, 3 }, { 1, 2, 3, 0 }, { 1, 3, 2, 0 }, { 1, 3, 0, 2 },
+				{ 2, 1, 0, 3 }, { 2, 1, 3, 0 }, { 2, 0, 1, 3 }, { 2, 0, 3, 1 },
+				{ 2, 3, 0, 1 }, { 2, 3, 1, 0 }, { 3, 1, 2, 0 }, { 3, 1, 0, 2 },
+				{ 3, 2, 1, 0 }, { 3, 2, 0, 1 }, { 3, 0, 2, 1 }, { 3, 0, 1, 2 }
+			};
+
+			// Each base 4 digit of the Morton index is shuffled by a permutation chosen from the higher digits,
+			// which randomizes the ranking per dimension while keeping the (0, 2) stratification of the sequence
+			uint64 sampleIndex = 0;
+			const bool pow2Samples = (mLog2SamplesPerPixel & 1) != 0;
+			const int lastDigit = pow2Samples ? 1 : 0;
+			for (int i = mNumBase4Digits - 1; i >= lastDigit; i--)
+			{
+				const int digitShift = 2 * i - (pow2Samples ? 1 : 0);
+				const int digit = (mMortonIndex >> digitShift) & 3;
+				const uint64 higherDigits = mMortonIndex >> (digitShift + 2);
+				const int p = (MixBits(higherDigits ^ (0x55555555u * uint64(mDimension)) ^ (uint64(mRoundSeed) << 32)) >> 24) % 24;
+
+				sampleIndex |= uint64(Permutations[p][digit]) << digitShift;
+			}
+
+			// An odd power of two sample count leaves a single base 2 digit
+			if (pow2Samples)
+			{
+				const uint64 digit = mMortonIndex & 1;
+				sampleIndex |= digit ^ (MixBits((mMortonIndex >> 1) ^ (0x55555555u * uint64(mDimension)) ^ (uint64(mRoundSeed) << 32)) & 1);
+			}
+
+			return sampleIndex;
+		}
+	}
+}
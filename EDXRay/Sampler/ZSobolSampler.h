@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../Core/Sampler.h"
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		// Sobol sampler with hashed Owen scrambling, whose sample indices are ranked along a Morton curve
+		// over the image so that neighboring pixels take complementary samples (blue noise error distribution).
+		// Every dimension is padded from the first two Sobol dimensions with its own scramble and index permutation,
+		// so deep path vertices stay as well stratified as the camera sample
+		class ZSobolSampler final : public Sampler
+		{
+		private:
+			int mLog2SamplesPerPixel;
+			int mNumBase4Digits;
+			uint32 mSeed;
+			uint64 mSampleIndex;
+
+			uint64 mMortonIndex;
+			uint32 mRoundSeed;
+			uint mDimension;
+
+		public:
+			ZSobolSampler(const int resX, const int resY, const int samplesPerPixel, const uint32 seed = 0);
+
+			void GenerateSamples(
+				const int pixelX,
+				const int pixelY,
+				CameraSample* pSamples,
+				RandomGen& random) override;
+			void AdvanceSampleIndex() override;
+			void SetSampleIndex(const uint64 index) override;
+
+			void StartPixel(const int pixelX, const int pixelY) override;
+			float Get1D() override;
+			Vector2 Get2D() override;
+			Sample GetSample() override;
+			void GetSampleVector(const int* pGroupSizes, const int numGroups, float* pSamples) override;
+
+			UniquePtr<Sampler> Clone(const int seed) const override;
+
+		private:
+			uint64 PermutedSampleIndex() const;
+		};
+	}
+}
@@ -529,5 +529,73 @@ namespace EDX
 
 			return false;
 		}
+
+		int BVH2::IntersectAll(const Ray& ray, Intersection* pIsects, const int maxIsects) const
+		{
+			const IntSSE identity = _mm_set_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+			const IntSSE swap = _mm_set_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+			const IntSSE shuffleX = ray.mDir.x >= 0 ? identity : swap;
+			const IntSSE shuffleY = ray.mDir.y >= 0 ? identity : swap;
+			const IntSSE shuffleZ = ray.mDir.z >= 0 ? identity : swap;
+
+			const IntSSE pn = IntSSE(0x00000000, 0x00000000, 0x80000000, 0x80000000);
+			const Vec3f_SSE norg(-ray.mOrg.x, -ray.mOrg.y, -ray.mOrg.z);
+			const Vec3f_SSE rdir = Vec3f_SSE(FloatSSE(1.0f / ray.mDir.x) ^ pn, FloatSSE(1.0f / ray.mDir.y) ^ pn, FloatSSE(1.0f / ray.mDir.z) ^ pn);
+			const FloatSSE nearFar(ray.mMin, ray.mMin, -ray.mMax, -ray.mMax);
+
+			// The segment never shrinks, so every node overlapping it is visited and the order does not matter
+			int TodoStack[64];
+			uint stackTop = 0, nodeIdx = 0;
+
+			int numIsects = 0;
+			while (numIsects < maxIsects)
+			{
+				const Node* pNode = &mpRoot[nodeIdx];
+
+				// Interior node
+				if (pNode->triangleCount == 0)
+				{
+					const FloatSSE tNearFarX = (SSE::Shuffle8(pNode->minMaxBoundsX, shuffleX) + norg.x) * rdir.x;
+					const FloatSSE tNearFarY = (SSE::Shuffle8(pNode->minMaxBoundsY, shuffleY) + norg.y) * rdir.y;
+					const FloatSSE tNearFarZ = (SSE::Shuffle8(pNode->minMaxBoundsZ, shuffleZ) + norg.z) * rdir.z;
+					const FloatSSE tNearFar = SSE::Max(SSE::Max(tNearFarX, tNearFarY), SSE::Max(tNearFarZ, nearFar)) ^ pn;
+					const BoolSSE lrhit = tNearFar <= SSE::Shuffle8(tNearFar, swap);
+
+					if (lrhit[0] != 0 && lrhit[1] != 0)
+					{
+						TodoStack[stackTop++] = pNode->secondChildOffset;
+						nodeIdx = nodeIdx + 1;
+					}
+					else if (lrhit[0] != 0)
+					{
+						nodeIdx = nodeIdx + 1;
+					}
+					else if (lrhit[1] != 0)
+					{
+						nodeIdx = pNode->secondChildOffset;
+					}
+					else // If miss the node's bounds
+					{
+						if (stackTop == 0)
+							break;
+
+						nodeIdx = TodoStack[--stackTop];
+					}
+				}
+				else // Leaf node
+				{
+					Triangle4Node* pLeafNode = (Triangle4Node*)pNode;
+					for (auto i = 0; i < pLeafNode->triangleCount; i++)
+						pLeafNode[i].tri4.IntersectAll(ray, pIsects, &numIsects, maxIsects, mRefPrims);
+
+					if (stackTop == 0)
+						break;
+
+					nodeIdx = TodoStack[--stackTop];
+				}
+			}
+
+			return numIsects;
+		}
 	}
 }
\ No newline at end of file
@@ -142,6 +142,8 @@ namespace EDX
 
 			bool Intersect(const Ray& ray, Intersection* pIsect) const;
 			bool Occluded(const Ray& ray) const;
+			// Gathers up to maxIsects hits within the ray segment in no particular order, returns their number
+			int IntersectAll(const Ray& ray, Intersection* pIsects, const int maxIsects) const;
 			BoundingBox WorldBounds() const
 			{
 				return mBounds;
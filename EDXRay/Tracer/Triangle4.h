@@ -96,21 +96,8 @@ namespace EDX
 
 				const size_t idx = SSE::SelectMin(valid, t);
 				float baryCentricU = u[idx], baryCentricV = v[idx];
-				if (mHasAlpha[idx])
-				{
-					const auto prim = prims[mMeshIds[idx]];
-					const auto mesh = prim->GetMesh();
-					const Vector2& texcoord1 = mesh->GetTexCoordAt(3 * mTriIds[idx]);
-					const Vector2& texcoord2 = mesh->GetTexCoordAt(3 * mTriIds[idx] + 1);
-					const Vector2& texcoord3 = mesh->GetTexCoordAt(3 * mTriIds[idx] + 2);
-
-					const Vector2 texCoord = (1.0f - baryCentricU - baryCentricV) * texcoord1 +
-						baryCentricU * texcoord2 +
-						baryCentricV * texcoord3;
-
-					if (prim->GetBSDF(mTriIds[idx])->GetTexture()->Sample(texCoord, nullptr, TextureFilter::Nearest).a == 0)
-						return false;
-				}
+				if (mHasAlpha[idx] && !AlphaTest(idx, baryCentricU, baryCentricV, prims))
+					return false;
 
 				float hitT = t[idx];
 
@@ -175,6 +162,69 @@ namespace EDX
 
 				return true;
 			}
+
+			// Appends every hit within the ray segment to pIsects, stopping once *pNumIsects reaches maxIsects
+			__forceinline void IntersectAll(const Ray& ray, Intersection* pIsects, int* pNumIsects, const int maxIsects, const Array<Primitive*>& prims) const
+			{
+				// Calculate determinant
+				const Vec3f_SSE vOrgs = Vec3f_SSE(ray.mOrg);
+				const Vec3f_SSE vDirs = Vec3f_SSE(ray.mDir);
+				const Vec3f_SSE vC = mVertices0 - vOrgs;
+				const Vec3f_SSE vR = Math::Cross(vDirs, vC);
+				const FloatSSE det = Math::Dot(mGeomNormals, vDirs);
+				const FloatSSE absDet = SSE::Abs(det);
+				const FloatSSE signedDet = SSE::SignMask(det);
+
+				// Edge tests
+				const FloatSSE U = Math::Dot(vR, mEdges2) ^ signedDet;
+				const FloatSSE V = Math::Dot(vR, mEdges1) ^ signedDet;
+				BoolSSE valid = (det != FloatSSE(Math::EDX_ZERO)) & (U >= 0.0f) & (V >= 0.0f) & (U + V <= absDet);
+				if (SSE::None(valid))
+					return;
+
+				const FloatSSE T = Math::Dot(mGeomNormals, vC) ^ signedDet;
+				valid &= (T > absDet * FloatSSE(ray.mMin)) & (T < absDet * FloatSSE(ray.mMax));
+				if (SSE::None(valid))
+					return;
+
+				const FloatSSE invAbsDet = SSE::Rcp(absDet);
+				const FloatSSE u = U * invAbsDet;
+				const FloatSSE v = V * invAbsDet;
+				const FloatSSE t = T * invAbsDet;
+
+				for (auto i = 0; i < 4 && *pNumIsects < maxIsects; i++)
+				{
+					if (valid[i] == 0)
+						continue;
+
+					if (mHasAlpha[i] && !AlphaTest(i, u[i], v[i], prims))
+						continue;
+
+					Intersection& isect = pIsects[(*pNumIsects)++];
+					isect.mDist = t[i];
+					isect.mU = u[i];
+					isect.mV = v[i];
+					isect.mPrimId = mMeshIds[i];
+					isect.mTriId = mTriIds[i];
+				}
+			}
+
+		private:
+			// Returns false if the texture is transparent at the given barycentric coordinates of triangle idx
+			__forceinline bool AlphaTest(const size_t idx, const float baryCentricU, const float baryCentricV, const Array<Primitive*>& prims) const
+			{
+				const auto prim = prims[mMeshIds[idx]];
+				const auto mesh = prim->GetMesh();
+				const Vector2& texcoord1 = mesh->GetTexCoordAt(3 * mTriIds[idx]);
+				const Vector2& texcoord2 = mesh->GetTexCoordAt(3 * mTriIds[idx] + 1);
+				const Vector2& texcoord3 = mesh->GetTexCoordAt(3 * mTriIds[idx] + 2);
+
+				const Vector2 texCoord = (1.0f - baryCentricU - baryCentricV) * texcoord1 +
+					baryCentricU * texcoord2 +
+					baryCentricV * texcoord3;
+
+				return prim->GetBSDF(mTriIds[idx])->GetTexture()->Sample(texCoord, nullptr, TextureFilter::Nearest).a != 0;
+			}
 		};
 
 		struct Triangle4Node
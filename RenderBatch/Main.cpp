@@ -0,0 +1,328 @@
+
+#include "Core/Renderer.h"
+#include "Core/Film.h"
+#include "Core/Scene.h"
+#include "Core/DistributedRender.h"
+#include "Core/SnapshotWriter.h"
+
+#include "SceneLoader.h"
+
+#include "Windows/Timer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace EDX;
+using namespace EDX::RayTracer;
+
+struct BatchOptions
+{
+	const char* ScenePath = nullptr;
+	const char* OutputPath = "EDXRay.bmp";
+	float SnapshotInterval = 0.0f;	// Seconds between progressive snapshots, 0 to disable
+	const char* CheckpointPath = nullptr;
+	bool Resume = false;
+	float TimeBudget = 0.0f;		// Seconds, 0 for unlimited
+	int SampleBudget = 0;			// Overrides the scene's samples per pixel if nonzero
+	float NoiseTarget = 0.0f;		// Relative error to stop at, 0 to disable
+
+	// Distributed rendering
+	const char* CoordinatorHost = nullptr;
+	int Port = 7531;
+	int WorkerIndex = 0;
+	int NumWorkers = 0;
+	bool Coordinator = false;
+	bool SpawnWorkers = false;
+};
+
+void PrintUsage()
+{
+	printf("Usage: RenderBatch <scene file> [options]\n"
+		"  -o <file>                     Output image, .bmp, .pfm or .hdr (default EDXRay.bmp)\n"
+		"  -snapshot <seconds>           Periodically write the output image while rendering\n"
+		"  -time <seconds>               Wall-clock budget\n"
+		"  -spp <count>                  Samples per pixel budget\n"
+		"  -noise <relative error>       Stop once the estimated relative error drops below the target\n"
+		"  -checkpoint <file>            Checkpoint the film every 60 seconds\n"
+		"  -resume                       Resume from the checkpoint file\n"
+		"  -worker <host> <port> <index> <count>\n"
+		"                                Render a share of the passes for a coordinator\n"
+		"  -coordinator <port> <count>   Merge the films of <count> workers\n"
+		"  -local <count>                Coordinate <count> workers spawned on this machine\n");
+}
+
+bool ParseOptions(int argc, char** argv, BatchOptions* pOptions)
+{
+	if (argc < 2)
+		return false;
+
+	pOptions->ScenePath = argv[1];
+	for (auto i = 2; i < argc; i++)
+	{
+		const int remaining = argc - i - 1;
+		if (strcmp(argv[i], "-o") == 0 && remaining >= 1)
+			pOptions->OutputPath = argv[++i];
+		else if (strcmp(argv[i], "-snapshot") == 0 && remaining >= 1)
+			pOptions->SnapshotInterval = float(atof(argv[++i]));
+		else if (strcmp(argv[i], "-time") == 0 && remaining >= 1)
+			pOptions->TimeBudget = float(atof(argv[++i]));
+		else if (strcmp(argv[i], "-spp") == 0 && remaining >= 1)
+			pOptions->SampleBudget = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-noise") == 0 && remaining >= 1)
+			pOptions->NoiseTarget = float(atof(argv[++i]));
+		else if (strcmp(argv[i], "-checkpoint") == 0 && remaining >= 1)
+			pOptions->CheckpointPath = argv[++i];
+		else if (strcmp(argv[i], "-resume") == 0)
+			pOptions->Resume = true;
+		else if (strcmp(argv[i], "-worker") == 0 && remaining >= 4)
+		{
+			pOptions->CoordinatorHost = argv[++i];
+			pOptions->Port = atoi(argv[++i]);
+			pOptions->WorkerIndex = atoi(argv[++i]);
+			pOptions->NumWorkers = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-coordinator") == 0 && remaining >= 2)
+		{
+			pOptions->Coordinator = true;
+			pOptions->Port = atoi(argv[++i]);
+			pOptions->NumWorkers = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-local") == 0 && remaining >= 1)
+		{
+			pOptions->Coordinator = true;
+			pOptions->SpawnWorkers = true;
+			pOptions->NumWorkers = atoi(argv[++i]);
+		}
+		else
+			return false;
+	}
+
+	return true;
+}
+
+// Mean relative difference between two images, used as the error estimate of the older one
+float RelativeDifference(const Array<Color>& reference, const Color* pImage)
+{
+	double sum = 0.0;
+	for (auto i = 0; i < reference.Size(); i++)
+	{
+		const float lum = pImage[i].Luminance();
+		sum += Math::Abs(lum - reference[i].Luminance()) / (lum + 1e-2f);
+	}
+
+	return float(sum / Math::Max(reference.Size(), 1));
+}
+
+void SpawnLocalWorkers(const BatchOptions& options)
+{
+	char exePath[MAX_PATH];
+	GetModuleFileNameA(nullptr, exePath, MAX_PATH);
+
+	for (auto i = 0; i < options.NumWorkers; i++)
+	{
+		char commandLine[2 * MAX_PATH + 128];
+		int length = sprintf_s(commandLine, "\"%s\" \"%s\" -worker localhost %i %i %i", exePath, options.ScenePath, options.Port, i, options.NumWorkers);
+
+		// Workers load the scene file themselves, so the budgets given to the coordinator are passed on
+		if (options.SampleBudget > 0)
+			length += sprintf_s(commandLine + length, _countof(commandLine) - length, " -spp %i", options.SampleBudget);
+		if (options.TimeBudget > 0.0f)
+			length += sprintf_s(commandLine + length, _countof(commandLine) - length, " -time %f", options.TimeBudget);
+
+		STARTUPINFOA startupInfo = { sizeof(STARTUPINFOA) };
+		PROCESS_INFORMATION processInfo;
+		if (CreateProcessA(nullptr, commandLine, nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startupInfo, &processInfo))
+		{
+			CloseHandle(processInfo.hThread);
+			CloseHandle(processInfo.hProcess);
+		}
+		else
+			printf("Unable to spawn worker %i\n", i);
+	}
+}
+
+int RunCoordinator(Renderer& renderer, const BatchOptions& options)
+{
+	RenderCoordinator coordinator;
+	if (!coordinator.Listen(options.Port, options.NumWorkers))
+	{
+		printf("Unable to listen on port %i\n", options.Port);
+		return 1;
+	}
+
+	if (options.SpawnWorkers)
+		SpawnLocalWorkers(options);
+
+	printf("Waiting for %i workers on port %i\n", options.NumWorkers, options.Port);
+	if (!coordinator.WaitForWorkers())
+		return 1;
+
+	Timer timer;
+	timer.Start();
+
+	Film* pFilm = renderer.GetFilm();
+	while (coordinator.Update(pFilm))
+	{
+		printf("\r%.1fs: %i spp merged", timer.GetElapsedTime(), pFilm->GetSampleCount());
+
+		if (options.TimeBudget > 0.0f && timer.GetElapsedTime() >= options.TimeBudget)
+		{
+			printf("\nTime budget reached");
+			break;
+		}
+	}
+
+	printf("\nMerged %i spp from %i workers in %.2fs\n", pFilm->GetSampleCount(), options.NumWorkers, timer.GetElapsedTime());
+	return 0;
+}
+
+int RunRender(Renderer& renderer, SnapshotWriter& snapshotWriter, const BatchOptions& options)
+{
+	const RenderJobDesc* pJobDesc = renderer.GetJobDesc();
+	Film* pFilm = renderer.GetFilm();
+
+	if (options.Resume && options.CheckpointPath)
+	{
+		if (renderer.ResumeFromCheckpoint(options.CheckpointPath))
+			printf("Resumed from %s at %i spp\n", options.CheckpointPath, pFilm->GetSampleCount());
+		else
+			printf("Unable to resume from %s, starting over\n", options.CheckpointPath);
+	}
+
+	Timer timer;
+	timer.Start();
+	renderer.QueueRenderTasks();
+
+	// Noise is estimated from the difference to the image at half the current sample count
+	Array<Color> reference;
+	int referenceSampleCount = 0;
+	float noise = 0.0f;
+
+	// Images above this size are written strip by strip instead of through a full copy
+	static const int INCREMENTAL_PIXEL_COUNT = 4096 * 4096;
+	const EImageFormat snapshotFormat = SnapshotWriter::FormatFromPath(options.OutputPath);
+	float lastSnapshotTime = 0.0f;
+
+	const char* stopReason = "sample budget";
+	while (pFilm->GetSampleCount() < int(pJobDesc->SamplesPerPixel))
+	{
+		Sleep(100);
+
+		// Integrators may finish with a different count than the budget, never wait on a render that returned
+		if (renderer.RenderFinished() && pFilm->GetSampleCount() < int(pJobDesc->SamplesPerPixel))
+		{
+			stopReason = "render finished";
+			break;
+		}
+
+		const int sampleCount = pFilm->GetSampleCount();
+		if (options.NoiseTarget > 0.0f && sampleCount >= 2 * referenceSampleCount && sampleCount > 0)
+		{
+			if (referenceSampleCount > 0)
+				noise = RelativeDifference(reference, pFilm->GetPixelBuffer());
+
+			reference.Resize(pFilm->GetPixelCount());
+			for (auto i = 0; i < reference.Size(); i++)
+				reference[i] = pFilm->GetPixelBuffer()[i];
+			referenceSampleCount = sampleCount;
+
+			if (noise > 0.0f && noise < options.NoiseTarget)
+			{
+				stopReason = "noise target";
+				break;
+			}
+		}
+
+		printf("\r%.1fs: %i spp, noise %.4f", timer.GetElapsedTime(), sampleCount, noise);
+
+		if (options.SnapshotInterval > 0.0f && timer.GetElapsedTime() - lastSnapshotTime >= options.SnapshotInterval)
+		{
+			if (pFilm->GetPixelCount() > INCREMENTAL_PIXEL_COUNT)
+				snapshotWriter.RequestIncrementalSnapshot(pFilm, options.OutputPath, snapshotFormat);
+			else
+				snapshotWriter.RequestSnapshot(pFilm, options.OutputPath, snapshotFormat);
+
+			lastSnapshotTime = timer.GetElapsedTime();
+		}
+
+		if (options.TimeBudget > 0.0f && timer.GetElapsedTime() >= options.TimeBudget)
+		{
+			stopReason = "time budget";
+			break;
+		}
+	}
+
+	renderer.StopRenderTasks();
+	const float renderTime = timer.GetElapsedTime();
+
+	const int sampleCount = pFilm->GetSampleCount();
+	const double numSamples = double(sampleCount) * pJobDesc->ImageWidth * pJobDesc->ImageHeight;
+	printf("\nStopped on %s\n", stopReason);
+	printf("Render time: %.2fs, %i spp, %.2f M samples/s\n", renderTime, sampleCount, numSamples / (renderTime * 1e6));
+
+	// Final state for the coordinator, or the last checkpoint
+	if (options.CoordinatorHost || options.CheckpointPath)
+		renderer.FlushCheckpoint();
+
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	BatchOptions options;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	Timer timer;
+	timer.Start();
+
+	Renderer renderer;
+	RenderJobDesc jobDesc;
+	if (!SceneLoader::Load(options.ScenePath, renderer.GetScene(), &jobDesc))
+		return 1;
+
+	if (options.SampleBudget > 0)
+		jobDesc.SamplesPerPixel = options.SampleBudget;
+
+	const float loadTime = timer.GetElapsedTime();
+
+	renderer.GetScene()->InitAccelerator();
+	const float buildTime = timer.GetElapsedTime() - loadTime;
+	printf("Scene loaded in %.2fs, acceleration structure built in %.2fs\n", loadTime, buildTime);
+
+	renderer.SetJobDesc(jobDesc);
+
+	if (options.CoordinatorHost)
+	{
+		if (!renderer.ConnectToCoordinator(options.CoordinatorHost, options.Port, options.WorkerIndex, options.NumWorkers, 5.0f))
+		{
+			printf("Unable to connect to %s:%i\n", options.CoordinatorHost, options.Port);
+			return 1;
+		}
+	}
+	else if (options.CheckpointPath)
+		renderer.EnableCheckpoint(options.CheckpointPath, 60.0f);
+
+	renderer.InitComponent();
+
+	SnapshotWriter snapshotWriter;
+	int ret = options.Coordinator ?
+		RunCoordinator(renderer, options) :
+		RunRender(renderer, snapshotWriter, options);
+
+	// Workers only report back to the coordinator
+	if (ret == 0 && !options.CoordinatorHost)
+	{
+		// Snapshots still in flight would otherwise overwrite the final image
+		snapshotWriter.WaitForPendingWrites();
+		snapshotWriter.RequestSnapshot(renderer.GetFilm(), options.OutputPath, SnapshotWriter::FormatFromPath(options.OutputPath));
+		snapshotWriter.WaitForPendingWrites();
+		printf("Saved %s\n", options.OutputPath);
+	}
+
+	return ret;
+}
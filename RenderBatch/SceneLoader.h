@@ -0,0 +1,326 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+
+#include "Core/Config.h"
+#include "Core/Scene.h"
+#include "Core/Primitive.h"
+#include "Core/TriangleMesh.h"
+#include "Lights/PointLight.h"
+#include "Lights/AreaLight.h"
+#include "Lights/DirectionalLight.h"
+#include "Lights/EnvironmentLight.h"
+#include "Media/Grid.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace EDX
+{
+	namespace RayTracer
+	{
+		// Loads a line based scene description, one directive per line and '#' for comments:
+		//
+		//   resolution <width> <height>
+		//   integrator DirectLighting|PathTracing|BidirectionalPathTracing|MultiplexedMLT|StochasticPPM|PathGuiding|RLPathTracing
+		//   sampler Random|Sobol|Metropolis|ZSobol
+		//   filter Box|Gaussian|MitchellNetravali
+		//   spp <count>
+		//   maxdepth <length>
+		//   subsurface Stochastic|Hierarchical
+		//   camera <pos xyz> <target xyz> <up xyz>
+		//   lens <focal length mm> <f-stop> <focus distance> <vignette>
+		//   mesh <path> <bsdf> <color rgb> <pos xyz> <scale> <rot xyz>
+		//   sphere <radius> <bsdf> <color rgb> <pos xyz>
+		//   plane <length> <bsdf> <color rgb> <pos xyz> <rot xyz>
+		//   arealight <length> <intensity rgb> <pos xyz> <rot xyz>
+		//   pointlight <pos xyz> <intensity rgb>
+		//   dirlight <dir xyz> <intensity rgb> <cone degrees>
+		//   envmap <path> <scale> <rotation>
+		//   envcolor <intensity rgb>
+		//   sky <turbidity> <ground albedo> <sun elevation> <rotation>
+		//   gridmedium <voxel file> <min xyz> <max xyz> <sigma_s rgb> <sigma_a rgb> <g>
+		//   scale <factor>
+		//
+		// scale applies to all meshes, planes, spheres and area lights regardless of where it appears. Point and
+		// directional lights and grid medium bounds are given in world units and are not scaled
+		//
+		// gridmedium fills the inside of the shape declared last, which should enclose the given box
+		//
+		// Paths are resolved relative to the working directory and must not contain spaces
+		class SceneLoader
+		{
+		public:
+			static bool Load(const char* path, Scene* pScene, RenderJobDesc* pJobDesc)
+			{
+				FILE* pFile = nullptr;
+				if (fopen_s(&pFile, path, "r") != 0 || !pFile)
+				{
+					printf("Unable to open scene file %s\n", path);
+					return false;
+				}
+
+				bool succeeded = true;
+				int lineNumber = 0;
+				char line[1024];
+				while (fgets(line, sizeof(line), pFile))
+				{
+					lineNumber++;
+					if (!ParseLine(line, pScene, pJobDesc))
+					{
+						printf("%s(%i): unable to parse \"%s\"\n", path, lineNumber, line);
+						succeeded = false;
+						break;
+					}
+				}
+
+				fclose(pFile);
+				return succeeded;
+			}
+
+		private:
+			static bool ParseLine(char* line, Scene* pScene, RenderJobDesc* pJobDesc)
+			{
+				char* pComment = strchr(line, '#');
+				if (pComment)
+					*pComment = '\0';
+
+				char directive[64];
+				int offset = 0;
+				if (sscanf_s(line, "%63s%n", directive, unsigned(sizeof(directive)), &offset) != 1)
+					return true; // Empty line
+
+				const char* args = line + offset;
+				char name[MAX_PATH];
+				char bsdfName[64];
+				Vector3 pos, rot, dir;
+				Color color;
+				float scale, length;
+
+				if (strcmp(directive, "resolution") == 0)
+				{
+					return sscanf_s(args, "%u %u", &pJobDesc->ImageWidth, &pJobDesc->ImageHeight) == 2;
+				}
+				else if (strcmp(directive, "integrator") == 0)
+				{
+					static const char* names[] = { "DirectLighting", "PathTracing", "BidirectionalPathTracing", "MultiplexedMLT", "StochasticPPM", "PathGuiding", "RLPathTracing" };
+					int type;
+					if (sscanf_s(args, "%63s", name, unsigned(sizeof(name))) != 1 || (type = FindName(name, names, _countof(names))) == INDEX_NONE)
+						return false;
+
+					pJobDesc->IntegratorType = EIntegratorType(type);
+					return true;
+				}
+				else if (strcmp(directive, "sampler") == 0)
+				{
+					static const char* names[] = { "Random", "Sobol", "Metropolis", "ZSobol" };
+					int type;
+					if (sscanf_s(args, "%63s", name, unsigned(sizeof(name))) != 1 || (type = FindName(name, names, _countof(names))) == INDEX_NONE)
+						return false;
+
+					pJobDesc->SamplerType = ESamplerType(type);
+					return true;
+				}
+				else if (strcmp(directive, "filter") == 0)
+				{
+					static const char* names[] = { "Box", "Gaussian", "MitchellNetravali" };
+					int type;
+					if (sscanf_s(args, "%63s", name, unsigned(sizeof(name))) != 1 || (type = FindName(name, names, _countof(names))) == INDEX_NONE)
+						return false;
+
+					pJobDesc->FilterType = EFilterType(type);
+					return true;
+				}
+				else if (strcmp(directive, "spp") == 0)
+				{
+					return sscanf_s(args, "%u", &pJobDesc->SamplesPerPixel) == 1;
+				}
+				else if (strcmp(directive, "maxdepth") == 0)
+				{
+					return sscanf_s(args, "%u", &pJobDesc->MaxPathLength) == 1;
+				}
+				else if (strcmp(directive, "subsurface") == 0)
+				{
+					static const char* names[] = { "Stochastic", "Hierarchical" };
+					int type;
+					if (sscanf_s(args, "%63s", name, unsigned(sizeof(name))) != 1 || (type = FindName(name, names, _countof(names))) == INDEX_NONE)
+						return false;
+
+					pJobDesc->SubsurfaceMode = ESubsurfaceMode(type);
+					return true;
+				}
+				else if (strcmp(directive, "camera") == 0)
+				{
+					CameraParameters& params = pJobDesc->CameraParams;
+					return sscanf_s(args, "%f %f %f %f %f %f %f %f %f",
+						&params.Pos.x, &params.Pos.y, &params.Pos.z,
+						&params.Target.x, &params.Target.y, &params.Target.z,
+						&params.Up.x, &params.Up.y, &params.Up.z) == 9;
+				}
+				else if (strcmp(directive, "lens") == 0)
+				{
+					CameraParameters& params = pJobDesc->CameraParams;
+					return sscanf_s(args, "%i %f %f %f", &params.FocalLengthMilliMeters, &params.FStop, &params.FocusPlaneDist, &params.Vignette) == 4;
+				}
+				else if (strcmp(directive, "mesh") == 0)
+				{
+					BSDFType bsdfType;
+					if (sscanf_s(args, "%259s %63s %f %f %f %f %f %f %f %f %f %f",
+						name, unsigned(sizeof(name)), bsdfName, unsigned(sizeof(bsdfName)),
+						&color.r, &color.g, &color.b,
+						&pos.x, &pos.y, &pos.z,
+						&scale,
+						&rot.x, &rot.y, &rot.z) != 12 || !ParseBSDFType(bsdfName, &bsdfType))
+						return false;
+
+					Primitive* pMesh = new Primitive;
+					pMesh->LoadMesh(name, bsdfType, color, pos, scale * Vector3::UNIT_SCALE, rot, true);
+					pScene->AddPrimitive(pMesh);
+					return true;
+				}
+				else if (strcmp(directive, "sphere") == 0)
+				{
+					BSDFType bsdfType;
+					if (sscanf_s(args, "%f %63s %f %f %f %f %f %f",
+						&length, bsdfName, unsigned(sizeof(bsdfName)),
+						&color.r, &color.g, &color.b,
+						&pos.x, &pos.y, &pos.z) != 8 || !ParseBSDFType(bsdfName, &bsdfType))
+						return false;
+
+					Primitive* pSphere = new Primitive;
+					pSphere->LoadSphere(length, bsdfType, color, 128, 64, pos);
+					pScene->AddPrimitive(pSphere);
+					return true;
+				}
+				else if (strcmp(directive, "plane") == 0)
+				{
+					BSDFType bsdfType;
+					if (sscanf_s(args, "%f %63s %f %f %f %f %f %f %f %f %f",
+						&length, bsdfName, unsigned(sizeof(bsdfName)),
+						&color.r, &color.g, &color.b,
+						&pos.x, &pos.y, &pos.z,
+						&rot.x, &rot.y, &rot.z) != 11 || !ParseBSDFType(bsdfName, &bsdfType))
+						return false;
+
+					Primitive* pPlane = new Primitive;
+					pPlane->LoadPlane(length, bsdfType, color, pos, Vector3::UNIT_SCALE, rot);
+					pScene->AddPrimitive(pPlane);
+					return true;
+				}
+				else if (strcmp(directive, "arealight") == 0)
+				{
+					if (sscanf_s(args, "%f %f %f %f %f %f %f %f %f %f",
+						&length,
+						&color.r, &color.g, &color.b,
+						&pos.x, &pos.y, &pos.z,
+						&rot.x, &rot.y, &rot.z) != 10)
+						return false;
+
+					Primitive* pPlane = new Primitive;
+					pPlane->LoadPlane(length, BSDFType::Diffuse, Color(0.2f), pos, Vector3::UNIT_SCALE, rot);
+					pScene->AddLight(new AreaLight(pPlane, color));
+					return true;
+				}
+				else if (strcmp(directive, "pointlight") == 0)
+				{
+					if (sscanf_s(args, "%f %f %f %f %f %f", &pos.x, &pos.y, &pos.z, &color.r, &color.g, &color.b) != 6)
+						return false;
+
+					pScene->AddLight(new PointLight(pos, color));
+					return true;
+				}
+				else if (strcmp(directive, "dirlight") == 0)
+				{
+					float cone;
+					if (sscanf_s(args, "%f %f %f %f %f %f %f", &dir.x, &dir.y, &dir.z, &color.r, &color.g, &color.b, &cone) != 7)
+						return false;
+
+					pScene->AddLight(new DirectionalLight(dir, color, pScene, cone));
+					return true;
+				}
+				else if (strcmp(directive, "envmap") == 0)
+				{
+					float rotation;
+					if (sscanf_s(args, "%259s %f %f", name, unsigned(sizeof(name)), &scale, &rotation) != 3)
+						return false;
+
+					pScene->AddLight(new EnvironmentLight(name, pScene, scale, rotation));
+					return true;
+				}
+				else if (strcmp(directive, "envcolor") == 0)
+				{
+					if (sscanf_s(args, "%f %f %f", &color.r, &color.g, &color.b) != 3)
+						return false;
+
+					pScene->AddLight(new EnvironmentLight(color, pScene));
+					return true;
+				}
+				else if (strcmp(directive, "sky") == 0)
+				{
+					float turbidity, albedo, elevation, rotation;
+					if (sscanf_s(args, "%f %f %f %f", &turbidity, &albedo, &elevation, &rotation) != 4)
+						return false;
+
+					pScene->AddLight(new EnvironmentLight(Color(turbidity), Color(albedo), elevation, pScene, rotation));
+					return true;
+				}
+				else if (strcmp(directive, "scale") == 0)
+				{
+					if (sscanf_s(args, "%f", &scale) != 1 || scale <= 0.0f)
+						return false;
+
+					pScene->SetScale(scale);
+					return true;
+				}
+				else if (strcmp(directive, "gridmedium") == 0)
+				{
+					BoundingBox bounds;
+					Vector3 sigmaS, sigmaA;
+					float g;
+					if (sscanf_s(args, "%259s %f %f %f %f %f %f %f %f %f %f %f %f %f",
+						name, unsigned(sizeof(name)),
+						&bounds.mMin.x, &bounds.mMin.y, &bounds.mMin.z,
+						&bounds.mMax.x, &bounds.mMax.y, &bounds.mMax.z,
+						&sigmaS.x, &sigmaS.y, &sigmaS.z,
+						&sigmaA.x, &sigmaA.y, &sigmaA.z,
+						&g) != 14 || pScene->GetPrimitives().Size() == 0)
+						return false;
+
+					GridMedium* pMedium = GridMedium::LoadFromFile(name, bounds, sigmaS, sigmaA, g);
+					if (!pMedium)
+					{
+						printf("Unable to load voxel file %s\n", name);
+						return false;
+					}
+
+					pScene->GetPrimitives().Top()->SetInsideMedium(pScene->AddMedium(pMedium));
+					return true;
+				}
+
+				return false;
+			}
+
+			static int FindName(const char* name, const char* names[], const int count)
+			{
+				for (auto i = 0; i < count; i++)
+				{
+					if (_stricmp(name, names[i]) == 0)
+						return i;
+				}
+
+				return INDEX_NONE;
+			}
+
+			static bool ParseBSDFType(const char* name, BSDFType* pType)
+			{
+				static const char* names[] = { "Diffuse", "Mirror", "Glass", "RoughConductor", "RoughDielectric", "Disney" };
+				const int type = FindName(name, names, _countof(names));
+				if (type == INDEX_NONE)
+					return false;
+
+				*pType = BSDFType(type);
+				return true;
+			}
+		};
+	}
+}
@@ -11,6 +11,7 @@
 #include "BSDFs/RoughConductor.h"
 #include "BSDFs/RoughDielectric.h"
 #include "Core/BSSRDF.h"
+#include "Core/SnapshotWriter.h"
 #include "Media/Homogeneous.h"
 #include "Tracer/BVHBuildTask.h"
 
@@ -29,16 +30,20 @@ using namespace EDX::GUI;
 
 Renderer*	gpRenderer = nullptr;
 Previewer*	gpPreview = nullptr;
+SnapshotWriter*	gpSnapshotWriter = nullptr;
 bool gRendering = false;
 Color gCursorColor;
 
 bool gRenderGui = true;
+char gCheckpointPath[MAX_PATH];
+bool gResumeFailed = false;
 
 void OnInit(Object* pSender, EventArgs args)
 {
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
 	gpRenderer = new Renderer;
+	gpSnapshotWriter = new SnapshotWriter;
 
 	Scene* pScene = gpRenderer->GetScene();
 	Primitive* pMesh = new Primitive;
@@ -117,6 +122,9 @@ void OnInit(Object* pSender, EventArgs args)
 	jobDesc.CameraParams.Target = Vector3(-5.86896896f, 14.0666752f, 15.6682129f);
 	gpRenderer->SetJobDesc(jobDesc);
 
+	sprintf_s(gCheckpointPath, MAX_PATH, "%s../../Media/EDXRay.checkpoint", Application::GetBaseDirectory());
+	gpRenderer->EnableCheckpoint(gCheckpointPath, 60.0f);
+
 	gpPreview = new Previewer;
 	gpPreview->Initialize(*pScene, gpRenderer->GetCamera());
 
@@ -124,6 +132,30 @@ void OnInit(Object* pSender, EventArgs args)
 	EDXGui::Init();
 }
 
+// Replacing the environment light deletes the old one, so a running render is stopped for the swap and restarted on
+// the new light afterwards
+const EnvironmentLight* ReplaceEnvironmentLight(EnvironmentLight* pLight, const float scale)
+{
+	const bool wasRendering = gRendering;
+	if (wasRendering)
+	{
+		gpRenderer->StopRenderTasks();
+		gRendering = false;
+	}
+
+	pLight->SetScaling(scale);
+	gpRenderer->GetScene()->AddLight(pLight);
+
+	if (wasRendering)
+	{
+		gpRenderer->InitComponent();
+		gpRenderer->QueueRenderTasks();
+		gRendering = true;
+	}
+
+	return pLight;
+}
+
 void OnRender(Object* pSender, EventArgs args)
 {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -168,19 +200,53 @@ void OnRender(Object* pSender, EventArgs args)
 				pJobDesc->CameraParams.FocusPlaneDist = gpPreview->GetCamera().mFocalPlaneDist;
 				gpRenderer->InitComponent();
 				gpRenderer->QueueRenderTasks();
+				gResumeFailed = false;
 			}
 			else
 			{
 				gpRenderer->StopRenderTasks();
 			}
 		}
+		if (!gRendering && EDXGui::Button("Resume Rendering"))
+		{
+			pJobDesc->CameraParams.Pos = gpPreview->GetCamera().mPos;
+			pJobDesc->CameraParams.Target = gpPreview->GetCamera().mTarget;
+			pJobDesc->CameraParams.Up = gpPreview->GetCamera().mUp;
+			pJobDesc->CameraParams.FocusPlaneDist = gpPreview->GetCamera().mFocalPlaneDist;
+			gpRenderer->InitComponent();
+
+			// A checkpoint from another integrator or view, or a corrupt file, is not silently replaced by a new render
+			gResumeFailed = !gpRenderer->ResumeFromCheckpoint(gCheckpointPath);
+			if (!gResumeFailed)
+			{
+				gpRenderer->QueueRenderTasks();
+				gRendering = true;
+			}
+		}
+		if (gResumeFailed && !gRendering)
+			EDXGui::Text("Unable to resume from the checkpoint");
 		if (EDXGui::Button("Save Image"))
 		{
 			char name[256];
 			char directory[MAX_PATH];
 			sprintf_s(directory, MAX_PATH, "%s../../Media", Application::GetBaseDirectory());
 			sprintf_s(name, "%sEDXRay_%i.bmp", directory, int(time(0)));
-			Bitmap::SaveBitmapFile(name, (float*)gpRenderer->GetFilm()->GetPixelBuffer(), pJobDesc->ImageWidth, pJobDesc->ImageHeight);
+			// The denoised image only exists in the display buffer
+			if (pJobDesc->UseRHF)
+				gpSnapshotWriter->RequestDisplaySnapshot(gpRenderer->GetFilm(), name, EImageFormat::BMP);
+			else
+				gpSnapshotWriter->RequestSnapshot(gpRenderer->GetFilm(), name, EImageFormat::BMP);
+		}
+		if (EDXGui::Button("Save HDR Image"))
+		{
+			char name[256];
+			char directory[MAX_PATH];
+			sprintf_s(directory, MAX_PATH, "%s../../Media", Application::GetBaseDirectory());
+			sprintf_s(name, "%sEDXRay_%i.pfm", directory, int(time(0)));
+			if (pJobDesc->UseRHF)
+				gpSnapshotWriter->RequestDisplaySnapshot(gpRenderer->GetFilm(), name, EImageFormat::PFM);
+			else
+				gpSnapshotWriter->RequestSnapshot(gpRenderer->GetFilm(), name, EImageFormat::PFM);
 		}
 
 		static bool showRenderSettings = true;
@@ -191,17 +257,20 @@ void OnRender(Object* pSender, EventArgs args)
 				{ 1, "Path Tracing" },
 				{ 2, "BD Path Tracing" },
 				{ 3, "Multiplexed MLT" },
-				{ 4, "RL Path Tracing" }
+				{ 4, "Stochastic PPM" },
+				{ 5, "Path Guiding" },
+				{ 6, "RL Path Tracing" }
 			};
-			EDXGui::ComboBox("Integrator", integratoriItems, 5, (int&)pJobDesc->IntegratorType);
+			EDXGui::ComboBox("Integrator", integratoriItems, 7, (int&)pJobDesc->IntegratorType);
 
 			static int sampler = 0;
 			ComboBoxItem samplerItems[] = {
 				{ 0, "Random" },
 				{ 1, "Sobol" },
-				{ 2, "Metroplis" }
+				{ 2, "Metroplis" },
+				{ 3, "Z-Sobol" }
 			};
-			EDXGui::ComboBox("Sampler", samplerItems, 3, (int&)pJobDesc->SamplerType);
+			EDXGui::ComboBox("Sampler", samplerItems, 4, (int&)pJobDesc->SamplerType);
 
 			static int filter = 0;
 			ComboBoxItem filteriItems[] = {
@@ -211,6 +280,12 @@ void OnRender(Object* pSender, EventArgs args)
 			};
 			EDXGui::ComboBox("Filter", filteriItems, 3, (int&)pJobDesc->FilterType);
 
+			ComboBoxItem subsurfaceItems[] = {
+				{ 0, "Stochastic" },
+				{ 1, "Hierarchical" }
+			};
+			EDXGui::ComboBox("Subsurface", subsurfaceItems, 2, (int&)pJobDesc->SubsurfaceMode);
+
 			EDXGui::InputDigit((int&)pJobDesc->MaxPathLength, "Max Length");
 			EDXGui::InputDigit((int&)pJobDesc->SamplesPerPixel, "Max Samples");
 			EDXGui::CheckBox("Adaptive Sampling", pJobDesc->AdaptiveSample);
@@ -260,10 +335,13 @@ void OnRender(Object* pSender, EventArgs args)
 		{
 			Vector3 center;
 			float radius;
-			gpRenderer->GetScene()->WorldBounds().BoundingSphere(&center, &radius);
+			gpRenderer->GetScene()->BoundingSphere(&center, &radius);
 			EDXGui::Text("Scene Size: %.2fm", 2.0f * radius);
 			if (EDXGui::Slider<float>("Scene Scale", &sceneScale, 0.0f, 10.0f))
 			{
+				// The geometry and its accelerators are rebuilt, so rendering cannot continue alongside
+				gpRenderer->StopRenderTasks();
+				gRendering = false;
 				gpRenderer->GetScene()->SetScale(sceneScale);
 			}
 			if (EDXGui::Button("Environment Light"))
@@ -275,30 +353,45 @@ void OnRender(Object* pSender, EventArgs args)
 					sprintf_s(directory, MAX_PATH, "%s../../Media", Application::GetBaseDirectory());
 					if (Application::GetMainWindow()->OpenFileDialog(directory, "", "", filePath))
 					{
-						gpRenderer->GetScene()->AddLight(new EnvironmentLight(filePath, gpRenderer->GetScene(), 1.0f, envLightRotation));
+						pEnvLight = ReplaceEnvironmentLight(new EnvironmentLight(filePath, gpRenderer->GetScene(), 1.0f,
+							Math::ToDegrees(envLightRotation)), envLightScale);
 					}
 				}
 				else
 				{
-					gpRenderer->GetScene()->AddLight(new EnvironmentLight(Color(turbidity), groundAlbedo, 40.0f,
-						gpRenderer->GetScene(), envLightRotation));
+					pEnvLight = ReplaceEnvironmentLight(new EnvironmentLight(Color(turbidity), groundAlbedo, 40.0f,
+						gpRenderer->GetScene(), Math::ToDegrees(envLightRotation)), envLightScale);
 				}
 			}
 
 			EDXGui::CheckBox("Use Sky Light", useSkyLight);
 			if (useSkyLight)
 			{
-				EDXGui::Slider<float>("Turbidity", &turbidity, 1.0f, 10.0f);
+				bool skyChanged = EDXGui::Slider<float>("Turbidity", &turbidity, 1.0f, 10.0f);
+
+				const Color prevAlbedo = groundAlbedo;
 				EDXGui::ColorSlider(&groundAlbedo);
+				for (auto i = 0; i < 3; i++)
+					skyChanged |= groundAlbedo[i] != prevAlbedo[i];
+
+				// Sky maps are generated in parallel and cached per setting, so edits apply while dragging, a running
+				// render restarts on the new sky
+				if (skyChanged && pEnvLight && pEnvLight->HasSun())
+				{
+					pEnvLight = ReplaceEnvironmentLight(new EnvironmentLight(Color(turbidity), groundAlbedo, 40.0f,
+						gpRenderer->GetScene(), Math::ToDegrees(envLightRotation)), envLightScale);
+				}
 			}
 
-			if (EDXGui::Slider<float>("Env Light Rotation", &envLightRotation, -float(Math::EDX_PI), float(Math::EDX_PI)))
+			if (EDXGui::Slider<float>("Env Light Rotation", &envLightRotation, -float(Math::EDX_PI), float(Math::EDX_PI)) && pEnvLight)
 			{
 				pEnvLight->SetRotation(envLightRotation);
+				gpRenderer->GetScene()->MarkModified();
 			}
-			if (EDXGui::Slider<float>("Env Light Scaling", &envLightScale, 0.0f, 5.0f))
+			if (EDXGui::Slider<float>("Env Light Scaling", &envLightScale, 0.0f, 5.0f) && pEnvLight)
 			{
 				pEnvLight->SetScaling(envLightScale);
+				gpRenderer->GetScene()->MarkModified();
 			}
 
 			EDXGui::CloseHeaderSection();
@@ -570,6 +663,7 @@ void OnRelease(Object* pSender, EventArgs args)
 {
 	gpRenderer->StopRenderTasks();
 
+	Memory::SafeDelete(gpSnapshotWriter);
 	Memory::SafeDelete(gpRenderer);
 	Memory::SafeDelete(gpPreview);
 	EDXGui::Release();